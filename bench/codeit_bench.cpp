@@ -0,0 +1,391 @@
+// Benchmarks for the text statistics engine, independent of the editor.
+//
+//   codeit_bench [--benchmark_filter=...]
+//
+// CODEIT_BENCH_CORPUS=file1:file2 adds a count benchmark for each file, so
+// real documents can be measured next to the synthetic corpora.
+// CODEIT_TEXTSCAN=sse2|scalar caps the SIMD kernels as in the editor.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "textscan.h"
+#include "textstats.h"
+
+// ---- Allocation counting ---------------------------------------------------
+
+namespace {
+
+std::atomic<int64_t> allocations{0};
+
+} // namespace
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Reports the allocations made since construction, per benchmark iteration.
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State &state)
+        : state(state), start(allocations.load(std::memory_order_relaxed)) {}
+
+    ~AllocationCounter() {
+        const int64_t made = allocations.load(std::memory_order_relaxed) - start;
+        state.counters["allocs/iter"] = benchmark::Counter(
+            static_cast<double>(made), benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State &state;
+    int64_t start;
+};
+
+// ---- Corpora ---------------------------------------------------------------
+
+constexpr size_t corpusBytes = 16 << 20;
+constexpr size_t longLineBytes = 100 << 20;
+
+// Word rules are the root rules here, so the ASCII fast path applies; the
+// process default may well be en_US_POSIX, which has its own.
+const icu::Locale &benchLocale() {
+    static const icu::Locale locale("en_US");
+    return locale;
+}
+
+template <size_t N>
+const char *pick(std::mt19937 &rng, const char *const (&items)[N]) {
+    return items[rng() % N];
+}
+
+std::string asciiCode(size_t bytes, bool lineBreaks) {
+    static const char *const tokens[] = {
+        "int", "const", "auto", "return", "for", "if", "while", "std::vector<int>",
+        "count", "total", "value_", "index", "=", "+=", "==", "(", ")", "{", "}",
+        ";", "0", "1", "42", "3.14", "0x7f", "\"text\"", "'c'", "->", "::", "<<",
+    };
+    std::mt19937 rng(1);
+    std::string text;
+    text.reserve(bytes + 128);
+    while (text.size() < bytes) {
+        const int indent = 4 * static_cast<int>(rng() % 4);
+        text.append(static_cast<size_t>(indent), ' ');
+        for (int n = 3 + static_cast<int>(rng() % 10); n > 0; --n) {
+            text += pick(rng, tokens);
+            text += ' ';
+        }
+        if (rng() % 5 == 0)
+            text += "// explain the line above in a few plain words";
+        text += lineBreaks ? '\n' : ' ';
+    }
+    return text;
+}
+
+std::string mixedCjkLatin(size_t bytes) {
+    static const char *const words[] = {
+        "统计", "文本", "编辑器", "字符", "日本語", "の", "テキスト", "を", "数える",
+        "한국어", "문장", "the", "editor", "counts", "words", "Unicode", "ICU", "2024",
+    };
+    static const char *const punctuation[] = {"", "", " ", "，", "。", "、", " ", ", "};
+    std::mt19937 rng(2);
+    std::string text;
+    text.reserve(bytes + 128);
+    while (text.size() < bytes) {
+        for (int n = 8 + static_cast<int>(rng() % 24); n > 0; --n) {
+            text += pick(rng, words);
+            text += pick(rng, punctuation);
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+std::string emojiHeavy(size_t bytes) {
+    static const char *const items[] = {
+        "\xF0\x9F\x98\x80",                                     // grinning face
+        "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD",                     // thumbs up, skin tone
+        "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB",         // woman technologist (ZWJ)
+        "\xF0\x9F\x87\xAB\xF0\x9F\x87\xAE",                     // flag pair
+        "\xE2\x9D\xA4\xEF\xB8\x8F",                             // heart, VS16
+        "ok", "nice", "ship it", " ", " ", "!",
+    };
+    std::mt19937 rng(3);
+    std::string text;
+    text.reserve(bytes + 128);
+    while (text.size() < bytes) {
+        for (int n = 4 + static_cast<int>(rng() % 16); n > 0; --n)
+            text += pick(rng, items);
+        text += '\n';
+    }
+    return text;
+}
+
+struct Corpus {
+    const char *name;
+    std::string (*make)();
+};
+
+const Corpus corpora[] = {
+    {"ascii_code", [] { return asciiCode(corpusBytes, true); }},
+    {"cjk_latin", [] { return mixedCjkLatin(corpusBytes); }},
+    {"emoji", [] { return emojiHeavy(corpusBytes); }},
+    {"one_line_100mb", [] { return asciiCode(longLineBytes, false); }},
+};
+
+const std::string &corpusText(size_t index) {
+    static std::vector<std::string> cache(std::size(corpora));
+    if (cache[index].empty())
+        cache[index] = corpora[index].make();
+    return cache[index];
+}
+
+size_t lineCountOf(const std::string &text) {
+    std::vector<int64_t> ends;
+    textscan::appendLineEnds(text.data(), text.size(), 0, ends);
+    return ends.size() + 1;
+}
+
+void reportCounts(benchmark::State &state, const std::string &text, const TextCounts &counts) {
+    const double iterations = static_cast<double>(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(iterations * static_cast<double>(text.size())));
+    state.counters["words/s"] = benchmark::Counter(
+        iterations * static_cast<double>(counts.words), benchmark::Counter::kIsRate);
+    state.counters["graphemes/s"] = benchmark::Counter(
+        iterations * static_cast<double>(counts.graphemes), benchmark::Counter::kIsRate);
+}
+
+// ---- Whole-text counting ---------------------------------------------------
+
+void countText(benchmark::State &state, const std::string &text, bool fastPath) {
+    TextCounter counter(benchLocale());
+    counter.setAsciiFastPath(fastPath);
+    std::vector<LineCounts> lines(lineCountOf(text));
+
+    TextCounts counts;
+    {
+        AllocationCounter allocs(state);
+        for (auto _ : state) {
+            std::fill(lines.begin(), lines.end(), LineCounts());
+            counter.countLines(text.data(), static_cast<int64_t>(text.size()),
+                               lines.data(), lines.size());
+            benchmark::DoNotOptimize(lines.data());
+        }
+    }
+    for (const LineCounts &line : lines)
+        counts += line;
+    reportCounts(state, text, counts);
+}
+
+// Args: corpus index, ASCII fast path on or off.
+void BM_Count(benchmark::State &state) {
+    const size_t index = static_cast<size_t>(state.range(0));
+    state.SetLabel(std::string(corpora[index].name) + (state.range(1) ? "" : "/icu_only"));
+    countText(state, corpusText(index), state.range(1) != 0);
+}
+
+// Arg: corpus index. What opening a UTF-8 file costs on top of reading it.
+void BM_ValidateUtf8(benchmark::State &state) {
+    const size_t index = static_cast<size_t>(state.range(0));
+    const std::string &text = corpusText(index);
+    state.SetLabel(std::string(corpora[index].name) + "/" + textscan::kernelName());
+    for (auto _ : state)
+        benchmark::DoNotOptimize(textscan::isValidUtf8(text.data(), text.size()));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+
+// Counts like StatsWorker: cut at split points into 1 MB chunks and share
+// them out among threads, each with its own pooled counter. Args: corpus
+// index, thread count.
+void BM_CountChunks(benchmark::State &state) {
+    const size_t index = static_cast<size_t>(state.range(0));
+    const unsigned threads = static_cast<unsigned>(state.range(1));
+    const std::string &text = corpusText(index);
+    state.SetLabel(corpora[index].name);
+
+    const char *data = text.data();
+    const int64_t length = static_cast<int64_t>(text.size());
+    std::vector<int64_t> cuts{0};
+    while (cuts.back() < length)
+        cuts.push_back(splitPointAfter(data, length, std::min<int64_t>(length, cuts.back() + (1 << 20))));
+
+    std::vector<std::vector<LineCounts>> chunks(cuts.size() - 1);
+    for (auto _ : state) {
+        std::atomic<size_t> next{0};
+        auto work = [&] {
+            for (size_t i; (i = next.fetch_add(1)) < chunks.size();) {
+                TextCounter counter(benchLocale());
+                counter.countLines(data + cuts[i], cuts[i + 1] - cuts[i], chunks[i]);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+            pool.emplace_back(work);
+        work();
+        for (std::thread &t : pool)
+            t.join();
+    }
+
+    TextCounts counts;
+    for (const std::vector<LineCounts> &chunk : chunks) {
+        for (const LineCounts &line : chunk)
+            counts += line;
+    }
+    reportCounts(state, text, counts);
+}
+
+// ---- Edit latency ----------------------------------------------------------
+
+// In-memory document with Scintilla's line model.
+class StringSource : public TextSource {
+public:
+    explicit StringSource(std::string content) : text(std::move(content)) {
+        lineStarts.push_back(0);
+        std::vector<int64_t> ends;
+        textscan::appendLineEnds(text.data(), text.size(), 0, ends);
+        lineStarts.insert(lineStarts.end(), ends.begin(), ends.end());
+    }
+
+    int64_t length() const override { return static_cast<int64_t>(text.size()); }
+    int64_t lineCount() const override { return static_cast<int64_t>(lineStarts.size()); }
+
+    int64_t lineFromPosition(int64_t position) const override {
+        return std::upper_bound(lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin() - 1;
+    }
+
+    int64_t lineStart(int64_t line) const override { return lineStarts[static_cast<size_t>(line)]; }
+
+    const char *rangePointer(int64_t start, int64_t) const override { return text.data() + start; }
+
+    // Inserts or removes one byte that is not a line end.
+    void insertByte(int64_t position, char c) {
+        text.insert(text.begin() + position, c);
+        shiftLinesAfter(position, 1);
+    }
+
+    void removeByte(int64_t position) {
+        text.erase(text.begin() + position);
+        shiftLinesAfter(position, -1);
+    }
+
+private:
+    void shiftLinesAfter(int64_t position, int64_t delta) {
+        for (size_t line = static_cast<size_t>(lineFromPosition(position)) + 1; line < lineStarts.size(); ++line)
+            lineStarts[line] += delta;
+    }
+
+    std::string text;
+    std::vector<int64_t> lineStarts;
+};
+
+// Types one character in the middle of a document of range(0) MB of code
+// and re-counts, as DocumentStats does for a keystroke. Only the statistics
+// update is timed, not the edit of the backing string, which is why the
+// iteration count is fixed.
+void BM_TypeCharacter(benchmark::State &state) {
+    StringSource source(asciiCode(static_cast<size_t>(state.range(0)) << 20, true));
+    IncrementalStats stats(source, benchLocale());
+    stats.recountDirty();
+
+    const int64_t position = source.lineStart(source.lineCount() / 2) + 4;
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        source.insertByte(position, 'x');
+        const auto start = std::chrono::steady_clock::now();
+        stats.textChanged(position, 0);
+        stats.recountDirty();
+        benchmark::DoNotOptimize(stats.totals());
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        source.removeByte(position);
+        stats.textChanged(position, 0);
+        stats.recountDirty();
+    }
+}
+
+// Looks up the counts of a selection of range(0) whole lines, as the status
+// bar does on every selection change.
+void BM_SelectionTotals(benchmark::State &state) {
+    StringSource source(asciiCode(64 << 20, true));
+    IncrementalStats stats(source, benchLocale());
+    stats.recountDirty();
+
+    const int64_t firstLine = 10;
+    const int64_t lastLine = std::min(source.lineCount() - 1, firstLine + state.range(0));
+    const int64_t start = source.lineStart(firstLine) + 3;
+    const int64_t end = source.lineStart(lastLine) + 5;
+    AllocationCounter allocs(state);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(stats.rangeTotals(start, end));
+}
+
+void registerBenchmarks() {
+    for (size_t i = 0; i < std::size(corpora); ++i) {
+        for (int fastPath : {1, 0})
+            benchmark::RegisterBenchmark("BM_Count", BM_Count)
+                ->Args({static_cast<int64_t>(i), fastPath})->Unit(benchmark::kMillisecond);
+    }
+
+    for (size_t i = 0; i < std::size(corpora); ++i)
+        benchmark::RegisterBenchmark("BM_ValidateUtf8", BM_ValidateUtf8)
+            ->Arg(static_cast<int64_t>(i))->Unit(benchmark::kMillisecond);
+
+    const int64_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < std::size(corpora); ++i) {
+        for (int64_t threads = 1; threads <= hardware; threads *= 2)
+            benchmark::RegisterBenchmark("BM_CountChunks", BM_CountChunks)
+                ->Args({static_cast<int64_t>(i), threads})->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::RegisterBenchmark("BM_TypeCharacter", BM_TypeCharacter)
+        ->Arg(1)->Arg(16)->Arg(128)->Iterations(200)->UseManualTime()->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_SelectionTotals", BM_SelectionTotals)
+        ->Arg(10)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+    // Real documents named in the environment.
+    if (const char *files = std::getenv("CODEIT_BENCH_CORPUS")) {
+        std::stringstream list(files);
+        for (std::string path; std::getline(list, path, ':');) {
+            if (path.empty())
+                continue;
+            benchmark::RegisterBenchmark(("BM_CountFile/" + path).c_str(), [path](benchmark::State &state) {
+                std::ifstream in(path, std::ios::binary);
+                const std::string text{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+                if (!in && text.empty()) {
+                    state.SkipWithError("cannot read corpus file");
+                    return;
+                }
+                countText(state, text, true);
+            })->Unit(benchmark::kMillisecond);
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    registerBenchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
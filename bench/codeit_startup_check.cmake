@@ -0,0 +1,24 @@
+# Starts codeit on a file large enough for the large file view and checks
+# that startup runs to the end, menus and all, with nothing but that view
+# ever shown. Run by ctest with -DCODEIT=<path to codeit> -DWORK=<directory>.
+
+file(MAKE_DIRECTORY "${WORK}")
+set(big "${WORK}/startup_big.log")
+# Sparse, so it costs no disk; just over the 256 MB threshold.
+execute_process(COMMAND truncate -s 257M "${big}" RESULT_VARIABLE made)
+if (NOT made EQUAL 0)
+    message(FATAL_ERROR "cannot create ${big}")
+endif()
+
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E env
+        QT_QPA_PLATFORM=offscreen CODEIT_STARTUP_TIME=1 CODEIT_QUIT_AFTER_STARTUP=1
+        "${CODEIT}" "${big}"
+    RESULT_VARIABLE result
+    ERROR_VARIABLE output
+    TIMEOUT 60)
+file(REMOVE "${big}")
+
+if (NOT result EQUAL 0 OR NOT output MATCHES "ready [0-9]+ ms")
+    message(FATAL_ERROR "startup did not finish (${result}):\n${output}")
+endif()
@@ -0,0 +1,206 @@
+// Differential check of TextCounter's ASCII fast path against ICU alone.
+//
+//   codeit_textstats_check [strings per corpus]
+//
+// Counts random mixed-script strings with the fast path on and off, whole
+// and cut at splitPointAfter() points the way StatsWorker cuts them, and
+// fails if any line's counts differ. The kernel is picked once per process,
+// so run it once per CODEIT_TEXTSCAN setting; ctest does.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "textscan.h"
+#include "textstats.h"
+
+namespace {
+
+// Root word rules, which the fast path needs; see codeit_bench.
+const icu::Locale &checkLocale() {
+    static const icu::Locale locale("en_US");
+    return locale;
+}
+
+// ---- Corpora ---------------------------------------------------------------
+
+const char *const asciiPieces[] = {
+    "int", "value_", "x", "42", "3.14", "1,000", "it's", "e.g.", "a.b", "user@host", "_",
+    "__init__", "v2", "0x7f", "can't", "1'000", "1;2", "=", "+=", "(", ")", "{", "}", ";",
+    ",", ".", "'", "\"", "-", "/", "\t", " ", "  ", "    ",
+};
+
+const char *const cjkLatinPieces[] = {
+    "统计", "文本", "编辑器", "字符", "日本語", "の", "テキスト", "を", "数える", "한국어",
+    "문장", "the", "editor", "Unicode", "ICU", "2024", "，", "。", "、", " ", "café", "naïve",
+    "Straße", "ÆØÅ",
+};
+
+const char *const emojiPieces[] = {
+    "\xF0\x9F\x98\x80",                             // grinning face
+    "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD",             // thumbs up, skin tone
+    "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB", // woman technologist (ZWJ)
+    "\xF0\x9F\x87\xAB\xF0\x9F\x87\xAE",             // flag pair
+    "\xE2\x9D\xA4\xEF\xB8\x8F",                     // heart, VS16
+    "e\xCC\x81",                                    // e, combining acute
+    "ok", "ship it", " ", "!",
+};
+
+const char *const lineEnds[] = {"\n", "\r\n", "\r", "\n\n", "\r\r\n"};
+
+struct Corpus {
+    const char *name;
+    // Percentages of ASCII, CJK/Latin and emoji pieces; the rest are line
+    // ends.
+    int ascii;
+    int cjkLatin;
+    int emoji;
+};
+
+const Corpus corpora[] = {
+    {"ascii", 90, 0, 0},
+    {"cjk_latin", 40, 50, 0},
+    {"emoji", 40, 0, 50},
+    {"crlf_mix", 50, 15, 15},
+};
+
+template <size_t N>
+const char *pick(std::mt19937 &rng, const char *const (&items)[N]) {
+    return items[rng() % N];
+}
+
+// Lengths up to a few hundred bytes, so that runs start and end anywhere in
+// and across the 64-byte blocks of the fast path.
+std::string makeText(std::mt19937 &rng, const Corpus &corpus) {
+    std::string text;
+    const int pieces = static_cast<int>(rng() % 120);
+    for (int i = 0; i < pieces; ++i) {
+        const int roll = static_cast<int>(rng() % 100);
+        if (roll < corpus.ascii)
+            text += pick(rng, asciiPieces);
+        else if (roll < corpus.ascii + corpus.cjkLatin)
+            text += pick(rng, cjkLatinPieces);
+        else if (roll < corpus.ascii + corpus.cjkLatin + corpus.emoji)
+            text += pick(rng, emojiPieces);
+        else
+            text += pick(rng, lineEnds);
+    }
+    return text;
+}
+
+// ---- Counting --------------------------------------------------------------
+
+size_t lineCountOf(const std::string &text) {
+    std::vector<int64_t> ends;
+    textscan::appendLineEnds(text.data(), text.size(), 0, ends);
+    return ends.size() + 1;
+}
+
+std::vector<LineCounts> countWhole(TextCounter &counter, const std::string &text) {
+    std::vector<LineCounts> lines;
+    counter.countLines(text.data(), static_cast<int64_t>(text.size()), lines);
+    return lines;
+}
+
+// Counts text in pieces of about chunkBytes, cut and summed as StatsWorker
+// does.
+std::vector<LineCounts> countChunked(TextCounter &counter, const std::string &text, int64_t chunkBytes) {
+    const char *data = text.data();
+    const int64_t length = static_cast<int64_t>(text.size());
+    std::vector<int64_t> cuts{0};
+    while (cuts.back() < length)
+        cuts.push_back(splitPointAfter(data, length, std::min(length, cuts.back() + chunkBytes)));
+
+    std::vector<LineCounts> lines(lineCountOf(text));
+    size_t line = 0;
+    std::vector<LineCounts> chunk;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        counter.countLines(data + cuts[i], cuts[i + 1] - cuts[i], chunk);
+        for (size_t j = 0; j < chunk.size(); ++j)
+            lines[std::min(line + j, lines.size() - 1)] += chunk[j];
+        line += chunk.size() - 1;
+    }
+    return lines;
+}
+
+bool same(const LineCounts &a, const LineCounts &b) {
+    return a.words == b.words && a.graphemes == b.graphemes && a.codePoints == b.codePoints;
+}
+
+void printEscaped(const std::string &text) {
+    for (unsigned char c : text) {
+        if (c == '\n')
+            std::fputs("\\n", stderr);
+        else if (c == '\r')
+            std::fputs("\\r", stderr);
+        else if (c == '\t')
+            std::fputs("\\t", stderr);
+        else if (c < 0x20 || c == '\\')
+            std::fprintf(stderr, "\\x%02x", c);
+        else
+            std::fputc(c, stderr);
+    }
+}
+
+// Reports the first line where got differs from expected.
+bool compare(const char *what, const std::string &text, const std::vector<LineCounts> &expected,
+             const std::vector<LineCounts> &got) {
+    if (expected.size() != got.size()) {
+        std::fprintf(stderr, "%s: %zu lines, expected %zu\n  text: \"", what, got.size(), expected.size());
+        printEscaped(text);
+        std::fputs("\"\n", stderr);
+        return false;
+    }
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (same(expected[i], got[i]))
+            continue;
+        std::fprintf(stderr,
+                     "%s: line %zu has %u words, %u graphemes, %u code points; "
+                     "ICU has %u, %u, %u\n  text: \"",
+                     what, i, got[i].words, got[i].graphemes, got[i].codePoints,
+                     expected[i].words, expected[i].graphemes, expected[i].codePoints);
+        printEscaped(text);
+        std::fputs("\"\n", stderr);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const int strings = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    if (!BreakIteratorPool::instance().hasRootRules(checkLocale())) {
+        std::fprintf(stderr, "codeit_textstats_check: %s lacks the root rules; nothing to check\n",
+                     checkLocale().getName());
+        return 1;
+    }
+
+    TextCounter fast(checkLocale());
+    TextCounter icu(checkLocale());
+    icu.setAsciiFastPath(false);
+
+    std::mt19937 rng(5);
+    int failures = 0;
+    for (const Corpus &corpus : corpora) {
+        for (int i = 0; i < strings && failures < 10; ++i) {
+            const std::string text = makeText(rng, corpus);
+            const std::vector<LineCounts> expected = countWhole(icu, text);
+            if (!compare(corpus.name, text, expected, countWhole(fast, text)))
+                ++failures;
+            const int64_t chunkBytes = 1 + static_cast<int64_t>(rng() % 256);
+            if (!compare(corpus.name, text, expected, countChunked(fast, text, chunkBytes)))
+                ++failures;
+        }
+        std::printf("%s: %d strings, kernel %s\n", corpus.name, strings, textscan::kernelName());
+    }
+    if (failures > 0) {
+        std::fprintf(stderr, "codeit_textstats_check: fast path differs from ICU\n");
+        return 1;
+    }
+    return 0;
+}
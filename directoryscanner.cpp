@@ -0,0 +1,314 @@
+#include "directoryscanner.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// getdents64 fills this much per call: about four thousand entries of
+// typical length.
+constexpr size_t direntBytes = 256 << 10;
+
+// More than a .gitignore needs; a larger one is read this far.
+constexpr qint64 maxIgnoreBytes = 1 << 20;
+
+// Time the GUI thread spends on listings before it lets the event loop
+// paint and take input, in milliseconds.
+constexpr qint64 deliverMsecs = 8;
+
+struct RawEntry {
+    std::string name;
+    bool isDirectory;
+};
+
+#ifdef Q_OS_UNIX
+// Whether name in the directory open as fd is a directory, following a
+// symbolic link.
+bool isDirectoryAt(int fd, const char *name) {
+    struct stat status;
+    return ::fstatat(fd, name, &status, 0) == 0 && S_ISDIR(status.st_mode);
+}
+#endif
+
+// Appends the entries of path but . and .. to entries. Returns false and
+// sets error if the directory cannot be read to the end.
+bool readDirectory(const std::string &path, std::vector<RawEntry> &entries, QString *error) {
+#if defined(Q_OS_LINUX)
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+    std::vector<char> buffer(direntBytes);
+    bool ok = true;
+    for (;;) {
+        const long n = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            *error = QString::fromLocal8Bit(std::strerror(errno));
+            ok = false;
+            break;
+        }
+        if (n == 0)
+            break;
+        // struct linux_dirent64: d_ino (8 bytes), d_off (8), d_reclen (2),
+        // d_type (1), then the name, NUL-terminated.
+        for (long offset = 0; offset < n;) {
+            const char *record = buffer.data() + offset;
+            unsigned short length;
+            std::memcpy(&length, record + 16, sizeof length);
+            const unsigned char type = static_cast<unsigned char>(record[18]);
+            const char *name = record + 19;
+            offset += length;
+            if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0)
+                continue;
+            // Some file systems leave the type to a stat.
+            const bool isDirectory = type == DT_DIR
+                || ((type == DT_UNKNOWN || type == DT_LNK) && isDirectoryAt(fd, name));
+            entries.push_back({name, isDirectory});
+        }
+    }
+    ::close(fd);
+    return ok;
+#elif defined(Q_OS_UNIX)
+    DIR *dir = ::opendir(path.c_str());
+    if (!dir) {
+        *error = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+    errno = 0;
+    while (const dirent *entry = ::readdir(dir)) {
+        if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+            entries.push_back({entry->d_name, isDirectoryAt(::dirfd(dir), entry->d_name)});
+    }
+    const bool ok = errno == 0;
+    if (!ok)
+        *error = QString::fromLocal8Bit(std::strerror(errno));
+    ::closedir(dir);
+    return ok;
+#else
+    const QDir dir(QFile::decodeName(path.c_str()));
+    if (!dir.exists()) {
+        *error = "No such directory";
+        return false;
+    }
+    for (const QString &name : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System))
+        entries.push_back({QFile::encodeName(name).toStdString(), true});
+    for (const QString &name : dir.entryList(QDir::Files | QDir::Hidden | QDir::System))
+        entries.push_back({QFile::encodeName(name).toStdString(), false});
+    return true;
+#endif
+}
+
+std::string readFile(const std::string &path) {
+    QFile file(QFile::decodeName(path.c_str()));
+    if (!file.open(QIODevice::ReadOnly))
+        return std::string();
+    return file.read(maxIgnoreBytes).toStdString();
+}
+
+} // namespace
+
+DirectoryScanner::DirectoryScanner(QObject *parent) : QObject(parent) {
+    deliverTimer.setSingleShot(true);
+    deliverTimer.setInterval(0);
+    connect(&deliverTimer, &QTimer::timeout, this, &DirectoryScanner::deliver);
+}
+
+DirectoryScanner::~DirectoryScanner() {
+    if (!thread)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wake.notify_one();
+    thread->wait();
+    delete thread;
+}
+
+void DirectoryScanner::setRoot(const QString &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    root = QFile::encodeName(path).toStdString();
+    ++generation;
+    requests.clear();
+    results.clear();
+}
+
+quint64 DirectoryScanner::list(const QString &directory) {
+    const quint64 id = ++lastRequest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({id, QFile::encodeName(directory).toStdString()});
+    }
+    // Started with the first project, so that an editor without one costs
+    // no thread.
+    if (!thread) {
+        thread = QThread::create([this] { run(); });
+        thread->start();
+    }
+    wake.notify_one();
+    return id;
+}
+
+void DirectoryScanner::run() {
+    for (;;) {
+        Request request;
+        std::string rootPath;
+        quint64 scanned;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopRequested || !requests.empty(); });
+            if (stopRequested)
+                return;
+            request = requests.front();
+            requests.pop_front();
+            rootPath = root;
+            scanned = generation;
+        }
+
+        if (scanned != rulesGeneration) {
+            rules.clear();
+            ruleTexts.clear();
+            excluded = IgnoreRules();
+            excluded.parse(readFile(rootPath + "/.git/info/exclude"));
+            rulesGeneration = scanned;
+        }
+        std::vector<Listing> batches = scan(request, rootPath);
+
+        bool post;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // Read for a project closed meanwhile.
+            if (generation != scanned)
+                continue;
+            // The GUI thread takes results until none are left; it needs
+            // waking only once it has.
+            post = results.empty();
+            for (Listing &batch : batches)
+                results.push_back(std::move(batch));
+        }
+        if (post)
+            QMetaObject::invokeMethod(this, [this] { deliverTimer.start(); }, Qt::QueuedConnection);
+    }
+}
+
+std::vector<DirectoryScanner::Listing> DirectoryScanner::scan(const Request &request,
+                                                              const std::string &rootPath) {
+    const std::string &directory = request.directory;
+    const std::string path = directory.empty() ? rootPath : rootPath + "/" + directory;
+    std::vector<RawEntry> raw;
+    QString error;
+    readDirectory(path, raw, &error);
+
+    // The directory's .gitignore applies to its own entries as well.
+    const bool hasRules = std::any_of(raw.begin(), raw.end(), [](const RawEntry &entry) {
+        return !entry.isDirectory && entry.name == ".gitignore";
+    });
+    const std::string text = hasRules ? readFile(path + "/.gitignore") : std::string();
+    const auto known = ruleTexts.find(directory);
+    const bool rulesChanged = known != ruleTexts.end() && known->second != text;
+    ruleTexts[directory] = text;
+    if (text.empty()) {
+        rules.erase(directory);
+    } else {
+        IgnoreRules parsed;
+        parsed.parse(text);
+        rules[directory] = std::move(parsed);
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(raw.size());
+    for (const RawEntry &entry : raw) {
+        if (entry.name == ".git" || isIgnored(directory, entry.name, entry.isDirectory))
+            continue;
+        entries.push_back({QFile::decodeName(QByteArray::fromStdString(entry.name)), entry.isDirectory});
+    }
+    std::sort(entries.begin(), entries.end(), &DirectoryScanner::lessThan);
+
+    std::vector<Listing> batches;
+    size_t start = 0;
+    do {
+        const size_t end = std::min(start + batchEntries, entries.size());
+        Listing batch;
+        batch.request = request.id;
+        batch.entries.assign(std::make_move_iterator(entries.begin() + start),
+                             std::make_move_iterator(entries.begin() + end));
+        start = end;
+        batches.push_back(std::move(batch));
+    } while (start < entries.size());
+    batches.back().done = true;
+    batches.back().rulesChanged = rulesChanged;
+    batches.back().error = error;
+    return batches;
+}
+
+bool DirectoryScanner::lessThan(const Entry &a, const Entry &b) {
+    if (a.isDirectory != b.isDirectory)
+        return a.isDirectory;
+    const int order = a.name.compare(b.name, Qt::CaseInsensitive);
+    return order != 0 ? order < 0 : a.name < b.name;
+}
+
+bool DirectoryScanner::isIgnored(const std::string &directory, const std::string &name,
+                                 bool isDirectory) const {
+    const std::string path = directory + name;
+    // The .gitignore nearest the entry decides first.
+    std::string at = directory;
+    for (;;) {
+        const auto found = rules.find(at);
+        if (found != rules.end()) {
+            const int verdict = found->second.match(path.substr(at.size()), isDirectory);
+            if (verdict != 0)
+                return verdict > 0;
+        }
+        if (at.empty())
+            break;
+        const size_t slash = at.rfind('/', at.size() - 2);
+        at = slash == std::string::npos ? std::string() : at.substr(0, slash + 1);
+    }
+    return excluded.match(path, isDirectory) > 0;
+}
+
+void DirectoryScanner::deliver() {
+    QElapsedTimer clock;
+    clock.start();
+    for (;;) {
+        Listing listing;
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (results.empty())
+                return;
+            listing = std::move(results.front());
+            results.pop_front();
+            more = !results.empty();
+        }
+        emit listed(listing);
+        if (!more)
+            return;
+        // The rest waits for the next turn of the event loop.
+        if (clock.elapsed() >= deliverMsecs) {
+            deliverTimer.start();
+            return;
+        }
+    }
+}
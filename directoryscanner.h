@@ -0,0 +1,107 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gitignore.h"
+
+class QThread;
+
+// Lists the directories of a project on a worker thread, one directory per
+// request, leaving out what .gitignore files ignore.
+//
+// On Linux a directory is read with getdents64 into a large buffer, which
+// returns a thousand entries or more per system call, and the entry types
+// come with the names, so a directory costs a few system calls and no stat
+// per entry. The worker reads each .gitignore as it lists the directory
+// that holds it, so the rules are there before anything below is listed.
+//
+// Listings come back sorted, directories first, in batches of at most
+// batchEntries, and listed() hands them over a few at a time from the event
+// loop, so that a huge directory never holds up the GUI.
+class DirectoryScanner : public QObject {
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString name;
+        bool isDirectory = false;
+    };
+
+    // A batch of the entries of a directory, in order.
+    struct Listing {
+        quint64 request = 0;
+        std::vector<Entry> entries;
+        // Set on the last batch of the request.
+        bool done = false;
+        // Set if the directory's .gitignore is not what it was when the
+        // directory was last listed, so that what is listed below it may be
+        // out of date.
+        bool rulesChanged = false;
+        QString error;
+    };
+
+    static constexpr size_t batchEntries = 2048;
+
+    // The order of a listing: directories first, then by name, ignoring
+    // case where the names differ otherwise.
+    static bool lessThan(const Entry &a, const Entry &b);
+
+    explicit DirectoryScanner(QObject *parent = nullptr);
+    ~DirectoryScanner() override;
+
+    // Drops the requests for the project before and starts on root.
+    void setRoot(const QString &root);
+    // Lists directory, relative to the root with a / after each component,
+    // or empty for the root itself. Returns the request, which listed()
+    // reports.
+    quint64 list(const QString &directory);
+
+signals:
+    void listed(const DirectoryScanner::Listing &listing);
+
+private:
+    struct Request {
+        quint64 id = 0;
+        std::string directory;
+    };
+
+    void run();
+    // Lists the directory of request into batches; the caller holds no lock.
+    std::vector<Listing> scan(const Request &request, const std::string &rootPath);
+    bool isIgnored(const std::string &directory, const std::string &name, bool isDirectory) const;
+    void deliver();
+
+    QThread *thread = nullptr;
+    quint64 lastRequest = 0;
+    QTimer deliverTimer;
+
+    // Shared with the worker.
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopRequested = false;
+    std::string root;
+    // Bumped by setRoot(), so the worker drops what it read for another root.
+    quint64 generation = 0;
+    std::deque<Request> requests;
+    std::deque<Listing> results;
+
+    // The worker's own: the rules of each directory listed so far by its
+    // path relative to the root, the text they came from, and the root's
+    // .git/info/exclude.
+    quint64 rulesGeneration = ~quint64(0);
+    std::map<std::string, IgnoreRules> rules;
+    std::map<std::string, std::string> ruleTexts;
+    IgnoreRules excluded;
+};
+
+#endif // DIRECTORYSCANNER_H
@@ -0,0 +1,160 @@
+#include "documentstats.h"
+
+#include <Qsci/qsciscintilla.h>
+
+namespace {
+
+// Dirty text up to this size is re-counted right away on the GUI thread.
+constexpr int64_t inlineBytes = 64 * 1024;
+
+// Larger dirty ranges are copied for the worker this much at a time, so a
+// freshly loaded file is never held twice.
+constexpr int64_t snapshotBytes = 64 << 20;
+
+} // namespace
+
+int64_t ScintillaTextSource::length() const {
+    return editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+}
+
+int64_t ScintillaTextSource::lineCount() const {
+    return editor->SendScintilla(QsciScintillaBase::SCI_GETLINECOUNT);
+}
+
+int64_t ScintillaTextSource::lineFromPosition(int64_t position) const {
+    return editor->SendScintilla(QsciScintillaBase::SCI_LINEFROMPOSITION,
+                                 static_cast<unsigned long>(position));
+}
+
+int64_t ScintillaTextSource::lineStart(int64_t line) const {
+    return editor->SendScintilla(QsciScintillaBase::SCI_POSITIONFROMLINE,
+                                 static_cast<unsigned long>(line));
+}
+
+const char *ScintillaTextSource::rangePointer(int64_t start, int64_t length) const {
+    // Points into Scintilla's own buffer. This may move the gap so the range
+    // is contiguous, but never allocates or copies the text elsewhere.
+    return reinterpret_cast<const char *>(
+        editor->SendScintilla(QsciScintillaBase::SCI_GETRANGEPOINTER,
+                              static_cast<unsigned long>(start),
+                              static_cast<long>(length)));
+}
+
+DocumentStats::DocumentStats(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor), source(editor), stats(source) {
+    qRegisterMetaType<LineCountsList>();
+
+    worker = new StatsWorker(generation);
+    worker->moveToThread(&workerThread);
+    connect(worker, &StatsWorker::counted, this, &DocumentStats::handleCounted);
+    workerThread.start(QThread::LowPriority);
+
+    // Bursts of edits, such as a paste or a replace-all, become one count.
+    coalesceTimer.setSingleShot(true);
+    coalesceTimer.setInterval(30);
+    connect(&coalesceTimer, &QTimer::timeout, this, &DocumentStats::startRecount);
+
+    connect(editor, &QsciScintillaBase::SCN_MODIFIED,
+            this, &DocumentStats::handleModified);
+
+    update();
+}
+
+DocumentStats::~DocumentStats() {
+    ++generation;
+    workerThread.quit();
+    workerThread.wait();
+    delete worker;
+}
+
+void DocumentStats::setLocale(const icu::Locale &locale) {
+    if (locale == stats.locale())
+        return;
+
+    stats.setLocale(locale);
+    update();
+}
+
+void DocumentStats::reset() {
+    stats.reset();
+    update();
+}
+
+DocumentStats::Selection DocumentStats::selection(QsciScintilla *view) {
+    Selection result;
+    const int ranges = static_cast<int>(view->SendScintilla(QsciScintillaBase::SCI_GETSELECTIONS));
+    for (int i = 0; i < ranges; ++i) {
+        const int64_t start = view->SendScintilla(QsciScintillaBase::SCI_GETSELECTIONNSTART,
+                                                  static_cast<unsigned long>(i));
+        const int64_t end = view->SendScintilla(QsciScintillaBase::SCI_GETSELECTIONNEND,
+                                                static_cast<unsigned long>(i));
+        if (start >= end)
+            continue;
+
+        result.counts += stats.rangeTotals(start, end);
+        result.bytes += end - start;
+        // A range that ends at a line start does not take in that line.
+        result.lines += source.lineFromPosition(end - 1) - source.lineFromPosition(start) + 1;
+        ++result.ranges;
+    }
+    return result;
+}
+
+void DocumentStats::handleModified(int position, int modificationType, const char *,
+                                   int, int linesAdded) {
+    if (!(modificationType & (QsciScintillaBase::SC_MOD_INSERTTEXT |
+                              QsciScintillaBase::SC_MOD_DELETETEXT)))
+        return;
+
+    stats.textChanged(position, linesAdded);
+    update();
+}
+
+void DocumentStats::update() {
+    // Any count in flight is now stale.
+    ++generation;
+
+    if (!pending && stats.dirtyRange().length <= inlineBytes) {
+        stats.recountDirty();
+        shown = stats.totals();
+    } else {
+        pending = true;
+        coalesceTimer.start();
+    }
+    emit changed();
+}
+
+void DocumentStats::startRecount() {
+    const IncrementalStats::Range range = stats.dirtyRange(snapshotBytes);
+    if (range.length <= inlineBytes) {
+        stats.recountDirty();
+        shown = stats.totals();
+        pending = false;
+        emit changed();
+        return;
+    }
+
+    const QByteArray snapshot(source.rangePointer(range.start, range.length), range.length);
+    const quint64 job = generation;
+    const icu::Locale locale = stats.locale();
+    StatsWorker *w = worker;
+    QMetaObject::invokeMethod(w, [w, job, snapshot, range, locale] {
+        w->count(job, snapshot, static_cast<qsizetype>(range.firstLine),
+                 static_cast<qsizetype>(range.lineCount), locale);
+    });
+}
+
+void DocumentStats::handleCounted(quint64 job, qsizetype firstLine, LineCountsList counts) {
+    // Drop results of snapshots that edits have since overtaken; the edit
+    // that overtook them restarted the coalescing timer.
+    if (job != generation)
+        return;
+
+    stats.applyCounts(static_cast<size_t>(firstLine), counts->data(), counts->size());
+    shown = stats.totals();
+    if (stats.isDirty())
+        startRecount();
+    else
+        pending = false;
+    emit changed();
+}
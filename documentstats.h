@@ -0,0 +1,99 @@
+#ifndef DOCUMENTSTATS_H
+#define DOCUMENTSTATS_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+
+#include "statsworker.h"
+#include "textstats.h"
+
+class QsciScintilla;
+
+// TextSource over the document shown in a QsciScintilla.
+class ScintillaTextSource : public TextSource {
+public:
+    explicit ScintillaTextSource(QsciScintilla *editor) : editor(editor) {}
+
+    int64_t length() const override;
+    int64_t lineCount() const override;
+    int64_t lineFromPosition(int64_t position) const override;
+    int64_t lineStart(int64_t line) const override;
+    const char *rangePointer(int64_t start, int64_t length) const override;
+
+private:
+    QsciScintilla *editor;
+};
+
+// Word and grapheme statistics of an editor's document, updated from
+// SCN_MODIFIED so that the cost of an update follows the size of the edit.
+// Small edits are re-counted in place; large ones are coalesced and counted
+// from a snapshot on a worker thread while the last result stays visible.
+class DocumentStats : public QObject {
+    Q_OBJECT
+
+public:
+    // Counts of the current selection, summed over its non-empty ranges. A
+    // multiple or rectangular selection has one range per caret.
+    struct Selection {
+        TextCounts counts;
+        int64_t bytes = 0;
+        int64_t lines = 0;
+        int ranges = 0;
+    };
+
+    explicit DocumentStats(QsciScintilla *editor, QObject *parent = nullptr);
+    ~DocumentStats() override;
+
+    // Totals of the last finished count.
+    const TextCounts &totals() const { return shown; }
+
+    int64_t byteCount() const { return source.length(); }
+    int64_t lineCount() const { return source.lineCount(); }
+
+    // Costs O(log n) per selected range plus the partial lines at its ends.
+    // Lines still being re-counted contribute their previous counts.
+    Selection selection() { return selection(editor); }
+    // The selection of view, another editor showing the same document, as
+    // a split view does. The counts come from the one index.
+    Selection selection(QsciScintilla *view);
+
+    // True while a re-count is queued or running on the worker.
+    bool isPending() const { return pending; }
+
+    const icu::Locale &locale() const { return stats.locale(); }
+
+    // Re-counts the document with the word rules of locale.
+    void setLocale(const icu::Locale &locale);
+
+    // Re-counts from scratch. Call after the editor was given another
+    // document, which Scintilla does not report through SCN_MODIFIED.
+    void reset();
+
+signals:
+    void changed();
+
+private slots:
+    void handleModified(int position, int modificationType, const char *text,
+                        int length, int linesAdded);
+    void startRecount();
+    void handleCounted(quint64 job, qsizetype firstLine, LineCountsList counts);
+
+private:
+    void update();
+
+    QsciScintilla *editor;
+    ScintillaTextSource source;
+    IncrementalStats stats;
+    TextCounts shown;
+    bool pending = false;
+
+    std::atomic<quint64> generation{0};
+    QTimer coalesceTimer;
+    QThread workerThread;
+    StatsWorker *worker;
+};
+
+#endif // DOCUMENTSTATS_H
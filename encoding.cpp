@@ -0,0 +1,236 @@
+#include "encoding.h"
+
+#include <unicode/ucsdet.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "textscan.h"
+
+namespace {
+
+// Bytes looked at by the UTF-16 check and by ICU's detector, which is far
+// slower than the UTF-8 validator.
+constexpr size_t zeroSampleBytes = 64 * 1024;
+constexpr size_t detectorSampleBytes = 64 * 1024;
+
+// Below this, ICU's detector is guessing.
+constexpr int32_t minConfidence = 30;
+
+struct Bom {
+    const char *bytes;
+    size_t length;
+    const char *name;
+};
+
+// UTF-32LE before UTF-16LE, whose mark it starts with.
+const Bom boms[] = {
+    {"\xEF\xBB\xBF", 3, "UTF-8"},
+    {"\xFF\xFE\0\0", 4, "UTF-32LE"},
+    {"\0\0\xFE\xFF", 4, "UTF-32BE"},
+    {"\xFF\xFE", 2, "UTF-16LE"},
+    {"\xFE\xFF", 2, "UTF-16BE"},
+};
+
+struct ConverterCloser {
+    void operator()(UConverter *converter) const { ucnv_close(converter); }
+};
+using ConverterPtr = std::unique_ptr<UConverter, ConverterCloser>;
+
+struct DetectorCloser {
+    void operator()(UCharsetDetector *detector) const { ucsdet_close(detector); }
+};
+using DetectorPtr = std::unique_ptr<UCharsetDetector, DetectorCloser>;
+
+// True if data decodes in encoding without an invalid or unmapped byte.
+bool decodesCleanly(const char *encoding, const char *data, size_t length, bool complete) {
+    UErrorCode status = U_ZERO_ERROR;
+    ConverterPtr converter(ucnv_open(encoding, &status));
+    if (U_FAILURE(status))
+        return false;
+    ucnv_setToUCallBack(converter.get(), UCNV_TO_U_CALLBACK_STOP, nullptr, nullptr, nullptr, &status);
+
+    std::vector<UChar> buffer(8192);
+    const char *source = data;
+    const char *sourceLimit = data + length;
+    for (;;) {
+        UChar *target = buffer.data();
+        status = U_ZERO_ERROR;
+        ucnv_toUnicode(converter.get(), &target, buffer.data() + buffer.size(),
+                       &source, sourceLimit, nullptr, complete, &status);
+        if (status != U_BUFFER_OVERFLOW_ERROR)
+            return U_SUCCESS(status);
+    }
+}
+
+// UTF-16 text in Latin scripts has a zero in most high bytes and almost no
+// zero in the low ones.
+const char *guessUtf16(const char *data, size_t length) {
+    const size_t n = std::min(length, zeroSampleBytes) & ~size_t(1);
+    if (n < 8)
+        return nullptr;
+
+    size_t evenZeros = 0, oddZeros = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        evenZeros += data[i] == 0;
+        oddZeros += data[i + 1] == 0;
+    }
+    const size_t pairs = n / 2;
+    if (oddZeros * 10 > pairs * 3 && evenZeros * 20 < pairs)
+        return "UTF-16LE";
+    if (evenZeros * 10 > pairs * 3 && oddZeros * 20 < pairs)
+        return "UTF-16BE";
+    return nullptr;
+}
+
+std::string guessLegacy(const char *data, size_t length, bool complete) {
+    const size_t n = std::min(length, detectorSampleBytes);
+    UErrorCode status = U_ZERO_ERROR;
+    DetectorPtr detector(ucsdet_open(&status));
+    ucsdet_setText(detector.get(), data, static_cast<int32_t>(n), &status);
+    int32_t count = 0;
+    const UCharsetMatch **matches = ucsdet_detectAll(detector.get(), &count, &status);
+    if (U_SUCCESS(status)) {
+        for (int32_t i = 0; i < count; ++i) {
+            const char *name = ucsdet_getName(matches[i], &status);
+            if (U_FAILURE(status) || ucsdet_getConfidence(matches[i], &status) < minConfidence)
+                break;
+            // Unicode encodings were ruled out above.
+            if (std::strncmp(name, "UTF", 3) == 0)
+                continue;
+            if (decodesCleanly(name, data, length, complete))
+                return name;
+        }
+    }
+
+    if (decodesCleanly("windows-1252", data, length, complete))
+        return "windows-1252";
+    return "ISO-8859-1";
+}
+
+} // namespace
+
+std::string TextEncoding::byteOrderMark() const {
+    if (!bom)
+        return std::string();
+    for (const Bom &mark : boms) {
+        if (name == mark.name)
+            return std::string(mark.bytes, mark.length);
+    }
+    return std::string();
+}
+
+std::string TextEncoding::displayName() const {
+    return bom ? name + " with BOM" : name;
+}
+
+bool TextEncoding::fromDisplayName(const std::string &text, TextEncoding &encoding) {
+    const std::string suffix = " with BOM";
+    TextEncoding parsed;
+    parsed.bom = text.size() > suffix.size()
+              && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    parsed.name = parsed.bom ? text.substr(0, text.size() - suffix.size()) : text;
+
+    // Use ICU's spelling of the name, so that isUtf8() and byteOrderMark()
+    // recognise aliases such as "utf8".
+    UErrorCode status = U_ZERO_ERROR;
+    ConverterPtr converter(ucnv_open(parsed.name.c_str(), &status));
+    if (U_FAILURE(status))
+        return false;
+    const char *canonical = ucnv_getName(converter.get(), &status);
+    if (U_SUCCESS(status) && (std::strcmp(canonical, "UTF-8") == 0
+                              || std::strncmp(canonical, "UTF-16", 6) == 0
+                              || std::strncmp(canonical, "UTF-32", 6) == 0))
+        parsed.name = canonical;
+    if (parsed.bom && parsed.byteOrderMark().empty())
+        return false;
+
+    encoding = parsed;
+    return true;
+}
+
+TextEncoding detectEncoding(const char *data, size_t length, bool complete) {
+    TextEncoding encoding;
+    for (const Bom &mark : boms) {
+        if (length >= mark.length && std::memcmp(data, mark.bytes, mark.length) == 0) {
+            encoding.name = mark.name;
+            encoding.bom = true;
+            return encoding;
+        }
+    }
+
+    // Before the UTF-8 check, which zeros pass.
+    if (const char *utf16 = guessUtf16(data, length)) {
+        encoding.name = utf16;
+        return encoding;
+    }
+
+    const size_t whole = complete ? length : textscan::completeUtf8Length(data, length);
+    if (textscan::isValidUtf8(data, whole))
+        return encoding;
+
+    encoding.name = guessLegacy(data, length, complete);
+    return encoding;
+}
+
+Transcoder::Transcoder(const std::string &encoding, Direction direction) {
+    UErrorCode status = U_ZERO_ERROR;
+    UConverter *other = ucnv_open(encoding.c_str(), &status);
+    if (U_FAILURE(status))
+        return;
+    status = U_ZERO_ERROR;
+    UConverter *utf8 = ucnv_open("UTF-8", &status);
+    if (U_FAILURE(status)) {
+        ucnv_close(other);
+        return;
+    }
+
+    source = direction == ToUtf8 ? other : utf8;
+    target = direction == ToUtf8 ? utf8 : other;
+    targetName = direction == ToUtf8 ? "UTF-8" : encoding;
+
+    // Saving must not turn characters the encoding lacks into '?'.
+    if (direction == FromUtf8)
+        ucnv_setFromUCallBack(target, UCNV_FROM_U_CALLBACK_STOP, nullptr, nullptr, nullptr, &status);
+}
+
+Transcoder::~Transcoder() {
+    ucnv_close(source);
+    ucnv_close(target);
+}
+
+bool Transcoder::convert(const char *data, size_t length, bool last, std::string &output,
+                         std::string *error) {
+    const char *in = data;
+    const char *inLimit = data + length;
+    size_t done = output.size();
+    // Most conversions change the size by at most a factor of two.
+    output.resize(done + 2 * length + 16);
+
+    for (;;) {
+        char *out = &output[done];
+        UErrorCode status = U_ZERO_ERROR;
+        ucnv_convertEx(target, source, &out, output.data() + output.size(), &in, inLimit,
+                       pivot, &pivotSource, &pivotTarget, pivot + std::size(pivot),
+                       false, last, &status);
+        done = static_cast<size_t>(out - output.data());
+
+        if (status == U_BUFFER_OVERFLOW_ERROR) {
+            output.resize(output.size() * 2);
+            continue;
+        }
+        output.resize(done);
+        if (U_FAILURE(status)) {
+            if (error) {
+                *error = status == U_INVALID_CHAR_FOUND || status == U_ILLEGAL_CHAR_FOUND
+                    ? "The text has characters that " + targetName + " cannot represent"
+                    : std::string("Cannot convert the text: ") + u_errorName(status);
+            }
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <cstddef>
+#include <string>
+
+#include <unicode/ucnv.h>
+
+// The encoding of a text file: the name of an ICU converter, and whether
+// the file starts with a byte order mark. The editor always holds UTF-8.
+struct TextEncoding {
+    std::string name = "UTF-8";
+    bool bom = false;
+
+    // UTF-8 needs no conversion either way, with or without a BOM.
+    bool isUtf8() const { return name == "UTF-8"; }
+
+    // The bytes of the byte order mark, or nothing if bom is false.
+    std::string byteOrderMark() const;
+
+    // For example "UTF-16LE with BOM".
+    std::string displayName() const;
+
+    // Parses a displayName(). Returns false if ICU has no such converter.
+    static bool fromDisplayName(const std::string &text, TextEncoding &encoding);
+
+    bool operator==(const TextEncoding &other) const {
+        return name == other.name && bom == other.bom;
+    }
+};
+
+// Guesses the encoding of a file from its first length bytes; complete says
+// whether those are the whole file. In order:
+//
+//   - a byte order mark names UTF-8, UTF-16 or UTF-32;
+//   - zeros in every other byte mean UTF-16 without a BOM;
+//   - valid UTF-8 is UTF-8, checked with the SIMD validator;
+//   - otherwise ICU's charset detector names a legacy encoding, if the
+//     sample decodes cleanly in it;
+//   - failing that windows-1252, or ISO-8859-1, which maps every byte and
+//     so keeps even binary files intact.
+TextEncoding detectEncoding(const char *data, size_t length, bool complete);
+
+// Converts text between an encoding and UTF-8 a chunk at a time. Sequences
+// split between chunks are carried over to the next one.
+class Transcoder {
+public:
+    enum Direction { ToUtf8, FromUtf8 };
+
+    Transcoder(const std::string &encoding, Direction direction);
+    ~Transcoder();
+
+    Transcoder(const Transcoder &) = delete;
+    Transcoder &operator=(const Transcoder &) = delete;
+
+    // False if ICU has no converter for the encoding.
+    bool isValid() const { return source && target; }
+
+    // Converts data and appends it to output; last flushes what is carried
+    // over. Bytes invalid in the source encoding become U+FFFD. Returns false
+    // and sets error if the target encoding cannot represent a character.
+    bool convert(const char *data, size_t length, bool last, std::string &output,
+                 std::string *error);
+
+private:
+    UConverter *source = nullptr;
+    UConverter *target = nullptr;
+    UChar pivot[4096];
+    UChar *pivotSource = pivot;
+    UChar *pivotTarget = pivot;
+    std::string targetName;
+};
+
+#endif // ENCODING_H
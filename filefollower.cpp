@@ -0,0 +1,185 @@
+#include "filefollower.h"
+
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// How often the worker looks at the file, and the GUI takes what it read.
+constexpr int pollMsecs = 100;
+constexpr int batchMsecs = 100;
+
+// Bytes read at a time.
+constexpr qint64 chunkBytes = 1 << 20;
+
+// The worker stops reading while this much waits to be appended, which
+// bounds both memory and the size of a batch.
+constexpr size_t maxPendingBytes = 8 << 20;
+
+} // namespace
+
+FileFollower::FileFollower(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor) {
+    batch = new QTimer(this);
+    batch->setInterval(batchMsecs);
+    connect(batch, &QTimer::timeout, this, &FileFollower::drain);
+}
+
+FileFollower::~FileFollower() {
+    stop();
+}
+
+void FileFollower::start(const QString &name, qint64 offset, const TextEncoding &encoding) {
+    stop();
+    fileName = name;
+    dropped = false;
+    pending.clear();
+    wasTruncated = false;
+    error.clear();
+    stopRequested = false;
+
+    // A log's history is not worth the memory of undoing it.
+    editor->SendScintilla(QsciScintillaBase::SCI_SETUNDOCOLLECTION, 0UL);
+    editor->SendScintilla(QsciScintillaBase::SCI_EMPTYUNDOBUFFER);
+    editor->setReadOnly(true);
+
+    thread = QThread::create([this, name, offset, encoding] { run(name, offset, encoding); });
+    thread->start(QThread::LowPriority);
+    batch->start();
+}
+
+void FileFollower::stop() {
+    if (!thread)
+        return;
+    batch->stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wake.notify_all();
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+
+    drain();
+    editor->setReadOnly(false);
+    editor->SendScintilla(QsciScintillaBase::SCI_SETUNDOCOLLECTION, 1UL);
+}
+
+void FileFollower::run(const QString &name, qint64 offset, const TextEncoding &encoding) {
+    auto makeTranscoder = [&encoding] {
+        return encoding.isUtf8() ? nullptr : std::make_unique<Transcoder>(encoding.name, Transcoder::ToUtf8);
+    };
+    std::unique_ptr<Transcoder> transcoder = makeTranscoder();
+    if (transcoder && !transcoder->isValid()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = "Unsupported encoding " + QString::fromStdString(encoding.name);
+        return;
+    }
+
+    std::vector<char> buffer(static_cast<size_t>(chunkBytes));
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopRequested) {
+        const qint64 room = static_cast<qint64>(maxPendingBytes - std::min(pending.size(), maxPendingBytes));
+        lock.unlock();
+
+        std::string text;
+        bool shrunk = false;
+        QString failure;
+        QFile file(name);
+        if (room > 0 && file.open(QIODevice::ReadOnly)) {
+            const qint64 size = file.size();
+            if (size < offset) {
+                offset = 0;
+                shrunk = true;
+                transcoder = makeTranscoder();
+            }
+            if (size > offset && file.seek(offset)) {
+                for (qint64 want = std::min(size - offset, room); want > 0;) {
+                    const qint64 n = file.read(buffer.data(), std::min(want, chunkBytes));
+                    if (n <= 0) {
+                        if (n < 0)
+                            failure = file.errorString();
+                        break;
+                    }
+                    if (transcoder)
+                        transcoder->convert(buffer.data(), static_cast<size_t>(n), false, text, nullptr);
+                    else
+                        text.append(buffer.data(), static_cast<size_t>(n));
+                    offset += n;
+                    want -= n;
+                }
+            }
+        } else if (room > 0 && file.exists()) {
+            failure = file.errorString();
+        }
+        // A file that is gone, as in the middle of a log rotation, is waited
+        // for.
+
+        lock.lock();
+        pending += text;
+        wasTruncated = wasTruncated || shrunk;
+        if (!failure.isEmpty()) {
+            error = failure;
+            return;
+        }
+        wake.wait_for(lock, std::chrono::milliseconds(pollMsecs), [this] { return stopRequested; });
+    }
+}
+
+void FileFollower::drain() {
+    std::string text;
+    bool shrunk;
+    QString failure;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        text.swap(pending);
+        shrunk = wasTruncated;
+        wasTruncated = false;
+        failure.swap(error);
+    }
+
+    if (shrunk)
+        emit truncated(fileName);
+    if (!text.empty())
+        append(text);
+    if (!failure.isEmpty()) {
+        stop();
+        emit failed(fileName, failure);
+    }
+}
+
+void FileFollower::append(const std::string &text) {
+    const long length = editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const bool atEnd = editor->SendScintilla(QsciScintillaBase::SCI_GETCURRENTPOS) == length
+        && editor->SendScintilla(QsciScintillaBase::SCI_GETANCHOR) == length;
+
+    editor->setReadOnly(false);
+    editor->SendScintilla(QsciScintillaBase::SCI_APPENDTEXT,
+                          static_cast<unsigned long>(text.size()), text.data());
+    if (limit > 0) {
+        // Scintilla keeps the lines on screen in place as those above go.
+        const long lines = editor->SendScintilla(QsciScintillaBase::SCI_GETLINECOUNT);
+        if (lines > limit) {
+            const long end = editor->SendScintilla(QsciScintillaBase::SCI_POSITIONFROMLINE,
+                                                   static_cast<unsigned long>(lines - limit));
+            editor->SendScintilla(QsciScintillaBase::SCI_DELETERANGE, 0UL, end);
+            dropped = true;
+        }
+    }
+    editor->setReadOnly(true);
+
+    if (atEnd)
+        editor->SendScintilla(QsciScintillaBase::SCI_DOCUMENTEND);
+    // The document mirrors the file; there is nothing to save.
+    editor->setModified(false);
+    emit appended(static_cast<qint64>(text.size()));
+}
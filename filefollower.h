@@ -0,0 +1,78 @@
+#ifndef FILEFOLLOWER_H
+#define FILEFOLLOWER_H
+
+#include <QObject>
+#include <QString>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "encoding.h"
+
+class QThread;
+class QTimer;
+class QsciScintilla;
+
+// Follows a growing file into the editor, like tail -f. A worker thread
+// polls the file and reads only the bytes past the offset where its last
+// read ended, converting them to UTF-8 as it goes. The GUI thread takes what
+// has been read in batches, a few times a second, and appends each batch
+// with one SCI_APPENDTEXT, so a fast log costs one repaint per batch rather
+// than one per line.
+//
+// The view scrolls along only while the caret is at the end. With a line
+// limit, the oldest lines are dropped as new ones arrive, keeping memory
+// bounded for logs that grow at tens of MB/s.
+//
+// While following, the editor is read-only and keeps no undo history.
+class FileFollower : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileFollower(QsciScintilla *editor, QObject *parent = nullptr);
+    ~FileFollower() override;
+
+    // Follows fileName from offset on; the document holds what comes before.
+    void start(const QString &fileName, qint64 offset, const TextEncoding &encoding);
+    // Stops following, after appending what has been read.
+    void stop();
+    bool isFollowing() const { return thread != nullptr; }
+
+    // The most lines the document keeps while following, or 0 for all.
+    void setLineLimit(int lines) { limit = lines; }
+    int lineLimit() const { return limit; }
+    // Whether the line limit dropped lines, so that the document no longer
+    // holds the file from its start.
+    bool hasDroppedLines() const { return dropped; }
+
+signals:
+    void appended(qint64 bytes);
+    // The file got shorter, as when a log is rotated; it is followed again
+    // from its start.
+    void truncated(const QString &fileName);
+    void failed(const QString &fileName, const QString &error);
+
+private:
+    void run(const QString &fileName, qint64 offset, const TextEncoding &encoding);
+    void drain();
+    void append(const std::string &text);
+
+    QsciScintilla *editor;
+    QTimer *batch;
+    QString fileName;
+    QThread *thread = nullptr;
+    int limit = 0;
+    bool dropped = false;
+
+    // Shared with the worker.
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopRequested = false;
+    // Read but not yet appended.
+    std::string pending;
+    bool wasTruncated = false;
+    QString error;
+};
+
+#endif // FILEFOLLOWER_H
@@ -0,0 +1,198 @@
+#include "fileloader.h"
+
+#include <QFile>
+#include <QThread>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "textscan.h"
+
+namespace {
+
+// Bytes read and handed to the loader at a time.
+constexpr qint64 chunkBytes = 4 << 20;
+
+// Scintilla's ILoader, which QScintilla does not install a header for. The
+// layout must match Scintilla's exactly. Declaring the length as ptrdiff_t
+// works whether the library was built with int or ptrdiff_t positions,
+// because chunks stay far below 2 GB.
+class ILoader {
+public:
+    virtual int Release() = 0;
+    // Returns an SC_STATUS_* code.
+    virtual int AddData(const char *data, std::ptrdiff_t length) = 0;
+    virtual void *ConvertToDocument() = 0;
+};
+
+} // namespace
+
+FileLoader::FileLoader(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor) {}
+
+FileLoader::~FileLoader() {
+    stop();
+}
+
+bool FileLoader::start(const QString &name, QString *error) {
+    stop();
+
+    auto file = std::make_unique<QFile>(name);
+    if (!file->open(QIODevice::ReadOnly)) {
+        if (error)
+            *error = file->errorString();
+        return false;
+    }
+
+    // The loader reserves the whole file up front, so the buffer never grows
+    // by copying.
+    const qint64 size = file->size();
+    const long options = size > INT_MAX ? QsciScintillaBase::SC_DOCUMENTOPTION_TEXT_LARGE
+                                        : QsciScintillaBase::SC_DOCUMENTOPTION_DEFAULT;
+    void *loader = reinterpret_cast<void *>(
+        editor->SendScintilla(QsciScintillaBase::SCI_CREATELOADER, static_cast<unsigned long>(size), options));
+    if (!loader) {
+        if (error)
+            *error = "Not enough memory for a document of this size";
+        return false;
+    }
+
+    fileName = name;
+    result = Result();
+    cancelRequested = false;
+
+    QFile *f = file.release();
+    thread = QThread::create([this, f, loader, size] {
+        run(f, loader, size);
+        delete f;
+    });
+    connect(thread, &QThread::finished, this, [this, id = ++loadId] {
+        if (id == loadId && thread)
+            finish();
+    });
+    thread->start(QThread::LowPriority);
+    return true;
+}
+
+void FileLoader::cancel() {
+    if (!thread)
+        return;
+
+    stop();
+    emit cancelled(fileName);
+}
+
+void FileLoader::run(QFile *file, void *handle, qint64 size) {
+    auto *loader = static_cast<ILoader *>(handle);
+    // Room for a UTF-8 sequence carried over from the previous chunk.
+    std::vector<char> buffer(static_cast<size_t>(chunkBytes) + 4);
+    size_t carried = 0;
+    std::unique_ptr<Transcoder> transcoder;
+    std::string converted;
+
+    auto fail = [&](const QString &error) {
+        result.error = error;
+        loader->Release();
+    };
+
+    qint64 done = 0;
+    for (bool first = true;; first = false) {
+        if (cancelRequested) {
+            loader->Release();
+            return;
+        }
+
+        const qint64 n = file->read(buffer.data() + carried, chunkBytes);
+        if (n < 0) {
+            fail(file->errorString());
+            return;
+        }
+        done += n;
+        const bool last = n == 0;
+        const char *data = buffer.data();
+        size_t length = carried + static_cast<size_t>(n);
+
+        if (first) {
+            result.encoding = detectEncoding(data, length, done >= size);
+            const size_t bom = result.encoding.byteOrderMark().size();
+            data += bom;
+            length -= bom;
+            if (!result.encoding.isUtf8()) {
+                transcoder = std::make_unique<Transcoder>(result.encoding.name, Transcoder::ToUtf8);
+                if (!transcoder->isValid()) {
+                    fail("Unsupported encoding " + QString::fromStdString(result.encoding.name));
+                    return;
+                }
+            }
+        }
+
+        size_t whole = length;
+        if (transcoder) {
+            converted.clear();
+            std::string error;
+            if (!transcoder->convert(data, length, last, converted, &error)) {
+                fail(QString::fromStdString(error));
+                return;
+            }
+            data = converted.data();
+            whole = converted.size();
+        } else {
+            // A sequence cut off at the end of the chunk waits for the rest,
+            // so that the validator sees it whole. Invalid bytes are kept as
+            // they are, to be saved back unchanged.
+            if (!last)
+                whole = textscan::completeUtf8Length(data, length);
+            if (!result.malformed && !textscan::isValidUtf8(data, whole))
+                result.malformed = true;
+        }
+
+        if (whole > 0 && loader->AddData(data, static_cast<std::ptrdiff_t>(whole)) != QsciScintillaBase::SC_STATUS_OK) {
+            fail("Not enough memory for a document of this size");
+            return;
+        }
+        if (last)
+            break;
+
+        if (!transcoder) {
+            carried = length - whole;
+            std::memmove(buffer.data(), data + whole, carried);
+        }
+        emit progress(done, size);
+    }
+
+    result.document = loader->ConvertToDocument();
+}
+
+void FileLoader::finish() {
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+
+    const Result finished = result;
+    result = Result();
+    if (finished.document)
+        emit loaded(fileName, finished.document, finished.encoding, finished.malformed);
+    else
+        emit failed(fileName, finished.error);
+}
+
+void FileLoader::stop() {
+    if (!thread)
+        return;
+
+    cancelRequested = true;
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+    ++loadId;
+
+    if (result.document)
+        editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, result.document);
+    result = Result();
+}
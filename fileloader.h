@@ -0,0 +1,73 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+
+#include "encoding.h"
+
+class QFile;
+class QThread;
+class QsciScintilla;
+
+// Loads a file into a new Scintilla document on a worker thread. The file
+// is read in large chunks straight into the document through Scintilla's
+// loader interface (SCI_CREATELOADER), so the text is held once, never as
+// an extra QByteArray or QString, and the GUI stays responsive.
+//
+// The encoding is detected from the first chunk. UTF-8 goes into the
+// document as it is; anything else is converted to UTF-8 chunk by chunk.
+//
+// loaded() hands over a document pointer holding one reference. Attach it
+// with SCI_SETDOCPOINTER, then drop that reference with SCI_RELEASEDOCUMENT.
+class FileLoader : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileLoader(QsciScintilla *editor, QObject *parent = nullptr);
+    ~FileLoader() override;
+
+    bool isLoading() const { return thread != nullptr; }
+
+    // Starts loading fileName, abandoning any load in progress. Returns false
+    // and sets error if the file cannot be opened.
+    bool start(const QString &fileName, QString *error);
+
+    // Stops the load in progress and waits for the worker, which finishes
+    // its current chunk first. Emits cancelled() before returning.
+    void cancel();
+
+signals:
+    void progress(qint64 bytesRead, qint64 totalBytes);
+    // malformed: the file was taken for UTF-8 but has invalid bytes, which
+    // the document keeps as they are.
+    void loaded(const QString &fileName, void *document, const TextEncoding &encoding,
+                bool malformed);
+    void failed(const QString &fileName, const QString &error);
+    void cancelled(const QString &fileName);
+
+private:
+    // Written by the worker, read once it has finished.
+    struct Result {
+        void *document = nullptr;
+        TextEncoding encoding;
+        bool malformed = false;
+        QString error;
+    };
+
+    void run(QFile *file, void *loader, qint64 size);
+    void finish();
+    void stop();
+
+    QsciScintilla *editor;
+    QThread *thread = nullptr;
+    // Tells the finish of the current worker from that of one already stopped.
+    quint64 loadId = 0;
+    QString fileName;
+    std::atomic<bool> cancelRequested{false};
+    Result result;
+};
+
+#endif // FILELOADER_H
@@ -0,0 +1,301 @@
+#include "filesaver.h"
+
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bytes handed to a single write, and the size of snapshot chunks.
+constexpr int64_t spanBytes = 4 << 20;
+
+// Documents up to this size are written on the calling thread, straight from
+// Scintilla's buffer; a copy and a thread would cost more than the write.
+constexpr int64_t inlineBytes = 64 * 1024;
+
+#ifdef Q_OS_UNIX
+// Makes a rename into dirPath durable. Failure only weakens that guarantee,
+// so it is not reported.
+void syncDirectory(const QString &dirPath) {
+    const int fd = ::open(QFile::encodeName(dirPath).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return;
+    ::fsync(fd);
+    ::close(fd);
+}
+#endif
+
+} // namespace
+
+// Such a span is already contiguous, so SCI_GETRANGEPOINTER returns it
+// without moving any text.
+std::vector<TextSpan> documentSpans(QsciScintilla *editor) {
+    std::vector<TextSpan> spans;
+    const int64_t length = editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const int64_t gap = editor->SendScintilla(QsciScintillaBase::SCI_GETGAPPOSITION);
+    for (int64_t position = 0; position < length;) {
+        const int64_t limit = position < gap ? gap : length;
+        const int64_t n = std::min(limit - position, spanBytes);
+        const char *data = reinterpret_cast<const char *>(
+            editor->SendScintilla(QsciScintillaBase::SCI_GETRANGEPOINTER,
+                                  static_cast<unsigned long>(position), static_cast<long>(n)));
+        spans.push_back({data, n});
+        position += n;
+    }
+    return spans;
+}
+
+bool saveSpans(const QString &fileName, const TextEncoding &encoding,
+               const std::vector<TextSpan> &spans, const std::function<void(int64_t)> &written,
+               QString *error) {
+    std::unique_ptr<Transcoder> transcoder;
+    if (!encoding.isUtf8()) {
+        transcoder = std::make_unique<Transcoder>(encoding.name, Transcoder::FromUtf8);
+        if (!transcoder->isValid()) {
+            if (error)
+                *error = "Unsupported encoding " + QString::fromStdString(encoding.name);
+            return false;
+        }
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    auto write = [&file, error](const char *data, int64_t length) {
+        if (file.write(data, length) == length)
+            return true;
+        if (error)
+            *error = file.errorString();
+        return false;
+    };
+
+    const std::string bom = encoding.byteOrderMark();
+    if (!bom.empty() && !write(bom.data(), static_cast<int64_t>(bom.size())))
+        return false;
+
+    std::string converted;
+    int64_t done = 0;
+    for (size_t i = 0; i <= spans.size(); ++i) {
+        if (transcoder) {
+            // One more round after the last span flushes the converter.
+            const bool last = i == spans.size();
+            converted.clear();
+            std::string failure;
+            if (!transcoder->convert(last ? nullptr : spans[i].data, last ? 0 : spans[i].length,
+                                     last, converted, &failure)) {
+                if (error)
+                    *error = QString::fromStdString(failure);
+                return false;
+            }
+            if (!write(converted.data(), static_cast<int64_t>(converted.size())))
+                return false;
+        } else if (i < spans.size() && !write(spans[i].data, spans[i].length)) {
+            return false;
+        }
+
+        if (i < spans.size()) {
+            done += spans[i].length;
+            if (written)
+                written(done);
+        }
+    }
+
+#ifdef Q_OS_UNIX
+    // The data must be on disk before the rename makes it the file.
+    if (::fsync(file.handle()) != 0) {
+        if (error)
+            *error = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+#endif
+
+    if (!file.commit()) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    syncDirectory(QFileInfo(fileName).absolutePath());
+#endif
+    return true;
+}
+
+bool saveDocument(QsciScintilla *editor, const QString &fileName, const TextEncoding &encoding,
+                  QString *error) {
+    return saveSpans(fileName, encoding, documentSpans(editor), nullptr, error);
+}
+
+FileSaver::FileSaver(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor) {
+    connect(editor, &QsciScintillaBase::SCN_MODIFIED, this, &FileSaver::handleModified);
+}
+
+FileSaver::~FileSaver() {
+    waitForDone();
+    delete reader;
+}
+
+void *FileSaver::shownDocument() const {
+    return reinterpret_cast<void *>(editor->SendScintilla(QsciScintillaBase::SCI_GETDOCPOINTER));
+}
+
+void FileSaver::handleModified(int, int modificationType, const char *, int, int) {
+    if (modificationType & (QsciScintillaBase::SC_MOD_INSERTTEXT |
+                            QsciScintillaBase::SC_MOD_DELETETEXT))
+        ++edits[shownDocument()];
+}
+
+bool FileSaver::isSaving(void *document) const {
+    if (thread && job.request.document == document)
+        return true;
+    return std::any_of(queue.begin(), queue.end(),
+                       [document](const Request &queued) { return queued.document == document; });
+}
+
+void FileSaver::save(const QString &fileName, const TextEncoding &encoding) {
+    const Request request = {fileName, encoding, shownDocument()};
+    if (!thread) {
+        if (editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH) > inlineBytes) {
+            start(request);
+            return;
+        }
+        QString error;
+        if (saveDocument(editor, fileName, encoding, &error)) {
+            editor->setModified(false);
+            emit saved(fileName);
+        } else {
+            emit failed(fileName, error);
+        }
+        return;
+    }
+
+    // Saving the same text to the same file again would change nothing.
+    if (fileName == job.request.fileName && encoding == job.request.encoding
+        && request.document == job.request.document && edits.value(request.document) == job.edits)
+        return;
+    for (Request &queued : queue) {
+        if (queued.fileName == fileName) {
+            queued.encoding = encoding;
+            queued.document = request.document;
+            return;
+        }
+    }
+    queue.push_back(request);
+}
+
+bool FileSaver::saveAndWait(const QString &fileName, const TextEncoding &encoding, QString *error) {
+    waitForDone();
+    if (!saveDocument(editor, fileName, encoding, error))
+        return false;
+
+    editor->setModified(false);
+    return true;
+}
+
+void FileSaver::waitForDone() {
+    while (thread) {
+        thread->wait();
+        finish();
+    }
+}
+
+void FileSaver::documentClosed(void *document) {
+    while (isSaving(document)) {
+        thread->wait();
+        finish();
+    }
+    edits.remove(document);
+}
+
+void FileSaver::start(const Request &request) {
+    job = Job();
+    job.request = request;
+    job.edits = edits.value(request.document);
+
+    QsciScintilla *source = editor;
+    if (request.document != shownDocument()) {
+        if (!reader) {
+            reader = new QsciScintilla;
+            reader->hide();
+        }
+        reader->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, request.document);
+        source = reader;
+    }
+    // Copying runs at memory speed; the write that follows is the slow part.
+    for (const TextSpan &span : documentSpans(source))
+        job.chunks.emplace_back(span.data, static_cast<qsizetype>(span.length));
+    if (source == reader) {
+        // Lets go of the document, which the reader only borrowed.
+        reader->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, static_cast<void *>(nullptr));
+    }
+
+    thread = QThread::create([this] { run(); });
+    // A finish that waitForDone() already handled must not be handled again.
+    connect(thread, &QThread::finished, this, [this, id = ++saveId] {
+        if (id == saveId && thread)
+            finish();
+    });
+    thread->start(QThread::LowPriority);
+}
+
+void FileSaver::run() {
+    std::vector<TextSpan> spans;
+    int64_t total = 0;
+    for (const QByteArray &chunk : job.chunks) {
+        spans.push_back({chunk.constData(), chunk.size()});
+        total += chunk.size();
+    }
+
+    saveSpans(job.request.fileName, job.request.encoding, spans,
+              [this, total](int64_t written) { emit progress(written, total); },
+              &job.error);
+}
+
+void FileSaver::finish() {
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+
+    Job done = std::move(job);
+    job = Job();
+    done.chunks.clear();
+
+    if (done.error.isEmpty()) {
+        // Edits made during the write are not in the file.
+        if (done.edits == edits.value(done.request.document)) {
+            if (done.request.document == shownDocument())
+                editor->setModified(false);
+            else
+                emit documentSaved(done.request.document);
+        }
+        emit saved(done.request.fileName);
+    } else {
+        emit failed(done.request.fileName, done.error);
+    }
+
+    if (!thread && !queue.empty()) {
+        const Request next = queue.front();
+        queue.erase(queue.begin());
+        start(next);
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef FILESAVER_H
+#define FILESAVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "encoding.h"
+
+class QThread;
+class QsciScintilla;
+
+// A run of UTF-8 text to save.
+struct TextSpan {
+    const char *data;
+    int64_t length;
+};
+
+// Writes the spans to fileName in encoding, safely: the text goes to a
+// temporary file beside fileName, is flushed to disk, and only then
+// replaces fileName by a rename. A crash or a full disk leaves either the
+// old file or the new one, never a truncated mix. written, if set, is
+// called with the UTF-8 bytes consumed after each span.
+//
+// UTF-8 is written as it is; other encodings are converted span by span.
+// Returns false and sets error if the file cannot be written, or if the
+// encoding cannot represent some of the text.
+bool saveSpans(const QString &fileName, const TextEncoding &encoding,
+               const std::vector<TextSpan> &spans, const std::function<void(int64_t)> &written,
+               QString *error);
+
+// The text of editor's document as spans that each lie on one side of
+// Scintilla's gap, so that reading them moves no text. They stay valid
+// together until the document is next modified.
+std::vector<TextSpan> documentSpans(QsciScintilla *editor);
+
+// Writes the document shown in editor to fileName with saveSpans(). The
+// text is read straight from Scintilla's buffer, in spans that never cross
+// its gap, so saving neither copies the document nor moves its text.
+bool saveDocument(QsciScintilla *editor, const QString &fileName, const TextEncoding &encoding,
+                  QString *error);
+
+// Saves an editor's document in the background. save() copies the text into
+// a list of chunks, which takes a fraction of the time writing it does, and
+// a worker thread writes that copy the way saveDocument() does while the
+// user keeps editing. A small document, with no save running, is written
+// with saveDocument() at once instead.
+//
+// Each save belongs to the Scintilla document it was asked for, so the
+// editor can show another one meanwhile. The document is marked unmodified
+// only if no edit landed in it between the copy and the end of the write.
+// Saves requested while one is running are queued and copy the text when
+// their turn comes, from a hidden view if the editor shows another document
+// by then; repeated requests for the same file collapse into one.
+class FileSaver : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileSaver(QsciScintilla *editor, QObject *parent = nullptr);
+    // Finishes every queued save, so call it while the editor still exists.
+    ~FileSaver() override;
+
+    bool isSaving() const { return thread != nullptr; }
+    // Whether a running or queued save is for document.
+    bool isSaving(void *document) const;
+
+    // Saves the document the editor shows.
+    void save(const QString &fileName, const TextEncoding &encoding);
+
+    // Finishes every running and queued save, then saves with saveDocument()
+    // on the calling thread. For a document about to be closed or replaced,
+    // where a background save gains nothing and its copy costs memory.
+    bool saveAndWait(const QString &fileName, const TextEncoding &encoding, QString *error);
+
+    // Blocks until every running and queued save has finished.
+    void waitForDone();
+
+    // Call before document is released. Saves for it still need its text,
+    // so they are finished first; others carry on.
+    void documentClosed(void *document);
+
+signals:
+    void progress(qint64 bytesWritten, qint64 totalBytes);
+    void saved(const QString &fileName);
+    // A document the editor no longer shows matches the file it was saved
+    // to. The one shown is marked unmodified directly.
+    void documentSaved(void *document);
+    void failed(const QString &fileName, const QString &error);
+
+private slots:
+    void handleModified(int position, int modificationType, const char *text,
+                        int length, int linesAdded);
+
+private:
+    struct Request {
+        QString fileName;
+        TextEncoding encoding;
+        void *document = nullptr;
+    };
+
+    // The text to write, copied when the save starts, and the count of
+    // edits to its document then.
+    struct Job {
+        Request request;
+        std::vector<QByteArray> chunks;
+        quint64 edits = 0;
+        QString error;
+    };
+
+    void *shownDocument() const;
+    void start(const Request &request);
+    void run();
+    void finish();
+
+    QsciScintilla *editor;
+    // Reads queued documents the editor no longer shows; made when first
+    // needed.
+    QsciScintilla *reader = nullptr;
+    QThread *thread = nullptr;
+    // Tells the finish of the current worker from that of one already
+    // handled by waitForDone().
+    quint64 saveId = 0;
+    Job job;
+    std::vector<Request> queue;
+
+    // Counts the edits of each document, to tell whether it still matches a
+    // save.
+    QHash<void *, quint64> edits;
+};
+
+#endif // FILESAVER_H
@@ -0,0 +1,516 @@
+#include "filewatcher.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QThread>
+#include <QTimer>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "filesaver.h"
+
+namespace {
+
+// Quiet time after a notification before the file is looked at.
+constexpr int settleMsecs = 200;
+
+// Bytes read at a time.
+constexpr qint64 chunkBytes = 4 << 20;
+
+// Bytes at the start and before the old end of the file compared to make
+// sure it only grew.
+constexpr qint64 edgeBytes = 4096;
+
+// Beyond these, diffing costs more than it saves, and the whole range
+// between the common prefix and suffix is replaced.
+constexpr int64_t maxDiffLines = 1 << 20;
+constexpr int64_t maxDiffEdits = 2000;
+
+// Bytes memcmp() compares at once before the differing byte is looked for.
+constexpr int64_t compareBlock = 4096;
+
+struct Line {
+    const char *data;
+    int64_t length;
+    size_t hash;
+};
+
+// Lines of [begin, end) from begin.
+struct Hunk {
+    int64_t oldStart;
+    int64_t oldCount;
+    int64_t newStart;
+    int64_t newCount;
+};
+
+using Replacement = FileWatcher::Replacement;
+
+// Number of equal bytes at the start of a and b.
+int64_t equalPrefix(const char *a, const char *b, int64_t n) {
+    int64_t i = 0;
+    while (i < n) {
+        const int64_t m = std::min(compareBlock, n - i);
+        if (std::memcmp(a + i, b + i, static_cast<size_t>(m)) != 0)
+            break;
+        i += m;
+    }
+    while (i < n && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+// Number of equal bytes before aEnd and bEnd.
+int64_t equalSuffix(const char *aEnd, const char *bEnd, int64_t n) {
+    int64_t i = 0;
+    while (i < n) {
+        const int64_t m = std::min(compareBlock, n - i);
+        if (std::memcmp(aEnd - i - m, bEnd - i - m, static_cast<size_t>(m)) != 0)
+            break;
+        i += m;
+    }
+    while (i < n && aEnd[-i - 1] == bEnd[-i - 1])
+        ++i;
+    return i;
+}
+
+std::string copyRange(const std::vector<TextSpan> &spans, int64_t from, int64_t to) {
+    std::string out;
+    out.reserve(static_cast<size_t>(std::max<int64_t>(0, to - from)));
+    int64_t start = 0;
+    for (const TextSpan &span : spans) {
+        const int64_t begin = std::max(from, start);
+        const int64_t end = std::min(to, start + span.length);
+        if (begin < end)
+            out.append(span.data + (begin - start), static_cast<size_t>(end - begin));
+        start += span.length;
+    }
+    return out;
+}
+
+// Each line keeps its line end; the last may have none.
+std::vector<Line> splitLines(const char *data, int64_t length) {
+    std::vector<Line> lines;
+    const char *end = data + length;
+    for (const char *p = data; p < end;) {
+        const char *lf = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char *next = lf ? lf + 1 : end;
+        const auto n = static_cast<int64_t>(next - p);
+        lines.push_back({p, n, std::hash<std::string_view>()(std::string_view(p, static_cast<size_t>(n)))});
+        p = next;
+    }
+    return lines;
+}
+
+// Myers' O(ND) diff of two line lists, as the ranges that differ. Falls back
+// to one range for everything when the lists are long or differ a lot.
+std::vector<Hunk> diffLines(const std::vector<Line> &a, const std::vector<Line> &b) {
+    const auto n = static_cast<int64_t>(a.size());
+    const auto m = static_cast<int64_t>(b.size());
+    const std::vector<Hunk> whole = {{0, n, 0, m}};
+    if (n + m > maxDiffLines)
+        return whole;
+
+    auto same = [&a, &b](int64_t x, int64_t y) {
+        return a[x].hash == b[y].hash && a[x].length == b[y].length
+            && std::memcmp(a[x].data, b[y].data, static_cast<size_t>(a[x].length)) == 0;
+    };
+
+    // v[offset + k] is the furthest x reached on diagonal k = x - y. The
+    // trace keeps the diagonals -d .. d of v after each round d, to find the
+    // way back.
+    const int64_t maxD = std::min(n + m, maxDiffEdits);
+    const int64_t offset = maxD + 1;
+    std::vector<int64_t> v(static_cast<size_t>(2 * offset + 1), 0);
+    std::vector<std::vector<int64_t>> trace;
+    int64_t d = 0;
+    for (;; ++d) {
+        if (d > maxD)
+            return whole;
+        bool done = false;
+        for (int64_t k = -d; k <= d; k += 2) {
+            int64_t x = k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])
+                ? v[offset + k + 1]
+                : v[offset + k - 1] + 1;
+            int64_t y = x - k;
+            while (x < n && y < m && same(x, y)) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                done = true;
+                break;
+            }
+        }
+        if (done)
+            break;
+        trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+    }
+
+    // Walk back from the end, collecting the lines that match.
+    std::vector<std::pair<int64_t, int64_t>> matches;
+    int64_t x = n, y = m;
+    for (; d > 0; --d) {
+        const std::vector<int64_t> &previous = trace[static_cast<size_t>(d - 1)];
+        auto at = [&previous, d](int64_t k) { return previous[static_cast<size_t>(k + d - 1)]; };
+        const int64_t k = x - y;
+        const int64_t previousK = k == -d || (k != d && at(k - 1) < at(k + 1)) ? k + 1 : k - 1;
+        const int64_t previousX = at(previousK);
+        // Where the one edit of this round led, and the matching run began.
+        const int64_t runX = previousK == k + 1 ? previousX : previousX + 1;
+        while (x > runX) {
+            --x;
+            --y;
+            matches.emplace_back(x, y);
+        }
+        x = previousX;
+        y = previousX - previousK;
+    }
+    while (x > 0 && y > 0) {
+        --x;
+        --y;
+        matches.emplace_back(x, y);
+    }
+    std::reverse(matches.begin(), matches.end());
+
+    std::vector<Hunk> hunks;
+    int64_t nextX = 0, nextY = 0;
+    for (const auto &[matchX, matchY] : matches) {
+        if (matchX > nextX || matchY > nextY)
+            hunks.push_back({nextX, matchX - nextX, nextY, matchY - nextY});
+        nextX = matchX + 1;
+        nextY = matchY + 1;
+    }
+    if (n > nextX || m > nextY)
+        hunks.push_back({nextX, n - nextX, nextY, m - nextY});
+    return hunks;
+}
+
+// The replacements that turn old into text, from the bottom up, so that the
+// offsets of those still to make hold.
+std::vector<Replacement> replacementsFor(const std::string &old, const std::string &text) {
+    const auto oldLength = static_cast<int64_t>(old.size());
+    const auto newLength = static_cast<int64_t>(text.size());
+
+    // Skip what is equal at both ends, in whole lines: the prefix ends, and
+    // the suffix starts, just past a line feed.
+    int64_t prefix = equalPrefix(old.data(), text.data(), std::min(oldLength, newLength));
+    if (prefix == oldLength && prefix == newLength)
+        return {};
+    const size_t prefixEnd = prefix > 0 ? text.rfind('\n', static_cast<size_t>(prefix - 1)) : std::string::npos;
+    prefix = prefixEnd == std::string::npos ? 0 : static_cast<int64_t>(prefixEnd) + 1;
+
+    int64_t suffix = equalSuffix(old.data() + oldLength, text.data() + newLength,
+                                 std::min(oldLength, newLength) - prefix);
+    const char *suffixStart = text.data() + newLength - suffix;
+    const auto *lf = static_cast<const char *>(std::memchr(suffixStart, '\n', static_cast<size_t>(suffix)));
+    suffix = lf ? newLength - (lf - text.data() + 1) : 0;
+
+    const char *oldMiddle = old.data() + prefix;
+    const char *newMiddle = text.data() + prefix;
+    const int64_t oldMiddleLength = oldLength - suffix - prefix;
+    const int64_t newMiddleLength = newLength - suffix - prefix;
+    const std::vector<Line> a = splitLines(oldMiddle, oldMiddleLength);
+    const std::vector<Line> b = splitLines(newMiddle, newMiddleLength);
+    const std::vector<Hunk> hunks = diffLines(a, b);
+
+    auto oldOffset = [&a, oldMiddle, oldMiddleLength](int64_t line) {
+        return line < static_cast<int64_t>(a.size()) ? a[line].data - oldMiddle : oldMiddleLength;
+    };
+    auto newOffset = [&b, newMiddle, newMiddleLength](int64_t line) {
+        return line < static_cast<int64_t>(b.size()) ? b[line].data - newMiddle : newMiddleLength;
+    };
+
+    std::vector<Replacement> replacements;
+    replacements.reserve(hunks.size());
+    for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); ++hunk) {
+        const int64_t from = newOffset(hunk->newStart);
+        replacements.push_back({prefix + oldOffset(hunk->oldStart),
+                                prefix + oldOffset(hunk->oldStart + hunk->oldCount), prefix + from,
+                                newOffset(hunk->newStart + hunk->newCount) - from});
+    }
+    return replacements;
+}
+
+} // namespace
+
+FileWatcher::FileWatcher(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor) {
+    watcher = new QFileSystemWatcher(this);
+    settle = new QTimer(this);
+    settle->setSingleShot(true);
+    settle->setInterval(settleMsecs);
+
+    connect(watcher, &QFileSystemWatcher::fileChanged, settle, qOverload<>(&QTimer::start));
+    // Files replaced by a rename, as most programs save, drop out of the
+    // watch; their directory notices the new one.
+    connect(watcher, &QFileSystemWatcher::directoryChanged, settle, qOverload<>(&QTimer::start));
+    connect(settle, &QTimer::timeout, this, &FileWatcher::check);
+    connect(editor, &QsciScintillaBase::SCN_MODIFIED, this, &FileWatcher::handleModified);
+}
+
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+void FileWatcher::handleModified(int, int modificationType, const char *, int, int) {
+    if (modificationType & (QsciScintillaBase::SC_MOD_INSERTTEXT |
+                            QsciScintillaBase::SC_MOD_DELETETEXT))
+        ++edits;
+}
+
+FileWatcher::State FileWatcher::stateOf(const QString &fileName) {
+    const QFileInfo info(fileName);
+    return {fileName, info.exists() ? info.size() : -1, info.lastModified()};
+}
+
+void FileWatcher::watch(const QString &fileName) {
+    watch(stateOf(fileName));
+}
+
+void FileWatcher::watch(const State &state) {
+    stop();
+    if (state.fileName != watched)
+        unwatch();
+    watched = state.fileName;
+    const QString dir = QFileInfo(watched).absolutePath();
+    if (!watcher->directories().contains(dir))
+        watcher->addPath(dir);
+    if (QFileInfo::exists(watched) && !watcher->files().contains(watched))
+        watcher->addPath(watched);
+    knownSize = state.size;
+    knownModified = state.modified;
+}
+
+void FileWatcher::unwatch() {
+    stop();
+    settle->stop();
+    const QStringList paths = watcher->files() + watcher->directories();
+    if (!paths.isEmpty())
+        watcher->removePaths(paths);
+    watched.clear();
+    knownSize = -1;
+}
+
+void FileWatcher::markCurrent() {
+    const State now = stateOf(watched);
+    knownSize = now.size;
+    knownModified = now.modified;
+}
+
+void FileWatcher::check() {
+    // A running reload checks again when it finishes.
+    if (watched.isEmpty() || thread)
+        return;
+
+    const QFileInfo info(watched);
+    if (!info.exists()) {
+        if (knownSize >= 0) {
+            knownSize = -1;
+            emit removedFromDisk(watched);
+        }
+        return;
+    }
+    if (!watcher->files().contains(watched))
+        watcher->addPath(watched);
+
+    if (info.size() == knownSize && info.lastModified() == knownModified)
+        return;
+    emit changedOnDisk(watched);
+}
+
+void FileWatcher::reload(const TextEncoding &encoding) {
+    reload(encoding, true);
+}
+
+void FileWatcher::reload(const TextEncoding &encoding, bool mayAppend) {
+    stop();
+    if (watched.isEmpty())
+        return;
+
+    // An unmodified UTF-8 document that the file has grown past may only
+    // need the new bytes. The worker makes sure the bytes at the start and
+    // before the old end did not change; a file rewritten to the same size
+    // has not grown, and is compared in full. Otherwise the worker gets a
+    // copy of the document to diff against, and the editor only makes the
+    // replacements it finds.
+    const QFileInfo info(watched);
+    const auto bom = static_cast<qint64>(encoding.byteOrderMark().size());
+    const qint64 length = editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const std::vector<TextSpan> spans = documentSpans(editor);
+    qint64 from = -1;
+    std::string head;
+    std::string tail;
+    std::string document;
+    if (mayAppend && encoding.isUtf8() && !editor->isModified() && info.size() > bom + length) {
+        from = bom + length;
+        head = copyRange(spans, 0, std::min(length, edgeBytes));
+        tail = copyRange(spans, std::max<qint64>(0, length - edgeBytes), length);
+    } else {
+        document = copyRange(spans, 0, length);
+    }
+
+    // Changes during the read make the file differ from this again.
+    knownSize = info.size();
+    knownModified = info.lastModified();
+
+    result = Result();
+    readEdits = edits;
+    reloadEncoding = encoding;
+    thread = QThread::create([this, fileName = watched, from, head, tail, document = std::move(document), encoding] {
+        read(fileName, from, head, tail, encoding);
+        if (from < 0 && result.error.isEmpty())
+            result.replacements = replacementsFor(document, result.text);
+    });
+    connect(thread, &QThread::finished, this, [this, id = ++reloadId] {
+        if (id == reloadId && thread)
+            finish();
+    });
+    thread->start(QThread::LowPriority);
+}
+
+void FileWatcher::read(const QString &fileName, qint64 from, const std::string &head,
+                       const std::string &tail, const TextEncoding &encoding) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = file.errorString();
+        return;
+    }
+
+    auto readAll = [&file, this](const std::function<bool(const char *, qint64)> &take) {
+        std::vector<char> buffer(static_cast<size_t>(chunkBytes));
+        for (;;) {
+            const qint64 n = file.read(buffer.data(), chunkBytes);
+            if (n < 0) {
+                result.error = file.errorString();
+                return false;
+            }
+            if (n == 0)
+                return true;
+            if (!take(buffer.data(), n))
+                return false;
+        }
+    };
+
+    if (from >= 0) {
+        const auto bom = static_cast<qint64>(encoding.byteOrderMark().size());
+        const auto before = static_cast<qint64>(tail.size());
+        auto matches = [&file](qint64 at, const std::string &bytes) {
+            const auto n = static_cast<qint64>(bytes.size());
+            return file.seek(at) && file.read(n) == QByteArray(bytes.data(), static_cast<qsizetype>(n));
+        };
+        if (file.size() < from || !matches(bom, head) || !matches(from - before, tail)) {
+            // Rewritten rather than grown; the owner diffs it instead.
+            result.rewritten = true;
+            return;
+        }
+        result.appended = true;
+        file.seek(from);
+        readAll([this](const char *data, qint64 n) {
+            result.text.append(data, static_cast<size_t>(n));
+            return true;
+        });
+        return;
+    }
+
+    const std::string bom = encoding.byteOrderMark();
+    if (!bom.empty() && file.peek(static_cast<qint64>(bom.size())) == QByteArray(bom.data(), static_cast<qsizetype>(bom.size())))
+        file.seek(static_cast<qint64>(bom.size()));
+
+    if (encoding.isUtf8()) {
+        result.text.reserve(static_cast<size_t>(std::max<qint64>(0, file.size())));
+        readAll([this](const char *data, qint64 n) {
+            result.text.append(data, static_cast<size_t>(n));
+            return true;
+        });
+        return;
+    }
+
+    Transcoder transcoder(encoding.name, Transcoder::ToUtf8);
+    if (!transcoder.isValid()) {
+        result.error = "Unsupported encoding " + QString::fromStdString(encoding.name);
+        return;
+    }
+    std::string failure;
+    const bool ok = readAll([&transcoder, &failure, this](const char *data, qint64 n) {
+        return transcoder.convert(data, static_cast<size_t>(n), false, result.text, &failure);
+    }) && transcoder.convert(nullptr, 0, true, result.text, &failure);
+    if (!ok && result.error.isEmpty())
+        result.error = QString::fromStdString(failure);
+}
+
+void FileWatcher::stop() {
+    if (!thread)
+        return;
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+    ++reloadId;
+    result = Result();
+}
+
+void FileWatcher::finish() {
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+
+    Result done = std::move(result);
+    result = Result();
+    if (!done.error.isEmpty()) {
+        emit failed(watched, done.error);
+        return;
+    }
+
+    // The text read may no longer fit the document; ask the owner again.
+    if (edits != readEdits) {
+        knownSize = -1;
+        emit changedOnDisk(watched);
+        return;
+    }
+
+    if (done.rewritten) {
+        reload(reloadEncoding, false);
+        return;
+    }
+
+    if (done.appended) {
+        if (!done.text.empty()) {
+            editor->SendScintilla(QsciScintillaBase::SCI_APPENDTEXT,
+                                  static_cast<unsigned long>(done.text.size()), done.text.data());
+        }
+        editor->setModified(false);
+        emit reloaded(watched, 0, static_cast<qint64>(done.text.size()));
+    } else {
+        const qint64 bytes = apply(done);
+        editor->setModified(false);
+        emit reloaded(watched, static_cast<int>(done.replacements.size()), bytes);
+    }
+
+    // The file may have changed again during the read.
+    check();
+}
+
+qint64 FileWatcher::apply(const Result &done) {
+    if (done.replacements.empty())
+        return 0;
+    qint64 bytes = 0;
+    editor->SendScintilla(QsciScintillaBase::SCI_BEGINUNDOACTION);
+    for (const Replacement &replacement : done.replacements) {
+        editor->SendScintilla(QsciScintillaBase::SCI_SETTARGETRANGE, static_cast<unsigned long>(replacement.start),
+                              static_cast<long>(replacement.end));
+        editor->SendScintilla(QsciScintillaBase::SCI_REPLACETARGET, static_cast<unsigned long>(replacement.length),
+                              done.text.data() + replacement.from);
+        bytes += replacement.length;
+    }
+    editor->SendScintilla(QsciScintillaBase::SCI_ENDUNDOACTION);
+    return bytes;
+}
@@ -0,0 +1,141 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <QDateTime>
+#include <QObject>
+#include <QString>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "encoding.h"
+
+class QFileSystemWatcher;
+class QThread;
+class QTimer;
+class QsciScintilla;
+
+// Notices when the file open in editor changes on disk, and reloads it in
+// place. Rather than replacing the text, which would lose the scroll
+// position, the undo history and the styling, a reload edits only the lines
+// that differ, as one undoable step.
+//
+// A file that only grew, like a log being written, is the common case and
+// the cheap one: only the new bytes are read and appended. Otherwise the new
+// text is read on a worker thread and compared there with a copy of the
+// document: the common prefix and suffix are skipped at memcmp speed, and
+// the lines in between are diffed with Myers' algorithm. The editor only
+// makes the replacements the worker found.
+//
+// The watcher does not decide when to reload. It emits changedOnDisk(), and
+// the owner calls reload(), or markCurrent() to keep its own text.
+class FileWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    // What the watcher knows of a file: how it was when the document last
+    // matched it. A document the editor does not show keeps this instead of
+    // a watch, and hands it back once it returns.
+    struct State {
+        QString fileName;
+        qint64 size = -1;
+        QDateTime modified;
+    };
+
+    // A range of the document, [start, end), and the bytes of the new text
+    // that replace it.
+    struct Replacement {
+        int64_t start;
+        int64_t end;
+        int64_t from;
+        int64_t length;
+    };
+
+    explicit FileWatcher(QsciScintilla *editor, QObject *parent = nullptr);
+    ~FileWatcher() override;
+
+    // The file as it is on disk now.
+    static State stateOf(const QString &fileName);
+
+    // Watches fileName, whose contents the document holds now.
+    void watch(const QString &fileName);
+    // Watches the file of state, which the document matched as state says;
+    // check() then tells whether it changed since.
+    void watch(const State &state);
+    void unwatch();
+    State state() const { return {watched, knownSize, knownModified}; }
+    QString fileName() const { return watched; }
+
+    bool isReloading() const { return thread != nullptr; }
+
+    // Takes the file as it is on disk now for what the document holds, as
+    // after a save, or to stop asking about a change the user declined.
+    void markCurrent();
+
+    // Emits changedOnDisk() again if the file still differs from what the
+    // document holds, for an owner that was busy the first time.
+    void check();
+
+    // Brings the document up to date with the file, which is in encoding.
+    // reloaded() or failed() reports the outcome.
+    void reload(const TextEncoding &encoding);
+    // Drops a reload in progress, for a document leaving the editor. The
+    // change stays unhandled, and check() reports it again.
+    void stop();
+
+signals:
+    void changedOnDisk(const QString &fileName);
+    void removedFromDisk(const QString &fileName);
+    // changes: the number of ranges replaced, or 0 when bytes were only
+    // appended. bytes: the bytes put into the document.
+    void reloaded(const QString &fileName, int changes, qint64 bytes);
+    void failed(const QString &fileName, const QString &error);
+
+private slots:
+    void handleModified(int position, int modificationType, const char *text,
+                        int length, int linesAdded);
+
+private:
+    // Written by the worker, read once it has finished.
+    struct Result {
+        // Only the bytes past the old end, or else the whole text.
+        bool appended = false;
+        // Not grown after all, and to be read again and diffed.
+        bool rewritten = false;
+        std::string text;
+        // For the whole text, what changes in the document, from the bottom
+        // up.
+        std::vector<Replacement> replacements;
+        QString error;
+    };
+
+    // mayAppend: whether a file that grew may only need its new bytes.
+    void reload(const TextEncoding &encoding, bool mayAppend);
+    void read(const QString &fileName, qint64 from, const std::string &head, const std::string &tail,
+              const TextEncoding &encoding);
+    void finish();
+    // Makes the replacements of done as one undoable step. Returns the bytes
+    // put in.
+    qint64 apply(const Result &done);
+
+    QsciScintilla *editor;
+    QFileSystemWatcher *watcher;
+    // Collects the bursts of notifications a single write causes.
+    QTimer *settle;
+    QString watched;
+    // The file as the document last matched it.
+    qint64 knownSize = -1;
+    QDateTime knownModified;
+
+    QThread *thread = nullptr;
+    // Tells the finish of the current worker from that of one already stopped.
+    quint64 reloadId = 0;
+    Result result;
+    TextEncoding reloadEncoding;
+    // Counts edits, to tell whether the document changed during a read.
+    quint64 edits = 0;
+    quint64 readEdits = 0;
+};
+
+#endif // FILEWATCHER_H
@@ -0,0 +1,157 @@
+#include "gitignore.h"
+
+#include <cstring>
+
+namespace {
+
+// Matches the class at p, just past its [, against c. Sets end past the
+// closing ]; a [ without one is no class, and matches itself.
+bool matchClass(const char *p, const char *pe, char c, const char **end) {
+    const bool negated = p < pe && (*p == '!' || *p == '^');
+    if (negated)
+        ++p;
+    bool matched = false;
+    bool first = true;
+    while (p < pe && (*p != ']' || first)) {
+        first = false;
+        char low = *p;
+        if (low == '\\' && p + 1 < pe)
+            low = *++p;
+        char high = low;
+        if (p + 2 < pe && p[1] == '-' && p[2] != ']') {
+            p += 2;
+            high = *p;
+            if (high == '\\' && p + 1 < pe)
+                high = *++p;
+        }
+        if (c >= low && c <= high)
+            matched = true;
+        ++p;
+    }
+    if (p == pe) {
+        *end = nullptr;
+        return false;
+    }
+    *end = p + 1;
+    return matched != negated;
+}
+
+// Matches text against pattern, where * and ? stop at a / and ** does not.
+bool wildmatch(const char *p, const char *pe, const char *t, const char *te) {
+    while (p < pe) {
+        if (*p == '*') {
+            if (p + 1 < pe && p[1] == '*') {
+                p += 2;
+                while (p < pe && *p == '*')
+                    ++p;
+                if (p < pe && *p == '/') {
+                    // "**/" matches no directory, or any number of them.
+                    ++p;
+                    for (const char *s = t;;) {
+                        if (wildmatch(p, pe, s, te))
+                            return true;
+                        const void *slash = std::memchr(s, '/', static_cast<size_t>(te - s));
+                        if (!slash)
+                            return false;
+                        s = static_cast<const char *>(slash) + 1;
+                    }
+                }
+                // Elsewhere, ** matches anything.
+                for (const char *s = t; s <= te; ++s) {
+                    if (wildmatch(p, pe, s, te))
+                        return true;
+                }
+                return false;
+            }
+            ++p;
+            for (const char *s = t;; ++s) {
+                if (wildmatch(p, pe, s, te))
+                    return true;
+                if (s == te || *s == '/')
+                    return false;
+            }
+        }
+        if (t == te)
+            return false;
+        if (*p == '?') {
+            if (*t == '/')
+                return false;
+        } else if (*p == '[') {
+            const char *end = nullptr;
+            const bool matched = matchClass(p + 1, pe, *t, &end);
+            if (end) {
+                if (!matched || *t == '/')
+                    return false;
+                p = end;
+                ++t;
+                continue;
+            }
+            if (*t != '[')
+                return false;
+        } else {
+            if (*p == '\\' && p + 1 < pe)
+                ++p;
+            if (*p != *t)
+                return false;
+        }
+        ++p;
+        ++t;
+    }
+    return t == te;
+}
+
+} // namespace
+
+void IgnoreRules::parse(const std::string &text) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        // Trailing spaces go, unless escaped.
+        while (!line.empty() && line.back() == ' '
+               && !(line.size() > 1 && line[line.size() - 2] == '\\'))
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.erase(0, 1);
+        } else if (line[0] == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!')) {
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.directoryOnly = true;
+            line.pop_back();
+        }
+        rule.anchored = line.find('/') != std::string::npos;
+        if (!line.empty() && line[0] == '/')
+            line.erase(0, 1);
+        if (line.empty())
+            continue;
+        rule.pattern = line;
+        rules.push_back(rule);
+    }
+}
+
+int IgnoreRules::match(const std::string &path, bool isDirectory) const {
+    const size_t slash = path.rfind('/');
+    const char *name = path.data() + (slash == std::string::npos ? 0 : slash + 1);
+    const char *pathEnd = path.data() + path.size();
+    for (auto rule = rules.rbegin(); rule != rules.rend(); ++rule) {
+        if (rule->directoryOnly && !isDirectory)
+            continue;
+        const char *p = rule->pattern.data();
+        const char *subject = rule->anchored ? path.data() : name;
+        if (wildmatch(p, p + rule->pattern.size(), subject, pathEnd))
+            return rule->negated ? -1 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef GITIGNORE_H
+#define GITIGNORE_H
+
+#include <string>
+#include <vector>
+
+// The patterns of one .gitignore, or of .git/info/exclude, for the paths
+// below the directory it is in. Follows gitignore(5): # comments, !
+// negation, a trailing / for directories only, a leading or inner / to
+// anchor the pattern to the directory, and the wildcards *, ?, [...] and
+// **. Paths are bytes, as the file system has them.
+class IgnoreRules {
+public:
+    // Adds the patterns in text, one per line.
+    void parse(const std::string &text);
+    bool empty() const { return rules.empty(); }
+
+    // What the last pattern matching path says: 1 ignore it, -1 keep it
+    // (a negated pattern), 0 no pattern matches. path is relative to the
+    // directory of the rules, with / between components.
+    int match(const std::string &path, bool isDirectory) const;
+
+private:
+    struct Rule {
+        std::string pattern;
+        bool negated = false;
+        bool directoryOnly = false;
+        // Matched against the whole path rather than its last component.
+        bool anchored = false;
+    };
+
+    std::vector<Rule> rules;
+};
+
+#endif // GITIGNORE_H
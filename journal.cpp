@@ -0,0 +1,436 @@
+#include "journal.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "filesaver.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Starts every journal, so that a stray file is never replayed.
+constexpr char magic[8] = {'C', 'O', 'D', 'E', 'I', 'T', 'J', '1'};
+
+// Record types. The first record is a head, the rest are edits.
+enum : char {
+    // size, modification time and document length of the file
+    FileHead = 'F',
+    EmptyHead = 'E',
+    // position, then the text inserted
+    Insert = 'I',
+    // position and length
+    Delete = 'D',
+};
+
+// How long changes gather before they are written, unless this many bytes
+// gather first.
+constexpr int flushMsecs = 200;
+constexpr size_t flushBytes = 1 << 20;
+
+// A journal that has grown past this, and past twice the document, is
+// compacted into a snapshot.
+constexpr int64_t compactBytes = 4 << 20;
+
+// The largest insert record a snapshot writes.
+constexpr int64_t snapshotChunkBytes = 1 << 20;
+
+// CRC-32 as zlib computes it (reflected polynomial 0xEDB88320).
+uint32_t crc32(const char *data, size_t length) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i)
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void putInt(std::string &out, int64_t value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+template <typename T>
+bool takeInt(const char *&p, const char *end, T &value) {
+    if (end - p < static_cast<std::ptrdiff_t>(sizeof value))
+        return false;
+    std::memcpy(&value, p, sizeof value);
+    p += sizeof value;
+    return true;
+}
+
+// A record is the payload's length and CRC, then the payload.
+std::string frame(const std::string &payload) {
+    std::string out;
+    const auto length = static_cast<uint32_t>(payload.size());
+    const uint32_t crc = crc32(payload.data(), payload.size());
+    out.reserve(sizeof length + sizeof crc + payload.size());
+    out.append(reinterpret_cast<const char *>(&length), sizeof length);
+    out.append(reinterpret_cast<const char *>(&crc), sizeof crc);
+    out += payload;
+    return out;
+}
+
+std::string insertRecord(int64_t position, const char *text, int64_t length) {
+    std::string payload(1, Insert);
+    putInt(payload, position);
+    payload.append(text, static_cast<size_t>(length));
+    return payload;
+}
+
+std::string fileHead(const QString &fileName, int64_t documentLength) {
+    const QFileInfo info(fileName);
+    std::string payload(1, FileHead);
+    putInt(payload, info.size());
+    putInt(payload, info.lastModified().toMSecsSinceEpoch());
+    putInt(payload, documentLength);
+    return payload;
+}
+
+} // namespace
+
+Journal::Journal(QsciScintilla *editor, QObject *parent)
+    : QObject(parent), editor(editor) {
+    connect(editor, &QsciScintillaBase::SCN_MODIFIED, this, &Journal::handleModified);
+    connect(editor, &QsciScintillaBase::SCN_SAVEPOINTREACHED, this, &Journal::handleSavePoint);
+}
+
+Journal::~Journal() {
+    if (!thread)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wake.notify_one();
+    thread->wait();
+    delete thread;
+}
+
+QString Journal::pathFor(const QString &fileName, int untitled) {
+    if (fileName.isEmpty()) {
+        // The first untitled document keeps the name it had before there
+        // could be several.
+        return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+            + (untitled > 1 ? QString("/untitled-%1.codeit-journal").arg(untitled)
+                            : QString("/untitled.codeit-journal"));
+    }
+    const QFileInfo info(fileName);
+    return info.absolutePath() + "/." + info.fileName() + ".codeit-journal";
+}
+
+bool Journal::exists(const QString &fileName, int untitled) {
+    return QFileInfo::exists(pathFor(fileName, untitled));
+}
+
+QList<int> Journal::untitledJournals() {
+    QList<int> numbers;
+    const QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+    for (const QString &name : dir.entryList({"untitled*.codeit-journal"}, QDir::Files)) {
+        if (name == "untitled.codeit-journal") {
+            numbers.append(1);
+            continue;
+        }
+        bool ok = false;
+        const int number = name.mid(9, name.size() - 24).toInt(&ok);
+        if (ok && name.startsWith("untitled-") && number > 1)
+            numbers.append(number);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+void Journal::discard(const QString &fileName, int untitled) {
+    QFile::remove(pathFor(fileName, untitled));
+}
+
+void Journal::restart(const QString &name, int number) {
+    fileName = name;
+    untitled = number;
+    active = true;
+    suspended = false;
+    journaled = 0;
+    bool remove;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        remove = started;
+        if (started)
+            removePaths.append(openPath);
+        started = false;
+        reopen = false;
+        openPath = pathFor(name, number);
+    }
+    if (remove)
+        wakeWorker();
+
+    const int64_t length = editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    if (editor->isModified() || (name.isEmpty() && length > 0))
+        snapshot();
+    else
+        head = name.isEmpty() ? std::string(1, EmptyHead) : fileHead(name, length);
+}
+
+void Journal::close() {
+    active = false;
+    bool remove;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        remove = started;
+        if (started)
+            removePaths.append(openPath);
+        started = false;
+        reopen = false;
+    }
+    if (remove)
+        wakeWorker();
+}
+
+void Journal::handleSavePoint() {
+    // The document matches its file again, so the journal has nothing to
+    // add. An untitled document has no file, and keeps a snapshot.
+    if (active && !suspended && !fileName.isEmpty())
+        restart(fileName, untitled);
+}
+
+void Journal::handleModified(int position, int modificationType, const char *text,
+                             int length, int) {
+    if (!active || suspended)
+        return;
+    if (modificationType & QsciScintillaBase::SC_MOD_INSERTTEXT) {
+        record(insertRecord(position, text, length));
+    } else if (modificationType & QsciScintillaBase::SC_MOD_DELETETEXT) {
+        std::string payload(1, Delete);
+        putInt(payload, position);
+        putInt(payload, length);
+        record(payload);
+    }
+}
+
+void Journal::record(const std::string &payload) {
+    const std::string bytes = frame(payload);
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!started) {
+            started = true;
+            reopen = true;
+            pending.assign(magic, sizeof magic);
+            pending += frame(head);
+        }
+        pending += bytes;
+        full = pending.size() >= flushBytes;
+    }
+    if (full)
+        wakeWorker();
+
+    // Compact once replaying the edits would cost more than the text they
+    // make. Not from inside a notification, where the text is mid-change.
+    journaled += static_cast<int64_t>(bytes.size());
+    if (!compacting && journaled > compactBytes
+        && journaled > 2 * editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH)) {
+        compacting = true;
+        QMetaObject::invokeMethod(this, &Journal::compact, Qt::QueuedConnection);
+    }
+}
+
+void Journal::compact() {
+    compacting = false;
+    if (active && !suspended)
+        snapshot();
+}
+
+void Journal::wakeWorker() {
+    if (!thread) {
+        thread = QThread::create([this] { run(); });
+        thread->start(QThread::LowPriority);
+    }
+    wake.notify_one();
+}
+
+void Journal::snapshot() {
+    head = std::string(1, EmptyHead);
+    {
+        // Replaces whatever the journal holds; no need to write the rest.
+        std::lock_guard<std::mutex> lock(mutex);
+        started = true;
+        reopen = true;
+        pending.assign(magic, sizeof magic);
+        pending += frame(head);
+    }
+    journaled = 0;
+
+    // A large document is copied here, much as a background save copies
+    // it, which only happens once the journal has outgrown it.
+    int64_t position = 0;
+    for (const TextSpan &span : documentSpans(editor)) {
+        for (int64_t done = 0; done < span.length;) {
+            const int64_t n = std::min(snapshotChunkBytes, span.length - done);
+            record(insertRecord(position, span.data + done, n));
+            position += n;
+            done += n;
+        }
+    }
+}
+
+void Journal::run() {
+    QFile file;
+    bool reported = false;
+    auto report = [this, &file, &reported] {
+        if (reported)
+            return;
+        reported = true;
+        const QString error = file.fileName() + ": " + file.errorString();
+        QMetaObject::invokeMethod(this, [this, error] { emit failed(error); }, Qt::QueuedConnection);
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        // Sleep until there is work, then let changes gather a little.
+        wake.wait(lock, [this] { return stopRequested || !removePaths.isEmpty() || !pending.empty(); });
+        wake.wait_for(lock, std::chrono::milliseconds(flushMsecs),
+                      [this] { return stopRequested || pending.size() >= flushBytes; });
+
+        std::string data;
+        data.swap(pending);
+        QStringList remove;
+        remove.swap(removePaths);
+        const bool open = reopen;
+        reopen = false;
+        const QString path = openPath;
+        const bool quit = stopRequested;
+        lock.unlock();
+
+        for (const QString &removed : remove) {
+            if (file.isOpen() && file.fileName() == removed)
+                file.close();
+            QFile::remove(removed);
+        }
+        if (open) {
+            file.close();
+            file.setFileName(path);
+            reported = false;
+            QDir().mkpath(QFileInfo(path).absolutePath());
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+                report();
+        }
+        if (!data.empty() && file.isOpen()) {
+            if (file.write(data.data(), static_cast<qint64>(data.size())) != static_cast<qint64>(data.size()))
+                report();
+#ifdef Q_OS_UNIX
+            else
+                ::fdatasync(file.handle());
+#endif
+        }
+
+        lock.lock();
+        if (quit)
+            break;
+    }
+}
+
+bool Journal::replay(const QString &fileName, QsciScintilla *editor, QString *error,
+                     int untitled) {
+    auto fail = [error](const QString &message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    QFile file(pathFor(fileName, untitled));
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    const QByteArray bytes = file.readAll();
+    const char *p = bytes.constData();
+    const char *end = p + bytes.size();
+    if (end - p < static_cast<std::ptrdiff_t>(sizeof magic) || std::memcmp(p, magic, sizeof magic) != 0)
+        return fail("Not a journal");
+    p += sizeof magic;
+
+    // The records up to the first one cut short or damaged.
+    std::vector<std::pair<const char *, const char *>> records;
+    for (;;) {
+        uint32_t length, crc;
+        const char *at = p;
+        if (!takeInt(at, end, length) || !takeInt(at, end, crc) || end - at < static_cast<std::ptrdiff_t>(length)
+            || crc32(at, length) != crc || length == 0)
+            break;
+        records.emplace_back(at, at + length);
+        p = at + length;
+    }
+    if (records.empty())
+        return fail("The journal is empty");
+
+    int64_t documentLength = editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const auto [headStart, headEnd] = records.front();
+    if (*headStart == FileHead) {
+        const char *q = headStart + 1;
+        int64_t size, modified, length;
+        const QFileInfo info(fileName);
+        if (!takeInt(q, headEnd, size) || !takeInt(q, headEnd, modified) || !takeInt(q, headEnd, length))
+            return fail("The journal is damaged");
+        if (size != info.size() || modified != info.lastModified().toMSecsSinceEpoch()
+            || length != documentLength)
+            return fail("The file has changed since the journal was written");
+    } else if (*headStart != EmptyHead) {
+        return fail("The journal is damaged");
+    }
+
+    editor->SendScintilla(QsciScintillaBase::SCI_BEGINUNDOACTION);
+    if (*headStart == EmptyHead) {
+        editor->SendScintilla(QsciScintillaBase::SCI_CLEARALL);
+        documentLength = 0;
+    }
+    for (size_t i = 1; i < records.size(); ++i) {
+        const char *q = records[i].first + 1;
+        const char *recordEnd = records[i].second;
+        int64_t position, length = 0;
+        if (!takeInt(q, recordEnd, position))
+            break;
+        const char type = *records[i].first;
+        if (type == Insert) {
+            length = recordEnd - q;
+            if (position < 0 || position > documentLength)
+                break;
+            editor->SendScintilla(QsciScintillaBase::SCI_SETTARGETRANGE,
+                                  static_cast<unsigned long>(position), static_cast<long>(position));
+            editor->SendScintilla(QsciScintillaBase::SCI_REPLACETARGET,
+                                  static_cast<unsigned long>(length), q);
+            documentLength += length;
+        } else if (type == Delete) {
+            if (!takeInt(q, recordEnd, length) || position < 0 || length < 0
+                || position + length > documentLength)
+                break;
+            editor->SendScintilla(QsciScintillaBase::SCI_DELETERANGE,
+                                  static_cast<unsigned long>(position), static_cast<long>(length));
+            documentLength -= length;
+        } else {
+            break;
+        }
+    }
+    editor->SendScintilla(QsciScintillaBase::SCI_ENDUNDOACTION);
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+class QThread;
+class QsciScintilla;
+
+// Records every change to editor's document in an append-only journal
+// beside the file, so that the edits since the last save survive a crash.
+//
+// The journal is a sequence of checksummed records. The first names what
+// the edits apply to: the file on disk, identified by size and modification
+// time, or an empty document. Then come the inserts and deletes, as
+// SCN_MODIFIED reports them. A document that differs from its file when
+// the journal starts, and a journal that has grown larger than the document,
+// start over from an empty document plus the whole text, which is the
+// snapshot that compaction leaves.
+//
+// Recording a change only appends a few bytes to a buffer. A worker thread
+// writes the buffer out and fsyncs it a few times a second, so typing never
+// waits for the disk. An unmodified document has no journal at all.
+//
+// Each open document has its own journal. Only the one whose document the
+// editor shows records; the others are suspended.
+class Journal : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Journal(QsciScintilla *editor, QObject *parent = nullptr);
+    // Writes out what is buffered. The journal stays if it holds changes.
+    ~Journal() override;
+
+    // Where the journal of fileName goes: beside it, or in the application's
+    // data directory for an untitled document, numbered by untitled.
+    static QString pathFor(const QString &fileName, int untitled = 1);
+
+    // Starts journaling the document as it is now, as the contents of
+    // fileName, or untitled document number untitled if fileName is empty.
+    // Call whenever the document gets new text wholesale or is saved. Any
+    // earlier journal is dropped.
+    void restart(const QString &fileName, int untitled = 1);
+    // Stops journaling and deletes the journal, for a document discarded or
+    // no longer edited by hand.
+    void close();
+
+    // Stops recording while the editor shows another document, keeping the
+    // journal; resume() carries on with it once the document is back.
+    void suspend() { suspended = true; }
+    void resume() { suspended = false; }
+
+    // Whether fileName has a journal left by an earlier session.
+    static bool exists(const QString &fileName, int untitled = 1);
+    // The numbers of the untitled documents that have journals.
+    static QList<int> untitledJournals();
+    // Replays the journal of fileName into editor, which must hold what the
+    // journal starts from, as one undoable step. Records after the first
+    // damaged one, as a crash leaves, are ignored. Returns false and sets
+    // error if the journal does not fit the file or cannot be read.
+    static bool replay(const QString &fileName, QsciScintilla *editor, QString *error,
+                       int untitled = 1);
+    // Deletes the journal of fileName.
+    static void discard(const QString &fileName, int untitled = 1);
+
+signals:
+    void failed(const QString &error);
+
+private slots:
+    void handleModified(int position, int modificationType, const char *text,
+                        int length, int linesAdded);
+    void handleSavePoint();
+
+private:
+    void record(const std::string &payload);
+    // Starts the journal over from an empty document plus the whole text.
+    void snapshot();
+    void compact();
+    // Starts the worker if need be and wakes it.
+    void wakeWorker();
+    void run();
+
+    QsciScintilla *editor;
+    bool active = false;
+    bool suspended = false;
+    QString fileName;
+    int untitled = 1;
+    // The record that starts the journal, written with the first change.
+    std::string head;
+    // Whether the journal file has been started.
+    bool started = false;
+    // Bytes journaled since the start, to tell when to compact.
+    int64_t journaled = 0;
+    bool compacting = false;
+
+    // Started with the first journal, so that documents never edited cost
+    // no thread.
+    QThread *thread = nullptr;
+
+    // Shared with the worker.
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopRequested = false;
+    std::string pending;
+    // The worker deletes removePaths, then writes pending to openPath,
+    // starting that over first if reopen is set.
+    QStringList removePaths;
+    bool reopen = false;
+    QString openPath;
+};
+
+#endif // JOURNAL_H
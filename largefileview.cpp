@@ -0,0 +1,806 @@
+#include "largefileview.h"
+
+#include <QApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QThread>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "filesaver.h"
+#include "textscan.h"
+
+namespace {
+
+// Bytes indexed between two progress reports.
+constexpr int64_t progressBytes = 16 << 20;
+
+// Bytes of a line that are shown; the rest is cut off.
+constexpr int64_t maxLineBytes = 64 * 1024;
+
+// Bytes read to find the end of a line on screen, which is usually short.
+constexpr int64_t probeBytes = 4096;
+
+// Bytes of the unindexed file searched between two checks for a stop request.
+constexpr int64_t searchWindowBytes = 64 << 20;
+
+// The vertical scroll bar's range once the lines outnumber it. Lines times
+// steps stays well within 64 bits for any file that fits on a disk.
+constexpr int64_t scrollSteps = 1 << 20;
+
+// Bytes looked at to tell CR LF files from LF ones.
+constexpr int64_t newlineSampleBytes = 64 * 1024;
+
+constexpr int tabWidth = 4;
+constexpr int margin = 4;
+
+} // namespace
+
+LargeFileView::LargeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent) {
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setAutoFillBackground(true);
+    viewport()->setBackgroundRole(QPalette::Base);
+    verticalScrollBar()->setSingleStep(1);
+    horizontalScrollBar()->setSingleStep(1);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &LargeFileView::handleScrolled);
+
+    // The indexer signals from its own thread, so this connection is queued.
+    connect(this, &LargeFileView::indexProgress, this, &LargeFileView::handleIndexed);
+}
+
+LargeFileView::~LargeFileView() {
+    close();
+}
+
+bool LargeFileView::open(const QString &fileName, QString *error) {
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    length = file.size();
+    if (length > 0) {
+        data = reinterpret_cast<const char *>(file.map(0, length));
+        if (!data) {
+            if (error)
+                *error = file.errorString();
+            file.close();
+            length = 0;
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        indexing = true;
+    }
+    stopRequested = false;
+    matchOffset = pendingMatch = -1;
+    widestColumns = 0;
+    caret = 0;
+    preferredColumn = 0;
+
+    newline = "\n";
+    const char *lf = length > 0
+        ? static_cast<const char *>(std::memchr(data, '\n', static_cast<size_t>(std::min(length, newlineSampleBytes))))
+        : nullptr;
+    if (lf && lf > data && lf[-1] == '\r')
+        newline = "\r\n";
+
+    topLine = 0;
+    horizontalScrollBar()->setValue(0);
+    updateScrollRange();
+    viewport()->update();
+
+    indexer = QThread::create([this] { buildIndex(); });
+    indexer->start(QThread::LowPriority);
+    return true;
+}
+
+void LargeFileView::close() {
+    stopThreads();
+
+    // The tree points into the mapping, so it goes first.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tree.clear();
+        indexing = false;
+    }
+    if (data)
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    data = nullptr;
+    length = 0;
+    file.close();
+
+    history.clear();
+    caret = 0;
+    setModified(false);
+}
+
+void LargeFileView::stopThreads() {
+    stopSearch();
+    waitForSave();
+    if (indexer) {
+        stopRequested = true;
+        indexer->wait();
+        delete indexer;
+        indexer = nullptr;
+    }
+}
+
+qint64 LargeFileView::byteCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return indexing ? length : tree.length();
+}
+
+qint64 LargeFileView::lineCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.lineCount();
+}
+
+qint64 LargeFileView::indexedByteCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.length();
+}
+
+bool LargeFileView::isIndexing() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return indexing;
+}
+
+bool LargeFileView::isEditable() const {
+    return file.isOpen() && !isIndexing();
+}
+
+void LargeFileView::buildIndex() {
+    for (int64_t position = 0; position < length && !stopRequested;) {
+        const int64_t end = std::min(length, position + progressBytes);
+        while (position < end) {
+            const int64_t n = std::min(PieceTree::maxPieceBytes, end - position);
+            const auto feeds = static_cast<int64_t>(
+                textscan::countLineFeeds(data + position, static_cast<size_t>(n)));
+            std::lock_guard<std::mutex> lock(mutex);
+            tree.append(data + position, n, feeds);
+            position += n;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            indexing = position < length;
+        }
+        emit indexProgress(position, length);
+    }
+
+    if (length == 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            indexing = false;
+        }
+        emit indexProgress(0, 0);
+    }
+}
+
+void LargeFileView::handleIndexed() {
+    updateScrollRange();
+    viewport()->update();
+
+    if (pendingMatch >= 0 && (pendingMatch < indexedByteCount() || !isIndexing())) {
+        matchOffset = pendingMatch;
+        pendingMatch = -1;
+        showMatch();
+        emit findFinished(true);
+    }
+}
+
+int64_t LargeFileView::lineStart(int64_t line) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.lineStart(line);
+}
+
+int64_t LargeFileView::lineFromOffset(int64_t offset) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.lineFromOffset(offset);
+}
+
+std::string LargeFileView::text(int64_t offset, int64_t count) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.text(offset, count);
+}
+
+std::string LargeFileView::lineText(int64_t line) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t start = tree.lineStart(line);
+    const int64_t end = line + 1 < tree.lineCount() ? tree.lineStart(line + 1) - 1 : tree.length();
+    std::string bytes = tree.text(start, std::min(end - start, maxLineBytes));
+    if (end - start <= maxLineBytes && !bytes.empty() && bytes.back() == '\r')
+        bytes.pop_back();
+    return bytes;
+}
+
+QString LargeFileView::displayText(const char *bytes, int64_t count) {
+    const QString text = QString::fromUtf8(bytes, static_cast<qsizetype>(std::min(count, maxLineBytes)));
+    if (!text.contains('\t'))
+        return text;
+
+    QString expanded;
+    expanded.reserve(text.size() + 16);
+    for (const QChar c : text) {
+        if (c == '\t')
+            expanded.append(QString(tabWidth - expanded.size() % tabWidth, QChar(' ')));
+        else
+            expanded.append(c);
+    }
+    return expanded;
+}
+
+int64_t LargeFileView::offsetAtColumn(int64_t start, const std::string &bytes, int column) {
+    // Columns count UTF-16 units, as displayText() does.
+    int at = 0;
+    size_t i = 0;
+    while (i < bytes.size() && at < column) {
+        const auto c = static_cast<unsigned char>(bytes[i]);
+        const size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (c == '\t')
+            at += tabWidth - at % tabWidth;
+        else
+            at += n == 4 ? 2 : 1;
+        i = std::min(bytes.size(), i + n);
+    }
+    return start + static_cast<int64_t>(i);
+}
+
+void LargeFileView::updateScrollRange() {
+    pageRows = std::max(1, viewport()->height() / fontMetrics().height());
+    const int64_t maxTop = maxTopLine();
+    syncingScrollBar = true;
+    if (isScrollScaled()) {
+        verticalScrollBar()->setRange(0, static_cast<int>(scrollSteps));
+        verticalScrollBar()->setPageStep(static_cast<int>(std::max<int64_t>(1, pageRows * scrollSteps / maxTop)));
+    } else {
+        verticalScrollBar()->setRange(0, static_cast<int>(maxTop));
+        verticalScrollBar()->setPageStep(pageRows);
+    }
+    syncingScrollBar = false;
+    topLine = std::min(topLine, maxTop);
+    syncScrollBar();
+
+    const int columns = std::max(1, (viewport()->width() - gutterWidth()) / fontMetrics().horizontalAdvance('0'));
+    horizontalScrollBar()->setPageStep(columns);
+    horizontalScrollBar()->setRange(0, std::max(0, widestColumns - columns / 2));
+}
+
+int64_t LargeFileView::maxTopLine() const {
+    return std::max<int64_t>(0, lineCount() - pageRows);
+}
+
+bool LargeFileView::isScrollScaled() const {
+    return maxTopLine() > scrollSteps;
+}
+
+void LargeFileView::setTopLine(int64_t line) {
+    line = std::clamp<int64_t>(line, 0, maxTopLine());
+    if (line == topLine)
+        return;
+    topLine = line;
+    syncScrollBar();
+    viewport()->update();
+}
+
+void LargeFileView::syncScrollBar() {
+    const int64_t maxTop = maxTopLine();
+    const int64_t value = isScrollScaled() ? topLine * scrollSteps / maxTop : topLine;
+    syncingScrollBar = true;
+    verticalScrollBar()->setValue(static_cast<int>(value));
+    syncingScrollBar = false;
+}
+
+void LargeFileView::handleScrolled(int value) {
+    if (syncingScrollBar)
+        return;
+    // Scaled, the last step is the last line, so the end is in reach.
+    const int64_t maxTop = maxTopLine();
+    topLine = isScrollScaled() ? value * maxTop / scrollSteps : value;
+    viewport()->update();
+}
+
+void LargeFileView::wheelEvent(QWheelEvent *event) {
+    const int delta = event->angleDelta().y();
+    if (delta == 0) {
+        QAbstractScrollArea::wheelEvent(event);
+        return;
+    }
+    // By lines rather than scroll bar steps, which stand for many lines
+    // once the range is scaled.
+    wheelRemainder += delta;
+    const int notches = wheelRemainder / 120;
+    wheelRemainder -= notches * 120;
+    setTopLine(topLine - int64_t(notches) * QApplication::wheelScrollLines());
+    event->accept();
+}
+
+int LargeFileView::gutterWidth() const {
+    const int64_t last = std::max<int64_t>(lineCount(), topLine + pageRows);
+    const int digits = static_cast<int>(QString::number(last).size());
+    return (digits + 1) * fontMetrics().horizontalAdvance('0') + margin;
+}
+
+void LargeFileView::paintEvent(QPaintEvent *) {
+    QPainter painter(viewport());
+    const QFontMetrics metrics = fontMetrics();
+    const int lineHeight = metrics.height();
+    const int charWidth = metrics.horizontalAdvance('0');
+    const int rows = viewport()->height() / lineHeight + 1;
+    const int columns = viewport()->width() / charWidth + 1;
+    const int firstColumn = horizontalScrollBar()->value();
+    const int gutter = gutterWidth();
+
+    painter.fillRect(0, 0, gutter - margin, viewport()->height(), palette().alternateBase());
+
+    const int64_t top = topLine;
+    const int64_t lines = lineCount();
+    const int64_t caretLine = lineFromOffset(caret);
+    int widest = widestColumns;
+    int64_t offset = top < lines ? lineStart(top) : -1;
+    for (int row = 0; row < rows && offset >= 0; ++row) {
+        const int64_t line = top + row;
+        const int y = row * lineHeight;
+
+        // Most lines end within the probe; longer ones are read again, up
+        // to the cut.
+        std::string bytes = text(offset, probeBytes);
+        size_t lf = bytes.find('\n');
+        if (lf == std::string::npos && static_cast<int64_t>(bytes.size()) == probeBytes) {
+            bytes = text(offset, maxLineBytes + 1);
+            lf = bytes.find('\n');
+        }
+        int64_t next;
+        if (lf != std::string::npos) {
+            next = offset + static_cast<int64_t>(lf) + 1;
+            bytes.resize(lf);
+            if (!bytes.empty() && bytes.back() == '\r')
+                bytes.pop_back();
+        } else {
+            next = line + 1 < lines ? lineStart(line + 1) : -1;
+            bytes.resize(std::min<size_t>(bytes.size(), maxLineBytes));
+        }
+
+        const QString text = displayText(bytes.data(), static_cast<int64_t>(bytes.size()));
+        widest = std::max(widest, static_cast<int>(text.size()));
+
+        const auto lineBytes = static_cast<int64_t>(bytes.size());
+        if (matchOffset >= offset && matchOffset <= offset + lineBytes) {
+            const int from = static_cast<int>(displayText(bytes.data(), matchOffset - offset).size()) - firstColumn;
+            const int size = static_cast<int>(QString::fromUtf8(needle).size());
+            painter.fillRect(gutter + from * charWidth, y, size * charWidth, lineHeight,
+                             palette().highlight());
+        }
+
+        painter.setPen(palette().color(QPalette::PlaceholderText));
+        painter.drawText(0, y, gutter - margin - charWidth / 2, lineHeight,
+                         Qt::AlignRight | Qt::AlignVCenter, QString::number(line + 1));
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(gutter, y + metrics.ascent(), text.mid(firstColumn, columns));
+
+        if (line == caretLine && isEditable()) {
+            const int64_t inLine = std::min(caret - offset, lineBytes);
+            const int column = static_cast<int>(displayText(bytes.data(), inLine).size()) - firstColumn;
+            if (column >= 0)
+                painter.fillRect(gutter + column * charWidth, y, 2, lineHeight, palette().text());
+        }
+
+        offset = next;
+    }
+
+    // Lines scrolled into view may be wider than any seen before.
+    if (widest != widestColumns) {
+        widestColumns = widest;
+        QMetaObject::invokeMethod(this, [this] { updateScrollRange(); }, Qt::QueuedConnection);
+    }
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollRange();
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event) {
+    const bool control = event->modifiers() & Qt::ControlModifier;
+    const int64_t page = std::max(1, pageRows - 1);
+
+    switch (event->key()) {
+    case Qt::Key_Left:
+        moveCaret(previousPosition(caret));
+        return;
+    case Qt::Key_Right:
+        moveCaret(nextPosition(caret));
+        return;
+    case Qt::Key_Up:
+        moveCaretToLine(lineFromOffset(caret) - 1);
+        return;
+    case Qt::Key_Down:
+        moveCaretToLine(lineFromOffset(caret) + 1);
+        return;
+    case Qt::Key_PageUp:
+        moveCaretToLine(lineFromOffset(caret) - page);
+        return;
+    case Qt::Key_PageDown:
+        moveCaretToLine(lineFromOffset(caret) + page);
+        return;
+    case Qt::Key_Home:
+        moveCaret(control ? 0 : lineStart(lineFromOffset(caret)));
+        return;
+    case Qt::Key_End:
+        if (control) {
+            moveCaret(indexedByteCount());
+        } else {
+            const int64_t line = lineFromOffset(caret);
+            moveCaret(lineStart(line) + static_cast<int64_t>(lineText(line).size()));
+        }
+        return;
+    case Qt::Key_Backspace:
+        if (caret > 0) {
+            const int64_t previous = previousPosition(caret);
+            removeText(previous, caret - previous);
+        }
+        return;
+    case Qt::Key_Delete:
+        removeText(caret, nextPosition(caret) - caret);
+        return;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        insertText(newline);
+        return;
+    case Qt::Key_Tab:
+        insertText("\t");
+        return;
+    default:
+        break;
+    }
+
+    if (event->matches(QKeySequence::Undo)) {
+        undo();
+        return;
+    }
+
+    const QString typed = event->text();
+    if (!control && !typed.isEmpty() && typed.at(0).isPrint()) {
+        insertText(typed.toUtf8());
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event) {
+    setFocus();
+    const QPoint point = event->position().toPoint();
+    const int charWidth = fontMetrics().horizontalAdvance('0');
+    const int64_t line = std::min<int64_t>(lineCount() - 1,
+                                           topLine + point.y() / fontMetrics().height());
+    const int column = horizontalScrollBar()->value()
+                     + std::max(0, (point.x() - gutterWidth() + charWidth / 2) / charWidth);
+    moveCaret(offsetAtColumn(lineStart(line), lineText(line), column));
+}
+
+int64_t LargeFileView::previousPosition(int64_t offset) const {
+    if (offset <= 0)
+        return 0;
+    const std::string bytes = text(std::max<int64_t>(0, offset - 4), std::min<int64_t>(4, offset));
+    size_t i = bytes.size() - 1;
+    if (bytes[i] == '\n' && i > 0 && bytes[i - 1] == '\r')
+        return offset - 2;
+    while (i > 0 && (static_cast<unsigned char>(bytes[i]) & 0xC0) == 0x80)
+        --i;
+    return offset - static_cast<int64_t>(bytes.size() - i);
+}
+
+int64_t LargeFileView::nextPosition(int64_t offset) const {
+    const std::string bytes = text(offset, 4);
+    if (bytes.empty())
+        return offset;
+    if (bytes[0] == '\r' && bytes.size() > 1 && bytes[1] == '\n')
+        return offset + 2;
+    size_t n = 1;
+    while (n < bytes.size() && (static_cast<unsigned char>(bytes[n]) & 0xC0) == 0x80)
+        ++n;
+    return offset + static_cast<int64_t>(n);
+}
+
+int LargeFileView::caretColumn() const {
+    const int64_t start = lineStart(lineFromOffset(caret));
+    const std::string bytes = text(start, std::min(caret - start, maxLineBytes));
+    return static_cast<int>(displayText(bytes.data(), static_cast<int64_t>(bytes.size())).size());
+}
+
+void LargeFileView::moveCaret(int64_t offset, bool keepColumn) {
+    caret = std::clamp<int64_t>(offset, 0, indexedByteCount());
+    if (!keepColumn)
+        preferredColumn = caretColumn();
+    ensureCaretVisible();
+    viewport()->update();
+}
+
+void LargeFileView::moveCaretToLine(int64_t line) {
+    line = std::clamp<int64_t>(line, 0, lineCount() - 1);
+    moveCaret(offsetAtColumn(lineStart(line), lineText(line), preferredColumn), true);
+}
+
+void LargeFileView::ensureCaretVisible() {
+    const int64_t line = lineFromOffset(caret);
+    if (line < topLine)
+        setTopLine(line);
+    else if (line >= topLine + pageRows)
+        setTopLine(line - pageRows + 1);
+
+    const int column = caretColumn();
+    if (column >= widestColumns) {
+        widestColumns = column + 1;
+        updateScrollRange();
+    }
+    const int first = horizontalScrollBar()->value();
+    const int columns = horizontalScrollBar()->pageStep();
+    if (column < first)
+        horizontalScrollBar()->setValue(column);
+    else if (column >= first + columns - 1)
+        horizontalScrollBar()->setValue(column - columns + 2);
+}
+
+void LargeFileView::insertText(const QByteArray &bytes) {
+    if (!isEditable() || bytes.isEmpty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tree.insert(caret, bytes.constData(), bytes.size());
+    }
+
+    // A run of typing is undone as one.
+    Edit *last = history.empty() ? nullptr : &history.back();
+    if (last && last->removed.empty() && last->offset + last->inserted == caret)
+        last->inserted += bytes.size();
+    else
+        history.push_back({caret, bytes.size(), {}});
+
+    caret += bytes.size();
+    edited();
+}
+
+void LargeFileView::removeText(int64_t offset, int64_t count) {
+    if (!isEditable() || count <= 0)
+        return;
+    std::vector<PieceTree::Piece> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        removed = tree.remove(offset, count);
+    }
+    history.push_back({offset, 0, std::move(removed)});
+
+    caret = offset;
+    edited();
+}
+
+void LargeFileView::undo() {
+    if (!isEditable() || history.empty())
+        return;
+    const Edit edit = std::move(history.back());
+    history.pop_back();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (edit.inserted > 0)
+            tree.remove(edit.offset, edit.inserted);
+        tree.insertPieces(edit.offset, edit.removed);
+    }
+    int64_t restored = 0;
+    for (const PieceTree::Piece &piece : edit.removed)
+        restored += piece.length;
+
+    caret = edit.offset + restored;
+    edited();
+}
+
+void LargeFileView::edited() {
+    ++edits;
+    matchOffset = pendingMatch = -1;
+    setModified(true);
+    updateScrollRange();
+    moveCaret(caret);
+    emit textChanged();
+}
+
+void LargeFileView::setModified(bool on) {
+    if (modified == on)
+        return;
+    modified = on;
+    emit modificationChanged(on);
+}
+
+bool LargeFileView::save(const QString &fileName, const TextEncoding &encoding) {
+    if (saver || !isEditable())
+        return false;
+
+    // The pieces point into the mapping and the append buffer, which later
+    // edits leave alone, so the worker needs no copy of the text.
+    std::vector<TextSpan> spans;
+    int64_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const PieceTree::Span &span : tree.spans()) {
+            spans.push_back({span.data, span.length});
+            total += span.length;
+        }
+    }
+
+    saveFileName = fileName;
+    saveError.clear();
+    savedEdits = edits;
+    saver = QThread::create([this, spans = std::move(spans), fileName, encoding, total] {
+        saveSpans(fileName, encoding, spans,
+                  [this, total](int64_t written) { emit saveProgress(written, total); },
+                  &saveError);
+    });
+    // A finish that waitForSave() already handled must not be handled again.
+    connect(saver, &QThread::finished, this, [this, id = ++saveId] {
+        if (id == saveId && saver)
+            finishSave();
+    });
+    saver->start(QThread::LowPriority);
+    return true;
+}
+
+void LargeFileView::waitForSave() {
+    if (saver)
+        finishSave();
+}
+
+void LargeFileView::finishSave() {
+    saver->wait();
+    delete saver;
+    saver = nullptr;
+
+    if (!saveError.isEmpty()) {
+        emit saveFailed(saveFileName, saveError);
+        return;
+    }
+    // Edits made during the write are not in the file.
+    if (savedEdits == edits)
+        setModified(false);
+    emit saved(saveFileName);
+}
+
+void LargeFileView::find(const QByteArray &text) {
+    needle = text;
+    matchOffset = pendingMatch = -1;
+    viewport()->update();
+    startSearch(caret);
+}
+
+void LargeFileView::findNext() {
+    if (needle.isEmpty())
+        return;
+    startSearch(matchOffset >= 0 ? matchOffset + 1 : caret);
+}
+
+void LargeFileView::startSearch(int64_t from) {
+    stopSearch();
+    if (needle.isEmpty() || !file.isOpen())
+        return;
+
+    // Nothing is edited while indexing, so the mapping is the text and the
+    // search can run ahead of the index.
+    std::vector<PieceTree::Span> spans;
+    if (isIndexing()) {
+        for (int64_t position = 0; position < length; position += searchWindowBytes)
+            spans.push_back({data + position, std::min(searchWindowBytes, length - position)});
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        spans = tree.spans();
+    }
+
+    foundOffset = -1;
+    const int id = ++searchId;
+    searcher = QThread::create([this, spans = std::move(spans), n = needle, from] {
+        search(spans, n, from);
+    });
+    connect(searcher, &QThread::finished, this, [this, id] {
+        if (id == searchId && searcher)
+            handleFound();
+    });
+    searcher->start();
+}
+
+void LargeFileView::stopSearch() {
+    if (!searcher)
+        return;
+    searchCancelled = true;
+    searcher->wait();
+    delete searcher;
+    searcher = nullptr;
+    searchCancelled = false;
+    ++searchId;
+}
+
+void LargeFileView::search(const std::vector<PieceTree::Span> &spans, const QByteArray &text,
+                           int64_t from) {
+    const std::boyer_moore_horspool_searcher<const char *> searcher(text.constData(),
+                                                                    text.constData() + text.size());
+    const auto keep = static_cast<size_t>(text.size() - 1);
+    // The bytes before the current span that a match crossing into it can
+    // start in.
+    std::string tail;
+
+    int64_t start = 0;
+    for (const PieceTree::Span &span : spans) {
+        if (stopRequested || searchCancelled)
+            return;
+        const int64_t end = start + span.length;
+        if (end > from) {
+            const int64_t begin = std::max(from, start);
+            const char *first = span.data + (begin - start);
+            const char *last = span.data + span.length;
+
+            if (!tail.empty()) {
+                std::string seam = tail;
+                seam.append(first, std::min(keep, static_cast<size_t>(last - first)));
+                const char *found = std::search(seam.data(), seam.data() + seam.size(), searcher);
+                // Matches that start in this span are found below.
+                if (found - seam.data() < static_cast<std::ptrdiff_t>(tail.size())) {
+                    foundOffset = begin - static_cast<int64_t>(tail.size()) + (found - seam.data());
+                    return;
+                }
+            }
+
+            const char *found = std::search(first, last, searcher);
+            if (found != last) {
+                foundOffset = start + (found - span.data);
+                return;
+            }
+
+            if (static_cast<size_t>(last - first) >= keep) {
+                tail.assign(last - keep, keep);
+            } else {
+                tail.append(first, last);
+                tail.erase(0, tail.size() - std::min(tail.size(), keep));
+            }
+        }
+        start = end;
+    }
+}
+
+void LargeFileView::handleFound() {
+    searcher->wait();
+    delete searcher;
+    searcher = nullptr;
+
+    if (foundOffset < 0) {
+        emit findFinished(false);
+        return;
+    }
+    if (foundOffset >= indexedByteCount() && isIndexing()) {
+        // Shown once the index gets there.
+        pendingMatch = foundOffset;
+        return;
+    }
+    matchOffset = foundOffset;
+    showMatch();
+    emit findFinished(true);
+}
+
+void LargeFileView::showMatch() {
+    caret = matchOffset;
+    preferredColumn = caretColumn();
+
+    // Put the match a third of the way down rather than at the very edge.
+    const int64_t line = lineFromOffset(matchOffset);
+    setTopLine(line - pageRows / 3);
+    ensureCaretVisible();
+    viewport()->update();
+}
@@ -0,0 +1,195 @@
+#ifndef LARGEFILEVIEW_H
+#define LARGEFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QFile>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "encoding.h"
+#include "piecetree.h"
+
+class QThread;
+
+// Editor for a file too large to load into Scintilla, such as a
+// multi-gigabyte log. The file is memory-mapped rather than read, and its
+// text is a PieceTree over the mapping: edits go to the tree's append
+// buffer, so memory grows with the edits and not with the file. Only the
+// lines on screen are ever decoded.
+//
+// A worker thread adds the file to the tree a piece at a time, counting the
+// line feeds of each with the SIMD newline scan. Until it is done the view
+// is read-only, and the scroll range covers the lines added so far.
+//
+// Text is shown as UTF-8, tabs expanded, and lines are cut at 64 KB. There
+// is a caret and undo, but no selection or redo.
+//
+// The first line shown is a 64-bit line number. The vertical scroll bar
+// follows it one step per line while the lines fit its range, and scaled to
+// a fixed range past that, so the end of a file of billions of lines can be
+// scrolled to.
+class LargeFileView : public QAbstractScrollArea {
+    Q_OBJECT
+
+public:
+    explicit LargeFileView(QWidget *parent = nullptr);
+    ~LargeFileView() override;
+
+    // Maps fileName and starts indexing it. Returns false and sets error if
+    // the file cannot be opened or mapped.
+    bool open(const QString &fileName, QString *error);
+    // Waits for a running save, then drops the text and any edits.
+    void close();
+
+    QString fileName() const { return file.fileName(); }
+    qint64 byteCount() const;
+
+    // Lines indexed so far; all of them once isIndexing() is false.
+    qint64 lineCount() const;
+    qint64 indexedByteCount() const;
+    bool isIndexing() const;
+
+    bool isModified() const { return modified; }
+    bool isSaving() const { return saver != nullptr; }
+
+    // Writes the text to fileName on a worker thread, streaming the pieces
+    // through saveSpans(); saved() or saveFailed() reports the outcome.
+    // Returns false if a save is already running or indexing is not done.
+    bool save(const QString &fileName, const TextEncoding &encoding);
+    // Blocks until a running save has finished.
+    void waitForSave();
+
+    // Searches for text from the caret on, or past the last match with
+    // findNext(), on a worker thread. findFinished() reports the outcome;
+    // a match is scrolled to and highlighted.
+    void find(const QByteArray &text);
+    void findNext();
+
+signals:
+    void indexProgress(qint64 bytesIndexed, qint64 totalBytes);
+    void findFinished(bool found);
+    void textChanged();
+    void modificationChanged(bool modified);
+    void saveProgress(qint64 bytesWritten, qint64 totalBytes);
+    void saved(const QString &fileName);
+    void saveFailed(const QString &fileName, const QString &error);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private slots:
+    void handleIndexed();
+    void handleScrolled(int value);
+
+private:
+    // An edit as undo sees it: bytes inserted at offset, and the pieces of
+    // the bytes removed there.
+    struct Edit {
+        int64_t offset;
+        int64_t inserted;
+        std::vector<PieceTree::Piece> removed;
+    };
+
+    void buildIndex();
+    void search(const std::vector<PieceTree::Span> &spans, const QByteArray &text, int64_t from);
+    void startSearch(int64_t from);
+    void stopSearch();
+    void handleFound();
+    void finishSave();
+    void stopThreads();
+    void updateScrollRange();
+    // The last line that can be the first shown.
+    int64_t maxTopLine() const;
+    bool isScrollScaled() const;
+    void setTopLine(int64_t line);
+    // Moves the scroll bar to topLine.
+    void syncScrollBar();
+    void showMatch();
+    int gutterWidth() const;
+
+    bool isEditable() const;
+    void insertText(const QByteArray &text);
+    void removeText(int64_t offset, int64_t count);
+    void undo();
+    void setModified(bool on);
+    void edited();
+
+    void moveCaret(int64_t offset, bool keepColumn = false);
+    void moveCaretToLine(int64_t line);
+    void ensureCaretVisible();
+    int caretColumn() const;
+    // Offsets of the code point, or CR LF, before and after offset.
+    int64_t previousPosition(int64_t offset) const;
+    int64_t nextPosition(int64_t offset) const;
+
+    // Locked access to the tree, which the indexer appends to.
+    int64_t lineStart(int64_t line) const;
+    int64_t lineFromOffset(int64_t offset) const;
+    std::string text(int64_t offset, int64_t count) const;
+    // The bytes of line, without its line end, cut at 64 KB.
+    std::string lineText(int64_t line) const;
+    // Offset of the character shown in column of the line at start, or of
+    // the line end.
+    static int64_t offsetAtColumn(int64_t start, const std::string &bytes, int column);
+    static QString displayText(const char *bytes, int64_t count);
+
+    QFile file;
+    const char *data = nullptr;
+    int64_t length = 0;
+
+    // Shared with the indexer.
+    mutable std::mutex mutex;
+    PieceTree tree;
+    bool indexing = false;
+
+    QThread *indexer = nullptr;
+    QThread *searcher = nullptr;
+    QThread *saver = nullptr;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<bool> searchCancelled{false};
+    // Tell a finished search or save from one already handled.
+    int searchId = 0;
+    int saveId = 0;
+
+    QByteArray needle;
+    // Written by the searcher, read once it has finished.
+    int64_t foundOffset = -1;
+    // The match shown, and one still waiting for the index to reach it.
+    int64_t matchOffset = -1;
+    int64_t pendingMatch = -1;
+
+    // What Enter inserts: the line end of the file's first line.
+    QByteArray newline = "\n";
+    int64_t caret = 0;
+    // The column up and down keep to across shorter lines.
+    int preferredColumn = 0;
+    std::vector<Edit> history;
+    bool modified = false;
+
+    // Counts edits, to tell whether the text still matches a save.
+    quint64 edits = 0;
+    quint64 savedEdits = 0;
+    QString saveFileName;
+    QString saveError;
+
+    int widestColumns = 0;
+
+    // The first line shown, and how many fit.
+    int64_t topLine = 0;
+    int pageRows = 1;
+    // Set while syncScrollBar() moves the scroll bar.
+    bool syncingScrollBar = false;
+    // Wheel movement short of a line, from high-resolution wheels.
+    int wheelRemainder = 0;
+};
+
+#endif // LARGEFILEVIEW_H
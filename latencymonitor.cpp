@@ -0,0 +1,204 @@
+#include "latencymonitor.h"
+
+#include <QDateTime>
+#include <QEvent>
+#include <QFile>
+#include <QTextStream>
+
+#include <Qsci/qsciscintilla.h>
+
+#include <algorithm>
+
+#include "documentstats.h"
+
+namespace {
+
+constexpr size_t maxSamples = 10000;
+
+// Keys still waiting for a paint after this long belong to a hidden window
+// or a stalled one; they are dropped rather than reported.
+constexpr qint64 staleNs = 10'000'000'000;
+
+} // namespace
+
+LatencyMonitor::LatencyMonitor(QsciScintilla *editor, QObject *parent) : QObject(parent) {
+    clock.start();
+    watchView(editor);
+}
+
+void LatencyMonitor::watchView(QsciScintilla *view) {
+    view->installEventFilter(this);
+    view->viewport()->installEventFilter(this);
+
+    connect(view, &QsciScintillaBase::SCN_MODIFIED, this, [this] { handleModified(); });
+    connect(view, &QsciScintillaBase::SCN_PAINTED, this, [this] { handlePainted(); });
+}
+
+void LatencyMonitor::watchStats(DocumentStats *stats) {
+    connect(stats, &DocumentStats::changed, this, [this] { handleStatsChanged(); });
+}
+
+void LatencyMonitor::setEnabled(bool enable) {
+    enabled = enable;
+    open.clear();
+}
+
+void LatencyMonitor::clear() {
+    samples.clear();
+    nextSample = 0;
+}
+
+bool LatencyMonitor::eventFilter(QObject *watched, QEvent *event) {
+    if (!enabled)
+        return false;
+
+    if (qobject_cast<QsciScintilla *>(watched)) {
+        if (event->type() == QEvent::KeyPress || event->type() == QEvent::InputMethod) {
+            Keystroke key;
+            key.keyAt = clock.nsecsElapsed();
+            open.push_back(key);
+        }
+    } else if (event->type() == QEvent::Paint && !open.empty()) {
+        // The viewport; its view is the one about to paint.
+        paintStartAt = clock.nsecsElapsed();
+        styleVisibleLines(static_cast<QsciScintilla *>(watched->parent()));
+        styledAt = clock.nsecsElapsed();
+    }
+    return false;
+}
+
+void LatencyMonitor::handleModified() {
+    if (!open.empty() && open.back().modifiedAt < 0)
+        open.back().modifiedAt = clock.nsecsElapsed();
+}
+
+void LatencyMonitor::handleStatsChanged() {
+    // Later signals come from worker results, not from this keystroke.
+    if (!open.empty() && open.back().modifiedAt >= 0 && open.back().statsAt < 0)
+        open.back().statsAt = clock.nsecsElapsed();
+}
+
+void LatencyMonitor::styleVisibleLines(QsciScintilla *view) {
+    // Scintilla would lex these lines at the start of the paint anyway;
+    // doing it first only moves the work to where it can be timed.
+    const long firstVisible = view->SendScintilla(QsciScintillaBase::SCI_GETFIRSTVISIBLELINE);
+    const long onScreen = view->SendScintilla(QsciScintillaBase::SCI_LINESONSCREEN);
+    const long lastLine = view->SendScintilla(QsciScintillaBase::SCI_DOCLINEFROMVISIBLE,
+                                              static_cast<unsigned long>(firstVisible + onScreen + 1));
+    const long end = view->SendScintilla(QsciScintillaBase::SCI_GETLINEENDPOSITION,
+                                         static_cast<unsigned long>(lastLine));
+    const long start = view->SendScintilla(QsciScintillaBase::SCI_GETENDSTYLED);
+    if (start < end)
+        view->SendScintilla(QsciScintillaBase::SCI_COLOURISE, static_cast<unsigned long>(start), end);
+}
+
+void LatencyMonitor::handlePainted() {
+    if (open.empty() || paintStartAt < 0)
+        return;
+
+    const qint64 paintedAt = clock.nsecsElapsed();
+    for (const Keystroke &key : open) {
+        if (key.modifiedAt < 0 || paintedAt - key.keyAt > staleNs)
+            continue;
+
+        const qint64 handledAt = std::max(key.modifiedAt, key.statsAt);
+        Sample sample;
+        sample.stage[Edit] = key.modifiedAt - key.keyAt;
+        sample.stage[Statistics] = key.statsAt >= 0 ? key.statsAt - key.modifiedAt : 0;
+        sample.stage[Wait] = std::max<qint64>(0, paintStartAt - handledAt);
+        sample.stage[Styling] = styledAt - paintStartAt;
+        sample.stage[Paint] = paintedAt - styledAt;
+        sample.stage[Total] = paintedAt - key.keyAt;
+        addSample(sample);
+    }
+
+    open.clear();
+    paintStartAt = styledAt = -1;
+}
+
+void LatencyMonitor::addSample(const Sample &sample) {
+    if (samples.size() < maxSamples) {
+        samples.push_back(sample);
+    } else {
+        samples[nextSample] = sample;
+        nextSample = (nextSample + 1) % maxSamples;
+    }
+}
+
+LatencyMonitor::Summary LatencyMonitor::summary(Stage stage) const {
+    Summary result;
+    if (samples.empty())
+        return result;
+
+    std::vector<qint64> values;
+    values.reserve(samples.size());
+    for (const Sample &sample : samples)
+        values.push_back(sample.stage[stage]);
+    std::sort(values.begin(), values.end());
+
+    // Nearest-rank percentiles.
+    auto percentile = [&values](int p) {
+        const size_t rank = (values.size() * static_cast<size_t>(p) + 99) / 100;
+        return values[std::max<size_t>(rank, 1) - 1];
+    };
+    result.p50 = percentile(50);
+    result.p95 = percentile(95);
+    result.p99 = percentile(99);
+    result.max = values.back();
+    return result;
+}
+
+QString LatencyMonitor::stageName(Stage stage) {
+    switch (stage) {
+    case Edit: return "Edit";
+    case Statistics: return "Statistics";
+    case Wait: return "Wait";
+    case Styling: return "Styling";
+    case Paint: return "Paint";
+    case Total: return "Total";
+    case StageCount: break;
+    }
+    return QString();
+}
+
+bool LatencyMonitor::writeReport(const QString &fileName, QString *error) const {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 3); };
+
+    QTextStream out(&file);
+    out << "# codeit keystroke-to-paint latency, "
+        << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n";
+    out << "# " << samples.size() << " samples, times in ms\n";
+    out << "stage,p50,p95,p99,max\n";
+    for (int s = 0; s < StageCount; ++s) {
+        const Summary sum = summary(static_cast<Stage>(s));
+        out << stageName(static_cast<Stage>(s)) << ',' << ms(sum.p50) << ',' << ms(sum.p95)
+            << ',' << ms(sum.p99) << ',' << ms(sum.max) << "\n";
+    }
+
+    out << "\n";
+    for (int s = 0; s < StageCount; ++s)
+        out << (s ? "," : "") << stageName(static_cast<Stage>(s)).toLower();
+    out << "\n";
+    // Oldest first.
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const Sample &sample = samples[(nextSample + i) % samples.size()];
+        for (int s = 0; s < StageCount; ++s)
+            out << (s ? "," : "") << ms(sample.stage[s]);
+        out << "\n";
+    }
+
+    out.flush();
+    if (file.error() != QFileDevice::NoError) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
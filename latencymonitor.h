@@ -0,0 +1,94 @@
+#ifndef LATENCYMONITOR_H
+#define LATENCYMONITOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+
+#include <vector>
+
+class DocumentStats;
+class QsciScintilla;
+
+// Times keystrokes from the moment the key event reaches the editor to the
+// end of the first paint after it, split into stages:
+//
+//   Edit        key event to SCN_MODIFIED (Scintilla's own work)
+//   Statistics  SCN_MODIFIED to DocumentStats::changed
+//   Wait        rest of the key handling plus the event loop, up to the paint
+//   Styling     lexing the visible lines, forced with SCI_COLOURISE before
+//               the paint so it is not hidden inside it
+//   Paint       the paint itself, up to SCN_PAINTED
+//
+// Only keystrokes that modify the document become samples. Keys typed
+// faster than the screen repaints share one paint.
+class LatencyMonitor : public QObject {
+    Q_OBJECT
+
+public:
+    enum Stage { Edit, Statistics, Wait, Styling, Paint, Total, StageCount };
+
+    // Durations in nanoseconds.
+    struct Sample {
+        qint64 stage[StageCount] = {};
+    };
+
+    struct Summary {
+        qint64 p50 = 0;
+        qint64 p95 = 0;
+        qint64 p99 = 0;
+        qint64 max = 0;
+    };
+
+    // Create it before anything else that handles the editor's SCN_MODIFIED,
+    // so that its own handler runs first.
+    explicit LatencyMonitor(QsciScintilla *editor, QObject *parent = nullptr);
+
+    // Attributes the time up to stats' changed() signal to statistics.
+    void watchStats(DocumentStats *stats);
+    // Times keystrokes typed into view as well, another view of the
+    // editor's documents such as the second pane of a split.
+    void watchView(QsciScintilla *view);
+
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool enable);
+
+    void clear();
+    size_t sampleCount() const { return samples.size(); }
+    Summary summary(Stage stage) const;
+
+    static QString stageName(Stage stage);
+
+    // Writes the summary and every sample as CSV. Returns false and sets
+    // error if the file cannot be written.
+    bool writeReport(const QString &fileName, QString *error) const;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    struct Keystroke {
+        qint64 keyAt = 0;
+        qint64 modifiedAt = -1;
+        qint64 statsAt = -1;
+    };
+
+    void handleModified();
+    void handleStatsChanged();
+    void handlePainted();
+    void styleVisibleLines(QsciScintilla *view);
+    void addSample(const Sample &sample);
+
+    QElapsedTimer clock;
+    bool enabled = false;
+
+    std::vector<Keystroke> open;
+    qint64 paintStartAt = -1;
+    qint64 styledAt = -1;
+
+    // The latest samples, oldest overwritten first.
+    std::vector<Sample> samples;
+    size_t nextSample = 0;
+};
+
+#endif // LATENCYMONITOR_H
@@ -0,0 +1,94 @@
+#include "latencypanel.h"
+
+#include <QAction>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+#include "latencymonitor.h"
+
+LatencyPanel::LatencyPanel(LatencyMonitor *monitor, QWidget *parent)
+    : QDockWidget("Keystroke Latency", parent), monitor(monitor) {
+    setObjectName("latencyPanel");
+
+    table = new QTableWidget(LatencyMonitor::StageCount, 4);
+    table->setHorizontalHeaderLabels({"p50 (ms)", "p95 (ms)", "p99 (ms)", "max (ms)"});
+    QStringList stages;
+    for (int s = 0; s < LatencyMonitor::StageCount; ++s)
+        stages << LatencyMonitor::stageName(static_cast<LatencyMonitor::Stage>(s));
+    table->setVerticalHeaderLabels(stages);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    for (int row = 0; row < table->rowCount(); ++row) {
+        for (int column = 0; column < table->columnCount(); ++column) {
+            auto *item = new QTableWidgetItem;
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table->setItem(row, column, item);
+        }
+    }
+
+    countLabel = new QLabel;
+
+    auto *resetButton = new QPushButton("Reset");
+    connect(resetButton, &QPushButton::clicked, this, [this] {
+        this->monitor->clear();
+        refresh();
+    });
+
+    auto *saveButton = new QPushButton("Save Report...");
+    connect(saveButton, &QPushButton::clicked, this, &LatencyPanel::saveReport);
+
+    auto *buttons = new QHBoxLayout;
+    buttons->addWidget(countLabel, 1);
+    buttons->addWidget(resetButton);
+    buttons->addWidget(saveButton);
+
+    auto *contents = new QWidget;
+    auto *layout = new QVBoxLayout(contents);
+    layout->addWidget(table);
+    layout->addLayout(buttons);
+    setWidget(contents);
+
+    refreshTimer.setInterval(500);
+    connect(&refreshTimer, &QTimer::timeout, this, &LatencyPanel::refresh);
+
+    // Record only while the panel is open.
+    connect(toggleViewAction(), &QAction::toggled, this, [this](bool shown) {
+        this->monitor->setEnabled(shown);
+        if (shown) {
+            refresh();
+            refreshTimer.start();
+        } else {
+            refreshTimer.stop();
+        }
+    });
+
+    refresh();
+}
+
+void LatencyPanel::refresh() {
+    for (int s = 0; s < LatencyMonitor::StageCount; ++s) {
+        const LatencyMonitor::Summary sum = monitor->summary(static_cast<LatencyMonitor::Stage>(s));
+        const qint64 values[] = {sum.p50, sum.p95, sum.p99, sum.max};
+        for (int column = 0; column < 4; ++column)
+            table->item(s, column)->setText(QString::number(values[column] / 1e6, 'f', 2));
+    }
+    countLabel->setText(QString("%1 keystrokes").arg(monitor->sampleCount()));
+}
+
+void LatencyPanel::saveReport() {
+    const QString fileName = QFileDialog::getSaveFileName(this, "Save Latency Report",
+                                                          "codeit-latency.csv",
+                                                          "CSV Files (*.csv);;All Files (*)");
+    if (fileName.isEmpty())
+        return;
+
+    QString error;
+    if (!monitor->writeReport(fileName, &error))
+        QMessageBox::warning(this, "Save Failed", "Cannot save file: " + error);
+}
@@ -0,0 +1,30 @@
+#ifndef LATENCYPANEL_H
+#define LATENCYPANEL_H
+
+#include <QDockWidget>
+#include <QTimer>
+
+class LatencyMonitor;
+class QLabel;
+class QTableWidget;
+
+// Debug panel with the percentiles of a LatencyMonitor. The monitor only
+// records while the panel is shown.
+class LatencyPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    explicit LatencyPanel(LatencyMonitor *monitor, QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+    void saveReport();
+
+private:
+    LatencyMonitor *monitor;
+    QTableWidget *table;
+    QLabel *countLabel;
+    QTimer refreshTimer;
+};
+
+#endif // LATENCYPANEL_H
@@ -7,89 +7,566 @@
 #include <QMenu>
 #include <QAction>
 #include <QFileDialog>
-#include <QFile>
+#include <QFileInfo>
+#include <QDir>
 #include <QMessageBox>
 #include <QKeySequence>
+#include <QInputDialog>
+#include <QLabel>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QSplitter>
+#include <QStackedWidget>
+#include <QTabBar>
+#include <QVBoxLayout>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QCloseEvent>
+#include <QThreadPool>
 
+#include <Qsci/qsciscintilla.h>
+#include <Qsci/qscilexercpp.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <memory>
 #include <string>
+#include <vector>
 
-#include <Qsci/qsciscintilla.h>
-#include <Qsci/qscilexercpp.h>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "documentstats.h"
+#include "filefollower.h"
+#include "fileloader.h"
+#include "filesaver.h"
+#include "filewatcher.h"
+#include "journal.h"
+#include "largefileview.h"
+#include "latencymonitor.h"
+#include "latencypanel.h"
+#include "memorybudget.h"
+#include "memorypanel.h"
+#include "projectpanel.h"
+#include "session.h"
+#include "singleinstance.h"
+#include "textstats.h"
 
-#include <unicode/brkiter.h>
-#include <unicode/unistr.h>
-#include <unicode/uchar.h>
-#include <unicode/ubrk.h>
+// A file codeit [--reuse] [[+LINE[:COLUMN]] FILE | FOLDER]... asks for.
+struct FileRequest {
+    QString fileName;
+    int line = 0;
+    int column = 0;
+};
+
+// A +LINE[:COLUMN] applies to the file after it.
+std::vector<FileRequest> parseArguments(const QStringList &arguments) {
+    std::vector<FileRequest> requests;
+    FileRequest next;
+    for (const QString &arg : arguments) {
+        if (arg == "--reuse")
+            continue;
+        if (arg.startsWith("+")) {
+            const QStringList parts = arg.mid(1).split(QChar(':'));
+            next.line = parts.at(0).toInt();
+            next.column = parts.size() > 1 ? parts.at(1).toInt() : 0;
+        } else {
+            next.fileName = arg;
+            requests.push_back(next);
+            next = FileRequest();
+        }
+    }
+    return requests;
+}
 
 class CodeEditor : public QMainWindow {
     Q_OBJECT
 
 public:
-    CodeEditor() {
+    // startupClock runs from the start of main(), for the startup report.
+    explicit CodeEditor(const QElapsedTimer &startupClock) : startupClock(startupClock) {
         editor = new QsciScintilla(this);
+        focused = editor;
+        // QsciScintilla keeps referring to the document it created, so keep
+        // that alive while the open documents take its place.
+        originalDocument = reinterpret_cast<void *>(
+            editor->SendScintilla(QsciScintillaBase::SCI_GETDOCPOINTER));
+        editor->SendScintilla(QsciScintillaBase::SCI_ADDREFDOCUMENT, 0, originalDocument);
+        // Before DocumentStats, so it sees each SCN_MODIFIED first.
+        latency = new LatencyMonitor(editor, this);
+        stats = new DocumentStats(editor, this);
+        latency->watchStats(stats);
+        loader = new FileLoader(editor, this);
+        saver = new FileSaver(editor, this);
+        watcher = new FileWatcher(editor, this);
+        follower = new FileFollower(editor, this);
+
+        latencyPanel = new LatencyPanel(latency, this);
+        addDockWidget(Qt::BottomDockWidgetArea, latencyPanel);
+        latencyPanel->hide();
+        latencyPanel->toggleViewAction()->setChecked(false);
+
+        memoryPolicy = MemoryPolicy::fromEnvironment();
+        budget = new MemoryBudget(this);
+        memoryPanel = new MemoryPanel(this);
+        memoryPanel->setBudget(memoryPolicy.budget);
+        addDockWidget(Qt::BottomDockWidgetArea, memoryPanel);
+        memoryPanel->hide();
+        memoryPanel->toggleViewAction()->setChecked(false);
 
+        // Lists nothing, and starts no thread, until a folder is opened.
+        projectPanel = new ProjectPanel(this);
+        addDockWidget(Qt::LeftDockWidgetArea, projectPanel);
+        projectPanel->hide();
+        projectPanel->toggleViewAction()->setChecked(false);
+
+        // The lexer, the font and the menu entries wait for the first frame;
+        // see finishStartup().
         setupEditor();
-        setupLexer();
         setupStatusBar();
-        setupMenuBar();
+        fileMenu = menuBar()->addMenu("&File");
+        searchMenu = menuBar()->addMenu("&Search");
+        viewMenu = menuBar()->addMenu("&View");
+        toolsMenu = menuBar()->addMenu("&Tools");
 
-        setCentralWidget(editor);
+        tabs = new QTabBar(this);
+        tabs->setDocumentMode(true);
+        tabs->setExpanding(false);
+        tabs->setMovable(true);
+        tabs->setTabsClosable(true);
+        // The split view's second pane joins the editor when asked for.
+        splitter = new QSplitter(this);
+        splitter->setChildrenCollapsible(false);
+        splitter->addWidget(editor);
+        views = new QStackedWidget(this);
+        views->addWidget(splitter);
+        auto *central = new QWidget(this);
+        auto *layout = new QVBoxLayout(central);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->setSpacing(0);
+        layout->addWidget(tabs);
+        layout->addWidget(views);
+        setCentralWidget(central);
         setWindowTitle("Qt6 + QScintilla + ICU Code Editor");
         resize(900, 600);
 
-        connect(editor, &QsciScintilla::textChanged,
+        showDocument(addDocument(QString()));
+        connect(tabs, &QTabBar::currentChanged, this, &CodeEditor::handleTabChanged);
+        connect(tabs, &QTabBar::tabCloseRequested, this, &CodeEditor::closeTab);
+        connect(tabs, &QTabBar::tabMoved, this, &CodeEditor::handleTabMoved);
+
+        connect(stats, &DocumentStats::changed,
+                this, &CodeEditor::updateStats);
+        connect(editor, &QsciScintilla::selectionChanged,
                 this, &CodeEditor::updateStats);
+        connect(editor, &QsciScintilla::modificationChanged, this, [this] {
+            if (!isViewing())
+                updateTab(current);
+        });
+        // Scintilla keeps the text of each edit it can undo.
+        connect(editor, &QsciScintillaBase::SCN_MODIFIED, this,
+                [this](int, int modificationType, const char *, int length) {
+                    if ((modificationType & (QsciScintillaBase::SC_MOD_INSERTTEXT | QsciScintillaBase::SC_MOD_DELETETEXT))
+                        && (modificationType & QsciScintillaBase::SC_PERFORMED_USER)
+                        && editor->SendScintilla(QsciScintillaBase::SCI_GETUNDOCOLLECTION))
+                        current->undoBytes += length;
+                });
+
+        // Eviction waits for documents to have been in the background a
+        // while, so it looks again now and then.
+        memoryTimer.setInterval(2000);
+        connect(&memoryTimer, &QTimer::timeout, this, [this] {
+            enforceMemoryBudget();
+            if (memoryPanel->isVisible())
+                refreshMemoryPanel();
+        });
+        memoryTimer.start();
+        connect(memoryPanel->toggleViewAction(), &QAction::toggled, this, [this](bool shown) {
+            if (shown)
+                refreshMemoryPanel();
+        });
+        connect(memoryPanel, &MemoryPanel::budgetChanged, this, [this](qint64 bytes) {
+            memoryPolicy.budget = bytes;
+            enforceMemoryBudget();
+            refreshMemoryPanel();
+        });
+
+        connect(projectPanel, &ProjectPanel::fileActivated, this, &CodeEditor::openPath);
+
+        connect(loader, &FileLoader::progress, this, &CodeEditor::showLoadProgress);
+        connect(loader, &FileLoader::loaded, this, &CodeEditor::handleLoaded);
+        connect(loader, &FileLoader::failed, this, &CodeEditor::handleLoadFailed);
+        connect(loader, &FileLoader::cancelled, this, &CodeEditor::handleLoadCancelled);
+
+        connect(saver, &FileSaver::progress, this, &CodeEditor::showSaveProgress);
+        connect(saver, &FileSaver::saved, this, &CodeEditor::handleSaved);
+        connect(saver, &FileSaver::failed, this, &CodeEditor::handleSaveFailed);
+        connect(saver, &FileSaver::documentSaved, this, &CodeEditor::handleDocumentSaved);
+
+        connect(watcher, &FileWatcher::changedOnDisk, this, &CodeEditor::handleChangedOnDisk);
+        connect(watcher, &FileWatcher::removedFromDisk, this, &CodeEditor::handleRemovedFromDisk);
+        connect(watcher, &FileWatcher::reloaded, this, &CodeEditor::handleReloaded);
+        connect(watcher, &FileWatcher::failed, this, &CodeEditor::handleReloadFailed);
+
+        connect(follower, &FileFollower::truncated, this, &CodeEditor::handleFollowTruncated);
+        connect(follower, &FileFollower::failed, this, &CodeEditor::handleFollowFailed);
+
+        editor->installEventFilter(this);
+        editor->viewport()->installEventFilter(this);
+        windowMsecs = startupClock.elapsed();
+    }
+
+    // Opens the files given on the command line, each in a tab of its own,
+    // at their line and column (1-based; 0 leaves the caret at the start).
+    // A file that does not exist yet becomes a new document saved under
+    // that name, as $EDITOR needs.
+    void openFromCommandLine(const std::vector<FileRequest> &files);
+
+    ~CodeEditor() override {
+        // These talk to the editor, which is destroyed first otherwise. The
+        // saver finishes queued saves before it goes.
+        delete loader;
+        delete saver;
+        delete watcher;
+        delete follower;
+        editor->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, originalDocument);
+        if (pane) {
+            pane->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, paneDocument);
+            pane->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, paneDocument);
+        }
+        for (const auto &document : documents) {
+            delete document->journal;
+            if (document->pointer)
+                editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+        }
+        editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, originalDocument);
     }
 
+public slots:
+    // Opens what another invocation of codeit, run in workingDirectory,
+    // handed over.
+    void openFromInstance(const QString &workingDirectory, const QStringList &arguments);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void closeEvent(QCloseEvent *event) override;
+
 private:
+    // Where a view was in a document when another document took its place.
+    struct ViewState {
+        long anchor = 0;
+        long caret = 0;
+        long firstLine = 0;
+        long xOffset = 0;
+        // Scintilla forgets a view's folds when its document is swapped.
+        std::vector<long> folds;
+    };
+
+    // An open file or untitled document, shown in a tab. Each has a Scintilla
+    // document of its own, which the one editor swaps in when its tab is
+    // chosen. The lexer, the styles and the fonts belong to the editor, so a
+    // document costs little more than its text, and a switch costs no
+    // restyling.
+    struct Document {
+        // Holds a reference of its own, so it outlives its turns in the
+        // editor. Null in large file mode.
+        void *pointer = nullptr;
+        QString fileName;
+        // Numbers untitled documents, for their tabs and their journals.
+        int untitled = 0;
+        // What the file is saved as; the editor itself always holds UTF-8.
+        TextEncoding encoding;
+        Journal *journal = nullptr;
+        // The file as the document last matched it, while another document
+        // is shown and the watcher watches that.
+        FileWatcher::State watched;
+        LargeFileView *viewer = nullptr;
+        // Set while the file loads, or waits to load, into a new document
+        // that replaces pointer.
+        bool loading = false;
+        // Set once eviction has let go of the text, which loads from the file
+        // again when the tab is next chosen; loading is set meanwhile.
+        bool unloaded = false;
+        // Set while pointer is a copy without style bytes.
+        bool stripped = false;
+        // Set once the file has loaded, until the editor first shows it;
+        // recovery, the journal and the caret wait for that.
+        bool fresh = false;
+        // Where the caret goes then (1-based; 0 leaves it at the start).
+        int gotoLine = 0;
+        int gotoColumn = 0;
+        // Whether the document has the editor's per-document settings, and
+        // the lexer that styled it.
+        bool configured = false;
+        QsciLexer *lexer = nullptr;
+        // How the editor left the document when another took its place.
+        bool modified = false;
+        // Saved since, so to be marked unmodified once shown again.
+        bool savedAway = false;
+        // When that was, on startupClock.
+        qint64 leftAt = 0;
+        // What the text takes then; the undo history is counted here, from
+        // the edits made since Scintilla last dropped it.
+        DocumentMemory memory;
+        qint64 undoBytes = 0;
+        ViewState view;
+        // Where the split view's second pane was.
+        ViewState split;
+    };
+
+    // Files above this size open in the large file view instead.
+    static constexpr qint64 viewerThreshold = qint64(256) << 20;
+
+    QTabBar *tabs;
+    QStackedWidget *views;
+    QSplitter *splitter;
     QsciScintilla *editor;
-    QString currentFile;
+    void *originalDocument;
+    // The second pane of the split view, made the first time the view is
+    // split. It shows the editor's document and keeps its own caret and
+    // scroll position; the document, its styling and the statistics are
+    // shared. While unsplit it holds the document it was made with.
+    QsciScintilla *pane = nullptr;
+    void *paneDocument = nullptr;
+    // The view with the focus, or which last had it: the editor or the pane.
+    QsciScintilla *focused;
+    // The view the last search ran in, which Find Next carries on in.
+    QsciScintilla *searched = nullptr;
+    DocumentStats *stats;
+    LatencyMonitor *latency;
+    LatencyPanel *latencyPanel;
+    MemoryPolicy memoryPolicy;
+    MemoryBudget *budget;
+    MemoryPanel *memoryPanel;
+    QTimer memoryTimer;
+    ProjectPanel *projectPanel;
+    FileLoader *loader;
+    FileSaver *saver;
+    FileWatcher *watcher;
+    FileFollower *follower;
+    QLabel *statsLabel;
+    QLabel *encodingLabel;
+    QProgressBar *loadProgress;
+    QProgressBar *saveProgress;
+    QToolButton *cancelLoadButton;
+    // In the order of their tabs.
+    std::vector<std::unique_ptr<Document>> documents;
+    Document *current = nullptr;
+    // The document the loader loads, if any.
+    Document *loading = nullptr;
+    QString findText;
+    QMenu *fileMenu;
+    QMenu *searchMenu;
+    QMenu *viewMenu;
+    QMenu *toolsMenu;
+    QAction *followAct = nullptr;
+
+    QElapsedTimer startupClock;
+    qint64 windowMsecs = 0;
+    bool firstPaint = true;
+    bool startupFile = false;
+    // Set while the user is asked about a change on disk.
+    bool askingToReload = false;
+
+    bool isViewing() const { return current && current->viewer; }
+    bool isSplit() const { return pane && !pane->isHidden(); }
+    // Where the user works in the document: the focused pane.
+    QsciScintilla *activeView() const { return isSplit() ? focused : editor; }
+    static ViewState viewState(QsciScintilla *view);
+    static void restoreView(QsciScintilla *view, const ViewState &state);
+    bool isDocumentModified(const Document *document) const;
+    bool isSaving() const;
+    // Whether document is an empty untitled document nobody has typed into
+    // yet, which a file opened next takes the place of.
+    bool isBlank(const Document *document) const;
+    Document *documentFor(const QString &fileName) const;
+    int indexOf(const Document *document) const;
+    // Adds a tab for a new, empty document, or for a file in the large file
+    // view. The tab does not become current.
+    Document *addDocument(const QString &fileName, LargeFileView *view = nullptr);
+    // Makes document the one the editor shows.
+    void showDocument(Document *document);
+    // Puts the current document aside for another to take the editor.
+    void leaveDocument();
+    void attachDocument(Document *document);
+    // Recovery, the journal and the caret of a file just loaded, once shown.
+    void finishOpening(Document *document);
+    // Asks about unsaved changes, then closes document. Returns false if the
+    // user keeps it open.
+    bool closeDocument(Document *document);
+    void removeDocument(Document *document);
+    void setFileName(Document *document, const QString &fileName);
+    // The file name, or the number of an untitled document.
+    QString titleOf(const Document *document) const;
+    void updateTab(Document *document);
+    Document *openInViewer(const QString &fileName);
+    // A large file view of fileName, or null if it cannot be opened.
+    LargeFileView *createViewer(const QString &fileName);
+    void endLoading();
+    void setEncoding(const TextEncoding &fileEncoding);
+    // Stops following without picking up the rest of the file, for a
+    // document about to be replaced.
+    void endFollowing();
+    // Opens fileName in a tab, or shows the tab that has it open already.
+    // Returns null if it cannot be opened.
+    Document *openPath(const QString &fileName);
+    // Opens fileName with the caret at line and column, or starts a new
+    // document under that name if the file does not exist.
+    void openAt(const QString &fileName, int line, int column);
+    // Opens files in tabs of their own and shows the first. Only that one
+    // loads now; the others load when first chosen.
+    void openFiles(const std::vector<FileRequest> &files);
+    // Adds a tab for fileName that loads the file when first shown.
+    Document *addUnloadedDocument(const QString &fileName);
+    // Shows the folder at path in the project panel.
+    void showFolder(const QString &path);
+    void gotoPosition(int line, int column);
+    // Work the first frame does not need, done right after it.
+    void finishStartup();
+    // Offers to replay the journal an earlier session left for document,
+    // whose text the editor holds.
+    void offerRecovery(Document *document);
+    // Tabs for the files the last session had open, which load when first
+    // chosen; only the one that was current loads now.
+    void restoreSession();
+    void saveSession();
+    // Loads the file of a document eviction unloaded.
+    void reloadDocument(Document *document);
+
+    DocumentMemory memoryOf(const Document *document) const;
+    QString memoryStateOf(const Document *document) const;
+    // Evicts documents in the background, the least recently used first,
+    // until the open documents fit memoryPolicy.budget again or nothing
+    // more is due.
+    void enforceMemoryBudget();
+    void dropStyles(Document *document);
+    void unloadDocument(Document *document);
+    void refreshMemoryPanel();
 
 private slots:
     void updateStats();
 
+    void handleTabChanged(int index);
+    void handleTabMoved(int from, int to);
+    void closeTab(int index);
+    void closeCurrentTab();
+    void showNextTab();
+    void showPreviousTab();
+
+    void splitHorizontally();
+    void splitVertically();
+    void unsplit();
+    void split(Qt::Orientation orientation);
+
+    void showLoadProgress(qint64 bytesRead, qint64 totalBytes);
+    void handleLoaded(const QString &fileName, void *document, const TextEncoding &fileEncoding,
+                      bool malformed);
+    void handleLoadFailed(const QString &fileName, const QString &error);
+    void handleLoadCancelled(const QString &fileName);
+
+    void showSaveProgress(qint64 bytesWritten, qint64 totalBytes);
+    void handleSaved(const QString &fileName);
+    void handleSaveFailed(const QString &fileName, const QString &error);
+    void handleDocumentSaved(void *pointer);
+
+    void handleChangedOnDisk(const QString &fileName);
+    void handleRemovedFromDisk(const QString &fileName);
+    void handleReloaded(const QString &fileName, int changes, qint64 bytes);
+    void handleReloadFailed(const QString &fileName, const QString &error);
+
+    void toggleFollow(bool on);
+    void chooseFollowLimit();
+    void handleFollowTruncated(const QString &fileName);
+    void handleFollowFailed(const QString &fileName, const QString &error);
+
+    void handleJournalFailed(const QString &error);
+
+    void handleViewerFound(bool found);
+
     // File menu slots
     void newFile();
     void openFile();
+    void openFolder();
     bool saveFile();
     bool saveFileAs();
+    bool saveFileAndWait();
+
+    void find();
+    void findNext();
+
+    void chooseStatsLocale();
+    void chooseEncoding();
 
     void setupEditor() {
-        editor->setUtf8(true);
+        applyDocumentSettings();
+        setupView(editor);
+    }
 
+    // Settings Scintilla keeps per view, which each pane of a split needs.
+    void setupView(QsciScintilla *view) {
         // Line numbers
-        editor->setMarginType(0, QsciScintilla::NumberMargin);
-        editor->setMarginWidth(0, "00000");
-        editor->setMarginsForegroundColor(Qt::gray);
+        view->setMarginType(0, QsciScintilla::NumberMargin);
+        view->setMarginWidth(0, "00000");
+        view->setMarginsForegroundColor(Qt::gray);
 
         // Brace matching
-        editor->setBraceMatching(QsciScintilla::SloppyBraceMatch);
+        view->setBraceMatching(QsciScintilla::SloppyBraceMatch);
+
+        // Folding
+        view->setFolding(QsciScintilla::BoxedTreeFoldStyle);
 
         // Indentation
-        editor->setAutoIndent(true);
-        editor->setIndentationWidth(4);
-        editor->setTabWidth(4);
-        editor->setIndentationsUseTabs(false);
+        view->setAutoIndent(true);
 
         // Caret line visible and background: keep the line you're typing white (readable).
         // Make editor's default paper/text black-on-white so the white caret line remains readable.
-        editor->setPaper(Qt::white);     // editor background (non-active lines)
-        editor->setColor(Qt::black);     // default text color
+        view->setPaper(Qt::white);     // editor background (non-active lines)
+        view->setColor(Qt::black);     // default text color
 
-        editor->setCaretLineVisible(true);
-        editor->setCaretLineBackgroundColor(Qt::white); // active line white
+        view->setCaretLineVisible(true);
+        view->setCaretLineBackgroundColor(Qt::white); // active line white
+
+        // Each view lays out the lines it shows; keeping a page of them
+        // makes scrolling back and forth within it cheap.
+        view->SendScintilla(QsciScintillaBase::SCI_SETLAYOUTCACHE,
+                            static_cast<unsigned long>(QsciScintillaBase::SC_CACHE_PAGE));
+    }
 
+    // Looking the font up is one of the slowest steps of startup, so the
+    // first frame shows Scintilla's default font.
+    void setupFont() {
         // Font: Intel One Mono
-QFont font("Intel One Mono");
-font.setPointSize(11);
-font.setStyleHint(QFont::Monospace);
-font.setFixedPitch(true);
+        QFont font("Intel One Mono");
+        font.setPointSize(11);
+        font.setStyleHint(QFont::Monospace);
+        font.setFixedPitch(true);
 
-editor->setFont(font);
-editor->setMarginsFont(font);
+        editor->setFont(font);
+        editor->setMarginsFont(font);
+        if (pane) {
+            pane->setFont(font);
+            pane->setMarginsFont(font);
+        }
+        for (const auto &document : documents) {
+            if (document->viewer)
+                document->viewer->setFont(font);
+        }
     }
 
+    // Settings Scintilla keeps per document, which a new document lacks.
+    void applyDocumentSettings() {
+        editor->setUtf8(true);
+        editor->setIndentationWidth(4);
+        editor->setTabWidth(4);
+        editor->setIndentationsUseTabs(false);
+        // The lexer keeps its properties with the document.
+        editor->SendScintilla(QsciScintillaBase::SCI_SETPROPERTY, "fold", "1");
+    }
+
+    // One lexer styles every document; the others take it up when shown.
     void setupLexer() {
         auto *lexer = new QsciLexerCPP(editor);
         lexer->setDefaultFont(editor->font());
@@ -97,16 +574,43 @@ editor->setMarginsFont(font);
         lexer->setColor(Qt::black, QsciLexerCPP::Default);
         lexer->setPaper(Qt::white, QsciLexerCPP::Default);
         editor->setLexer(lexer);
+        if (!isViewing())
+            current->lexer = lexer;
     }
 
     void setupStatusBar() {
+        // Statistics stay in a permanent label so file messages don't hide them.
+        statsLabel = new QLabel(this);
+        statusBar()->addPermanentWidget(statsLabel);
+        encodingLabel = new QLabel(QString::fromStdString(TextEncoding().displayName()), this);
+        statusBar()->addPermanentWidget(encodingLabel);
+
+        loadProgress = new QProgressBar(this);
+        loadProgress->setRange(0, 100);
+        loadProgress->setMaximumWidth(150);
+        loadProgress->setFormat("Loading %p%");
+        loadProgress->hide();
+        statusBar()->addPermanentWidget(loadProgress);
+
+        cancelLoadButton = new QToolButton(this);
+        cancelLoadButton->setText("Cancel");
+        cancelLoadButton->hide();
+        connect(cancelLoadButton, &QToolButton::clicked, loader, &FileLoader::cancel);
+        statusBar()->addPermanentWidget(cancelLoadButton);
+
+        saveProgress = new QProgressBar(this);
+        saveProgress->setRange(0, 100);
+        saveProgress->setMaximumWidth(150);
+        saveProgress->setFormat("Saving %p%");
+        saveProgress->hide();
+        statusBar()->addPermanentWidget(saveProgress);
+
         statusBar()->showMessage("Ready");
         updateStats();
     }
 
+    // Fills in the menus the constructor adds.
     void setupMenuBar() {
-        QMenu *fileMenu = menuBar()->addMenu("&File");
-
         QAction *newAct = new QAction("&New", this);
         newAct->setShortcut(QKeySequence::New);
         connect(newAct, &QAction::triggered, this, &CodeEditor::newFile);
@@ -117,6 +621,10 @@ editor->setMarginsFont(font);
         connect(openAct, &QAction::triggered, this, &CodeEditor::openFile);
         fileMenu->addAction(openAct);
 
+        QAction *openFolderAct = new QAction("Open &Folder...", this);
+        connect(openFolderAct, &QAction::triggered, this, &CodeEditor::openFolder);
+        fileMenu->addAction(openFolderAct);
+
         QAction *saveAct = new QAction("&Save", this);
         saveAct->setShortcut(QKeySequence::Save);
         connect(saveAct, &QAction::triggered, this, &CodeEditor::saveFile);
@@ -127,144 +635,1421 @@ editor->setMarginsFont(font);
         connect(saveAsAct, &QAction::triggered, this, &CodeEditor::saveFileAs);
         fileMenu->addAction(saveAsAct);
 
+        QAction *closeAct = new QAction("&Close", this);
+        closeAct->setShortcut(QKeySequence::Close);
+        connect(closeAct, &QAction::triggered, this, &CodeEditor::closeCurrentTab);
+        fileMenu->addAction(closeAct);
+
+        QAction *encodingAct = new QAction("Set &Encoding...", this);
+        connect(encodingAct, &QAction::triggered, this, &CodeEditor::chooseEncoding);
+        fileMenu->addAction(encodingAct);
+
+        followAct = new QAction("&Follow File", this);
+        followAct->setCheckable(true);
+        connect(followAct, &QAction::triggered, this, &CodeEditor::toggleFollow);
+        fileMenu->addAction(followAct);
+
+        QAction *followLimitAct = new QAction("Follow Line &Limit...", this);
+        connect(followLimitAct, &QAction::triggered, this, &CodeEditor::chooseFollowLimit);
+        fileMenu->addAction(followLimitAct);
+
         fileMenu->addSeparator();
 
         QAction *exitAct = new QAction("E&xit", this);
         exitAct->setShortcut(QKeySequence::Quit);
         connect(exitAct, &QAction::triggered, this, &QWidget::close);
         fileMenu->addAction(exitAct);
+
+        QAction *findAct = new QAction("&Find...", this);
+        findAct->setShortcut(QKeySequence::Find);
+        connect(findAct, &QAction::triggered, this, &CodeEditor::find);
+        searchMenu->addAction(findAct);
+
+        QAction *findNextAct = new QAction("Find &Next", this);
+        findNextAct->setShortcut(QKeySequence::FindNext);
+        connect(findNextAct, &QAction::triggered, this, &CodeEditor::findNext);
+        searchMenu->addAction(findNextAct);
+
+        QAction *nextTabAct = new QAction("&Next Tab", this);
+        nextTabAct->setShortcut(QKeySequence::NextChild);
+        connect(nextTabAct, &QAction::triggered, this, &CodeEditor::showNextTab);
+        viewMenu->addAction(nextTabAct);
+
+        QAction *previousTabAct = new QAction("&Previous Tab", this);
+        previousTabAct->setShortcut(QKeySequence::PreviousChild);
+        connect(previousTabAct, &QAction::triggered, this, &CodeEditor::showPreviousTab);
+        viewMenu->addAction(previousTabAct);
+
+        viewMenu->addSeparator();
+
+        QAction *splitHorizontallyAct = new QAction("Split &Horizontally", this);
+        connect(splitHorizontallyAct, &QAction::triggered, this, &CodeEditor::splitHorizontally);
+        viewMenu->addAction(splitHorizontallyAct);
+
+        QAction *splitVerticallyAct = new QAction("Split &Vertically", this);
+        connect(splitVerticallyAct, &QAction::triggered, this, &CodeEditor::splitVertically);
+        viewMenu->addAction(splitVerticallyAct);
+
+        QAction *unsplitAct = new QAction("&Unsplit", this);
+        connect(unsplitAct, &QAction::triggered, this, &CodeEditor::unsplit);
+        viewMenu->addAction(unsplitAct);
+
+        viewMenu->addSeparator();
+
+        QAction *projectAct = projectPanel->toggleViewAction();
+        projectAct->setText("&Project");
+        viewMenu->addAction(projectAct);
+
+        QAction *localeAct = new QAction("Statistics &Locale...", this);
+        connect(localeAct, &QAction::triggered, this, &CodeEditor::chooseStatsLocale);
+        toolsMenu->addAction(localeAct);
+
+        QAction *latencyAct = latencyPanel->toggleViewAction();
+        latencyAct->setText("Keystroke &Latency");
+        toolsMenu->addAction(latencyAct);
+
+        QAction *memoryAct = memoryPanel->toggleViewAction();
+        memoryAct->setText("&Memory");
+        toolsMenu->addAction(memoryAct);
     }
 };
 
 #include "main.moc"
 
 void CodeEditor::updateStats() {
-    QString text = editor->text();
+    if (isViewing()) {
+        const LargeFileView *viewer = current->viewer;
+        QString lines = QString::number(viewer->lineCount());
+        if (viewer->isIndexing() && viewer->byteCount() > 0) {
+            lines += QString(" (indexing %1%)")
+                         .arg(viewer->indexedByteCount() * 100 / viewer->byteCount());
+        }
+        statsLabel->setText(QString("Lines: %1 | Bytes: %2 | Large file mode%3")
+                                .arg(lines)
+                                .arg(viewer->byteCount())
+                                .arg(viewer->isIndexing() ? ", read-only until indexed" : ""));
+        return;
+    }
 
-    // Convert to UTF-8 std::string then to ICU UnicodeString
-    std::string utf8 = text.toUtf8().constData();
-    icu::UnicodeString utext = icu::UnicodeString::fromUTF8(utf8);
+    const TextCounts &counts = stats->totals();
+    QString text = QString("Lines: %1 | Bytes: %2 | Code points: %3 | Words: %4 | Characters: %5%6")
+                       .arg(stats->lineCount())
+                       .arg(stats->byteCount())
+                       .arg(counts.codePoints)
+                       .arg(counts.words)
+                       .arg(counts.graphemes)
+                       .arg(stats->isPending() ? " (counting...)" : "");
 
-    UErrorCode status = U_ZERO_ERROR;
+    const DocumentStats::Selection selection = stats->selection(activeView());
+    if (selection.ranges > 0) {
+        QString selected = QString("Selected: %1 words, %2 characters, %3 code points, %4 bytes, %5 lines")
+                               .arg(selection.counts.words)
+                               .arg(selection.counts.graphemes)
+                               .arg(selection.counts.codePoints)
+                               .arg(selection.bytes)
+                               .arg(selection.lines);
+        if (selection.ranges > 1)
+            selected += QString(" in %1 ranges").arg(selection.ranges);
+        text = selected + " | " + text;
+    }
+
+    statsLabel->setText(text);
+}
+
+bool CodeEditor::isDocumentModified(const Document *document) const {
+    if (document->viewer)
+        return document->viewer->isModified();
+    return document == current ? editor->isModified() : document->modified;
+}
+
+bool CodeEditor::isSaving() const {
+    if (saver->isSaving())
+        return true;
+    return std::any_of(documents.begin(), documents.end(), [](const auto &document) {
+        return document->viewer && document->viewer->isSaving();
+    });
+}
 
-    // Word count (Unicode-aware using break iterator)
-    std::unique_ptr<icu::BreakIterator> wordIter(
-        icu::BreakIterator::createWordInstance(icu::Locale::getDefault(), status));
+bool CodeEditor::isBlank(const Document *document) const {
+    return document == current && document->fileName.isEmpty() && !document->viewer
+        && !editor->isModified() && editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH) == 0;
+}
 
-    int wordCount = 0;
-    if (U_SUCCESS(status) && wordIter) {
-        wordIter->setText(utext);
+CodeEditor::Document *CodeEditor::documentFor(const QString &fileName) const {
+    const QString path = QFileInfo(fileName).absoluteFilePath();
+    for (const auto &document : documents) {
+        if (!document->fileName.isEmpty() && QFileInfo(document->fileName).absoluteFilePath() == path)
+            return document.get();
+    }
+    return nullptr;
+}
 
-        // Iterate boundaries; count segments whose rule status is not UBRK_WORD_NONE
-        wordIter->first();
-        int32_t end;
-        while ((end = wordIter->next()) != icu::BreakIterator::DONE) {
-            int ruleStatus = wordIter->getRuleStatus();
-            if (ruleStatus != UBRK_WORD_NONE) {
-                ++wordCount;
+int CodeEditor::indexOf(const Document *document) const {
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (documents[i].get() == document)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+CodeEditor::Document *CodeEditor::addDocument(const QString &fileName, LargeFileView *view) {
+    auto document = std::make_unique<Document>();
+    if (!view) {
+        document->pointer = reinterpret_cast<void *>(
+            editor->SendScintilla(QsciScintillaBase::SCI_CREATEDOCUMENT));
+    }
+    document->viewer = view;
+    document->journal = new Journal(editor, this);
+    connect(document->journal, &Journal::failed, this, &CodeEditor::handleJournalFailed);
+
+    Document *added = document.get();
+    documents.push_back(std::move(document));
+    tabs->addTab(QString());
+    setFileName(added, fileName);
+    return added;
+}
+
+void CodeEditor::setFileName(Document *document, const QString &fileName) {
+    document->fileName = fileName;
+    document->untitled = 0;
+    if (fileName.isEmpty()) {
+        // The lowest number no other untitled document has.
+        int number = 1;
+        while (std::any_of(documents.begin(), documents.end(),
+                           [number](const auto &other) { return other->untitled == number; }))
+            ++number;
+        document->untitled = number;
+    }
+    updateTab(document);
+}
+
+QString CodeEditor::titleOf(const Document *document) const {
+    if (!document->fileName.isEmpty())
+        return QFileInfo(document->fileName).fileName();
+    return document->untitled > 1 ? QString("Untitled %1").arg(document->untitled) : QString("Untitled");
+}
+
+void CodeEditor::updateTab(Document *document) {
+    const int index = indexOf(document);
+    if (index < 0)
+        return;
+    QString title = titleOf(document);
+    if (isDocumentModified(document))
+        title += "*";
+    tabs->setTabText(index, title);
+    tabs->setTabToolTip(index, document->fileName);
+}
+
+void CodeEditor::handleTabChanged(int index) {
+    if (index >= 0 && index < static_cast<int>(documents.size()))
+        showDocument(documents[index].get());
+}
+
+void CodeEditor::handleTabMoved(int from, int to) {
+    std::unique_ptr<Document> document = std::move(documents[from]);
+    documents.erase(documents.begin() + from);
+    documents.insert(documents.begin() + to, std::move(document));
+}
+
+void CodeEditor::closeTab(int index) {
+    if (index >= 0 && index < static_cast<int>(documents.size()))
+        closeDocument(documents[index].get());
+}
+
+void CodeEditor::closeCurrentTab() {
+    closeDocument(current);
+}
+
+void CodeEditor::showNextTab() {
+    tabs->setCurrentIndex((tabs->currentIndex() + 1) % tabs->count());
+}
+
+void CodeEditor::showPreviousTab() {
+    tabs->setCurrentIndex((tabs->currentIndex() + tabs->count() - 1) % tabs->count());
+}
+
+void CodeEditor::showDocument(Document *document) {
+    if (document == current)
+        return;
+    if (current)
+        leaveDocument();
+    current = document;
+    tabs->setCurrentIndex(indexOf(document));
+
+    // A file that has grown past the threshold since it was last open.
+    if (document->unloaded && QFileInfo(document->fileName).size() > viewerThreshold) {
+        if (LargeFileView *view = createViewer(document->fileName)) {
+            editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+            document->pointer = nullptr;
+            document->viewer = view;
+            document->unloaded = false;
+            document->loading = false;
+        }
+    }
+
+    if (document->viewer) {
+        views->setCurrentWidget(document->viewer);
+        document->viewer->setFocus();
+    } else {
+        if (document->stripped) {
+            // The lexer styles the copy again, as far as the view shows.
+            if (void *styled = budget->withStyles(document->pointer)) {
+                editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+                document->pointer = styled;
+                document->stripped = false;
+                document->configured = false;
+                document->lexer = nullptr;
             }
         }
+        attachDocument(document);
+        views->setCurrentWidget(splitter);
+        activeView()->setFocus();
+        if (document->fresh)
+            finishOpening(document);
+        else
+            document->journal->resume();
+        if (document->savedAway) {
+            // Reaching the save point restarts the journal too.
+            document->savedAway = false;
+            editor->setModified(false);
+        }
+        // Catches up with what changed on disk meanwhile. A document still
+        // to load takes the file as it is then.
+        if (!document->watched.fileName.isEmpty() && !document->loading) {
+            watcher->watch(document->watched);
+            watcher->check();
+        }
+        // The loader takes one file at a time; this one waits for the
+        // current load otherwise.
+        if (document->unloaded && !loading)
+            reloadDocument(document);
     }
+    setEncoding(document->encoding);
+    updateStats();
+}
 
-    // Grapheme (user-perceived character) count
-    status = U_ZERO_ERROR;
-    std::unique_ptr<icu::BreakIterator> charIter(
-        icu::BreakIterator::createCharacterInstance(icu::Locale::getDefault(), status));
+void CodeEditor::leaveDocument() {
+    if (current->viewer)
+        return;
 
-    int graphemes = 0;
-    if (U_SUCCESS(status) && charIter) {
-        charIter->setText(utext);
-        int32_t start = charIter->first();
-        int32_t end = charIter->next();
-        for (; end != icu::BreakIterator::DONE; start = end, end = charIter->next())
-            ++graphemes;
+    if (follower->isFollowing()) {
+        // The watcher picks up the rest when the document is back.
+        followAct->setChecked(false);
+        toggleFollow(false);
     }
+    // A save in flight carries on with the copy it took.
+    current->journal->suspend();
+    current->watched = watcher->state();
+    // A reload cut short is done again on return.
+    if (watcher->isReloading())
+        current->watched.size = -1;
+    watcher->unwatch();
 
-    statusBar()->showMessage(
-        QString("Words: %1 | Characters: %2")
-            .arg(wordCount)
-            .arg(graphemes));
+    current->modified = editor->isModified();
+    current->leftAt = startupClock.elapsed();
+    current->memory = MemoryBudget::measure(editor, !current->stripped);
+    // A document still to load keeps where it is to open.
+    if (current->loading)
+        return;
+    current->view = viewState(editor);
+    if (isSplit())
+        current->split = viewState(pane);
 }
 
-void CodeEditor::newFile() {
-    if (editor->isModified()) {
-        auto ret = QMessageBox::question(this, "Unsaved Changes",
-                                         "The document has unsaved changes. Save before creating a new file?",
-                                         QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
-        if (ret == QMessageBox::Cancel) return;
-        if (ret == QMessageBox::Yes && !saveFile()) return;
+CodeEditor::ViewState CodeEditor::viewState(QsciScintilla *view) {
+    ViewState state;
+    state.anchor = view->SendScintilla(QsciScintillaBase::SCI_GETANCHOR);
+    state.caret = view->SendScintilla(QsciScintillaBase::SCI_GETCURRENTPOS);
+    state.firstLine = view->SendScintilla(QsciScintillaBase::SCI_GETFIRSTVISIBLELINE);
+    state.xOffset = view->SendScintilla(QsciScintillaBase::SCI_GETXOFFSET);
+    for (long line = view->SendScintilla(QsciScintillaBase::SCI_CONTRACTEDFOLDNEXT, 0UL); line >= 0;
+         line = view->SendScintilla(QsciScintillaBase::SCI_CONTRACTEDFOLDNEXT, static_cast<unsigned long>(line + 1)))
+        state.folds.push_back(line);
+    return state;
+}
+
+void CodeEditor::restoreView(QsciScintilla *view, const ViewState &state) {
+    // Folds first: the first visible line counts the lines they hide.
+    const long lines = view->SendScintilla(QsciScintillaBase::SCI_GETLINECOUNT);
+    if (!state.folds.empty() && state.folds.front() < lines) {
+        // The lexer sets the fold levels as it styles, which may not have
+        // got that far yet.
+        const long last = std::min(state.folds.back(), lines - 1);
+        const long end = view->SendScintilla(QsciScintillaBase::SCI_GETLINEENDPOSITION, static_cast<unsigned long>(last));
+        const long styled = view->SendScintilla(QsciScintillaBase::SCI_GETENDSTYLED);
+        if (styled < end)
+            view->SendScintilla(QsciScintillaBase::SCI_COLOURISE, static_cast<unsigned long>(styled), end);
+        for (long line : state.folds) {
+            if (line >= lines)
+                break;
+            if (view->SendScintilla(QsciScintillaBase::SCI_GETFOLDEXPANDED, static_cast<unsigned long>(line)))
+                view->SendScintilla(QsciScintillaBase::SCI_TOGGLEFOLD, static_cast<unsigned long>(line));
+        }
     }
+    view->SendScintilla(QsciScintillaBase::SCI_SETSEL, static_cast<unsigned long>(state.anchor), state.caret);
+    view->SendScintilla(QsciScintillaBase::SCI_SETFIRSTVISIBLELINE, static_cast<unsigned long>(state.firstLine));
+    view->SendScintilla(QsciScintillaBase::SCI_SETXOFFSET, static_cast<unsigned long>(state.xOffset));
+}
 
-    editor->setText(QString());
-    currentFile.clear();
-    editor->setModified(false);
-    statusBar()->showMessage("New file");
+void CodeEditor::attachDocument(Document *document) {
+    // Scintilla gives a new document its default line end mode.
+    const QsciScintilla::EolMode eolMode = editor->eolMode();
+    editor->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, document->pointer);
+    if (!document->configured) {
+        editor->setEolMode(eolMode);
+        applyDocumentSettings();
+        document->configured = true;
+    }
+    // The document keeps its styling between turns; only one styled before
+    // the lexer was set up, or never, is styled from the start.
+    if (document->lexer != editor->lexer()) {
+        editor->setLexer(editor->lexer());
+        document->lexer = editor->lexer();
+    }
+
+    restoreView(editor, document->view);
+    if (isSplit()) {
+        // The pane shares the document; Scintilla tells both views of each
+        // change and styles the text once.
+        pane->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, document->pointer);
+        restoreView(pane, document->split);
+    }
+    // Typing into a document about to be replaced by its file would be lost.
+    editor->setReadOnly(document->loading);
+    stats->reset();
 }
 
-void CodeEditor::openFile() {
-    if (editor->isModified()) {
+bool CodeEditor::closeDocument(Document *document) {
+    if (isDocumentModified(document)) {
+        showDocument(document);
+        const QString name = document->fileName.isEmpty() ? titleOf(document) : document->fileName;
         auto ret = QMessageBox::question(this, "Unsaved Changes",
-                                         "The document has unsaved changes. Save before opening another file?",
+                                         "Save the changes to " + name + " before closing it?",
                                          QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
-        if (ret == QMessageBox::Cancel) return;
-        if (ret == QMessageBox::Yes && !saveFile()) return;
+        if (ret == QMessageBox::Cancel) return false;
+        if (ret == QMessageBox::Yes && !saveFileAndWait()) return false;
+    }
+    removeDocument(document);
+    return true;
+}
+
+void CodeEditor::removeDocument(Document *document) {
+    if (document == loading) {
+        loading = nullptr;
+        loader->cancel();
+    }
+    if (document == current) {
+        const int index = indexOf(document);
+        if (documents.size() > 1) {
+            showDocument(documents[index + 1 < static_cast<int>(documents.size()) ? index + 1 : index - 1].get());
+        } else {
+            // There is always a document to type into.
+            Document *untitled = addDocument(QString());
+            showDocument(untitled);
+            untitled->journal->restart(QString(), untitled->untitled);
+        }
     }
 
+    // The user chose to lose what the journal holds.
+    document->journal->close();
+    delete document->journal;
+    if (document->viewer) {
+        document->viewer->close();
+        delete document->viewer;
+    }
+    if (document->pointer) {
+        saver->documentClosed(document->pointer);
+        editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+    }
+
+    // The tab goes last, so that the tab bar never finds a tab without its
+    // document.
+    const int index = indexOf(document);
+    documents.erase(documents.begin() + index);
+    tabs->removeTab(index);
+}
+
+void CodeEditor::newFile() {
+    Document *document = addDocument(QString());
+    showDocument(document);
+    document->journal->restart(QString(), document->untitled);
+    statusBar()->showMessage("New file");
+}
+
+void CodeEditor::openFile() {
     QString fileName = QFileDialog::getOpenFileName(this, "Open File");
     if (fileName.isEmpty()) return;
+    openPath(fileName);
+}
+
+void CodeEditor::openFolder() {
+    const QString path = QFileDialog::getExistingDirectory(this, "Open Folder", projectPanel->folder());
+    if (path.isEmpty()) return;
+    showFolder(path);
+}
+
+void CodeEditor::showFolder(const QString &path) {
+    projectPanel->openFolder(path);
+    projectPanel->show();
+    statusBar()->showMessage("Project: " + QDir::toNativeSeparators(path));
+}
+
+CodeEditor::Document *CodeEditor::openPath(const QString &fileName) {
+    if (Document *open = documentFor(fileName)) {
+        showDocument(open);
+        return open;
+    }
+
+    if (QFileInfo(fileName).size() > viewerThreshold)
+        return openInViewer(fileName);
 
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::warning(this, "Open Failed", "Cannot open file: " + file.errorString());
+    // The loader takes one file at a time; the tab of one still loading goes.
+    loader->cancel();
+    Document *blank = isBlank(current) ? current : nullptr;
+
+    // The file goes into a new document on a worker thread; handleLoaded()
+    // puts it in the tab.
+    QString error;
+    if (!loader->start(fileName, &error)) {
+        QMessageBox::warning(this, "Open Failed", "Cannot open file: " + error);
+        return nullptr;
+    }
+    Document *document = addDocument(fileName);
+    document->loading = true;
+    loading = document;
+    showDocument(document);
+    if (blank)
+        removeDocument(blank);
+
+    loadProgress->setValue(0);
+    loadProgress->show();
+    cancelLoadButton->show();
+    statusBar()->showMessage("Loading: " + fileName);
+    return document;
+}
+
+void CodeEditor::splitHorizontally() {
+    split(Qt::Horizontal);
+}
+
+void CodeEditor::splitVertically() {
+    split(Qt::Vertical);
+}
+
+void CodeEditor::split(Qt::Orientation orientation) {
+    if (isViewing()) {
+        statusBar()->showMessage("Split view is not available in large file mode");
+        return;
+    }
+    splitter->setOrientation(orientation);
+    if (isSplit())
+        return;
+
+    if (!pane) {
+        pane = new QsciScintilla(splitter);
+        // Like the editor, the pane keeps the document it was made with.
+        paneDocument = reinterpret_cast<void *>(
+            pane->SendScintilla(QsciScintillaBase::SCI_GETDOCPOINTER));
+        pane->SendScintilla(QsciScintillaBase::SCI_ADDREFDOCUMENT, 0, paneDocument);
+        setupView(pane);
+        pane->setFont(editor->font());
+        pane->setMarginsFont(editor->font());
+        // The pane takes the lexer's styles while it holds a document of its
+        // own, which spares the shared one a restyle.
+        pane->setLexer(editor->lexer());
+        splitter->addWidget(pane);
+        pane->installEventFilter(this);
+        latency->watchView(pane);
+        connect(pane, &QsciScintilla::selectionChanged, this, &CodeEditor::updateStats);
+    }
+
+    pane->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, current->pointer);
+    pane->show();
+    // The pane opens where the editor is.
+    restoreView(pane, viewState(editor));
+    const int size = orientation == Qt::Horizontal ? splitter->width() : splitter->height();
+    splitter->setSizes({size / 2, size - size / 2});
+    pane->setFocus();
+}
+
+void CodeEditor::unsplit() {
+    if (!isSplit())
+        return;
+    pane->hide();
+    // Lets go of the shared document, so that edits no longer lay out lines
+    // for a pane nobody sees.
+    pane->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, paneDocument);
+    focused = editor;
+    if (!isViewing())
+        editor->setFocus();
+    updateStats();
+}
+
+void CodeEditor::showLoadProgress(qint64 bytesRead, qint64 totalBytes) {
+    loadProgress->setValue(totalBytes > 0 ? static_cast<int>(bytesRead * 100 / totalBytes) : 100);
+}
+
+void CodeEditor::handleLoaded(const QString &fileName, void *loaded,
+                              const TextEncoding &fileEncoding, bool malformed) {
+    Document *document = loading;
+    loading = nullptr;
+    endLoading();
+    if (!document) {
+        editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, loaded);
         return;
     }
 
-    // Qt6: QTextStream::setCodec was removed. Read raw bytes and decode as UTF-8.
-    QByteArray bytes = file.readAll();
-    QString contents = QString::fromUtf8(bytes);
-    file.close();
+    // The loaded document takes the place of the empty one the tab had,
+    // with the reference the loader handed over.
+    void *placeholder = document->pointer;
+    document->pointer = loaded;
+    document->loading = false;
+    document->unloaded = false;
+    document->stripped = false;
+    document->undoBytes = 0;
+    document->configured = false;
+    document->lexer = nullptr;
+    document->encoding = fileEncoding;
+    document->watched = FileWatcher::stateOf(fileName);
+    document->fresh = true;
+    saver->documentClosed(placeholder);
+    if (document == current) {
+        attachDocument(document);
+        watcher->watch(document->watched);
+        finishOpening(document);
+        setEncoding(fileEncoding);
+    } else {
+        document->leftAt = startupClock.elapsed();
+        document->memory = budget->measure(document->pointer, true);
+    }
+    editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, placeholder);
+    updateTab(document);
+    statusBar()->showMessage(malformed ? "Opened: " + fileName + " (invalid UTF-8 kept as is)"
+                                       : "Opened: " + fileName);
+    if (current->unloaded && !loading)
+        reloadDocument(current);
+}
 
-    editor->setText(contents);
-    currentFile = fileName;
+void CodeEditor::finishOpening(Document *document) {
+    document->fresh = false;
     editor->setModified(false);
-    statusBar()->showMessage("Opened: " + fileName);
+    // Replaying must not be journaled.
+    document->journal->close();
+    offerRecovery(document);
+    document->journal->restart(document->fileName, document->untitled);
+    if (document->gotoLine > 0)
+        gotoPosition(document->gotoLine, document->gotoColumn);
+    document->gotoLine = 0;
+    document->gotoColumn = 0;
 }
 
-bool CodeEditor::saveFile() {
-    if (currentFile.isEmpty()) return saveFileAs();
+void CodeEditor::handleLoadFailed(const QString &, const QString &error) {
+    Document *document = loading;
+    loading = nullptr;
+    endLoading();
+    // An evicted document keeps its tab, and tries again when next shown.
+    if (document && !document->unloaded)
+        removeDocument(document);
+    if (current != document && current->unloaded)
+        reloadDocument(current);
+    QMessageBox::warning(this, "Open Failed", "Cannot open file: " + error);
+}
 
-    QFile file(currentFile);
-    if (!file.open(QIODevice::WriteOnly)) {
-        QMessageBox::warning(this, "Save Failed", "Cannot save file: " + file.errorString());
-        return false;
+void CodeEditor::handleLoadCancelled(const QString &fileName) {
+    Document *document = loading;
+    loading = nullptr;
+    endLoading();
+    if (document && !document->unloaded)
+        removeDocument(document);
+    statusBar()->showMessage("Cancelled opening: " + fileName);
+}
+
+void CodeEditor::endLoading() {
+    loadProgress->hide();
+    cancelLoadButton->hide();
+}
+
+void CodeEditor::reloadDocument(Document *document) {
+    QString error;
+    if (!loader->start(document->fileName, &error)) {
+        statusBar()->showMessage("Cannot load " + document->fileName + ": " + error);
+        return;
+    }
+    loading = document;
+    loadProgress->setValue(0);
+    loadProgress->show();
+    cancelLoadButton->show();
+    statusBar()->showMessage("Loading: " + document->fileName);
+}
+
+DocumentMemory CodeEditor::memoryOf(const Document *document) const {
+    DocumentMemory memory;
+    if (document->viewer) {
+        // The file is mapped, not copied; the line index is the viewer's own.
+        memory.lines = document->viewer->lineCount() * static_cast<qint64>(sizeof(qint64));
+        return memory;
+    }
+    memory = document == current ? MemoryBudget::measure(editor, !document->stripped) : document->memory;
+    memory.undo = document->undoBytes;
+    return memory;
+}
+
+QString CodeEditor::memoryStateOf(const Document *document) const {
+    if (document->viewer)
+        return "Large file mode";
+    if (document == loading)
+        return "Loading";
+    if (document->unloaded)
+        return "Unloaded";
+    if (document == current)
+        return "Shown";
+    if (document->stripped)
+        return "Styles dropped";
+    return "In memory";
+}
+
+void CodeEditor::enforceMemoryBudget() {
+    qint64 total = 0;
+    for (const auto &document : documents)
+        total += memoryOf(document.get()).total();
+    if (total <= memoryPolicy.budget)
+        return;
+
+    // Only what the file holds too can go.
+    std::vector<Document *> candidates;
+    for (const auto &document : documents) {
+        Document *d = document.get();
+        if (d != current && !d->viewer && !d->loading && !d->fresh && !isDocumentModified(d)
+            && !saver->isSaving(d->pointer))
+            candidates.push_back(d);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Document *a, const Document *b) { return a->leftAt < b->leftAt; });
+
+    const qint64 now = startupClock.elapsed();
+    auto due = [now](const Document *document, int after) {
+        return after >= 0 && now - document->leftAt >= qint64(after) * 1000;
+    };
+    // Each stage goes through the documents before a dearer one starts.
+    for (int stage = 0; stage < 3 && total > memoryPolicy.budget; ++stage) {
+        for (Document *document : candidates) {
+            if (total <= memoryPolicy.budget)
+                break;
+            const qint64 before = memoryOf(document).total();
+            if (stage == 0) {
+                // Copying would lose the undo history.
+                if (!document->stripped && document->undoBytes == 0 && due(document, memoryPolicy.stylesAfter))
+                    dropStyles(document);
+            } else if (stage == 1) {
+                if (document->undoBytes > 0 && due(document, memoryPolicy.undoAfter)) {
+                    budget->forgetUndo(document->pointer);
+                    document->undoBytes = 0;
+                    if (!document->stripped && due(document, memoryPolicy.stylesAfter))
+                        dropStyles(document);
+                }
+            } else if (!document->fileName.isEmpty() && document->undoBytes == 0
+                       && due(document, memoryPolicy.textAfter)) {
+                unloadDocument(document);
+            }
+            total += memoryOf(document).total() - before;
+        }
+    }
+}
+
+void CodeEditor::dropStyles(Document *document) {
+    void *copy = budget->withoutStyles(document->pointer);
+    if (!copy)
+        return;
+    editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+    document->pointer = copy;
+    document->stripped = true;
+    document->configured = false;
+    document->lexer = nullptr;
+    document->memory = budget->measure(copy, false);
+}
+
+void CodeEditor::unloadDocument(Document *document) {
+    editor->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, document->pointer);
+    // The tab shows an empty document until the file is back.
+    document->pointer = reinterpret_cast<void *>(
+        editor->SendScintilla(QsciScintillaBase::SCI_CREATEDOCUMENT));
+    document->unloaded = true;
+    document->loading = true;
+    document->stripped = false;
+    document->configured = false;
+    document->lexer = nullptr;
+    document->memory = DocumentMemory();
+    // It matches its file, so the journal holds nothing.
+    document->journal->close();
+}
+
+void CodeEditor::refreshMemoryPanel() {
+    const qint64 now = startupClock.elapsed();
+    std::vector<MemoryPanel::Row> rows;
+    for (const auto &document : documents) {
+        MemoryPanel::Row row;
+        row.name = titleOf(document.get());
+        row.state = memoryStateOf(document.get());
+        row.memory = memoryOf(document.get());
+        if (document.get() != current)
+            row.idleMsecs = now - document->leftAt;
+        rows.push_back(row);
     }
+    memoryPanel->setBudget(memoryPolicy.budget);
+    memoryPanel->setRows(rows);
+}
+
+CodeEditor::Document *CodeEditor::openInViewer(const QString &fileName) {
+    LargeFileView *view = createViewer(fileName);
+    if (!view)
+        return nullptr;
 
-    // Qt6: QTextStream::setCodec was removed. Write UTF-8 bytes directly.
-    QByteArray bytes = editor->text().toUtf8();
-    qint64 written = file.write(bytes);
-    file.close();
+    Document *blank = isBlank(current) ? current : nullptr;
+    Document *document = addDocument(fileName, view);
+    showDocument(document);
+    if (blank)
+        removeDocument(blank);
+    statusBar()->showMessage("Opened in large file mode: " + fileName);
+    return document;
+}
+
+LargeFileView *CodeEditor::createViewer(const QString &fileName) {
+    auto *view = new LargeFileView(this);
+    QString error;
+    if (!view->open(fileName, &error)) {
+        delete view;
+        QMessageBox::warning(this, "Open Failed", "Cannot open file: " + error);
+        return nullptr;
+    }
+    view->setFont(editor->font());
+    views->addWidget(view);
+    // Shown in place of the editor before the first frame, it paints that
+    // frame instead.
+    if (firstPaint)
+        view->viewport()->installEventFilter(this);
+
+    connect(view, &LargeFileView::indexProgress, this, [this, view] {
+        if (current->viewer == view)
+            updateStats();
+    });
+    connect(view, &LargeFileView::textChanged, this, [this, view] {
+        if (current->viewer == view)
+            updateStats();
+    });
+    connect(view, &LargeFileView::modificationChanged, this, [this, view] {
+        for (const auto &document : documents) {
+            if (document->viewer == view)
+                updateTab(document.get());
+        }
+    });
+    connect(view, &LargeFileView::findFinished, this, &CodeEditor::handleViewerFound);
+    connect(view, &LargeFileView::saveProgress, this, &CodeEditor::showSaveProgress);
+    connect(view, &LargeFileView::saved, this, &CodeEditor::handleSaved);
+    connect(view, &LargeFileView::saveFailed, this, &CodeEditor::handleSaveFailed);
+    return view;
+}
 
-    if (written == -1) {
-        QMessageBox::warning(this, "Save Failed", "Failed to write file: " + currentFile);
+bool CodeEditor::saveFile() {
+    if (follower->isFollowing()) {
+        statusBar()->showMessage("Stop following before saving");
+        return false;
+    }
+    if (current->loading) {
+        statusBar()->showMessage("Wait for the file to load before saving");
         return false;
     }
+    if (current->fileName.isEmpty()) return saveFileAs();
 
-    editor->setModified(false);
-    statusBar()->showMessage("Saved: " + currentFile);
+    if (isViewing()) {
+        // The pieces are streamed to the file on a worker thread.
+        if (!current->viewer->save(current->fileName, current->encoding)) {
+            statusBar()->showMessage(current->viewer->isSaving() ? "A save is already running"
+                                                                 : "Wait for indexing to finish before saving");
+            return false;
+        }
+        statusBar()->showMessage("Saving: " + current->fileName);
+        return true;
+    }
+
+    // The text is copied and written on a worker thread, unless it is small;
+    // handleSaved() or handleSaveFailed() reports the outcome.
+    saver->save(current->fileName, current->encoding);
+    if (saver->isSaving())
+        statusBar()->showMessage("Saving: " + current->fileName);
     return true;
 }
 
 bool CodeEditor::saveFileAs() {
+    if (follower->isFollowing()) {
+        statusBar()->showMessage("Stop following before saving");
+        return false;
+    }
+    if (current->loading) {
+        statusBar()->showMessage("Wait for the file to load before saving");
+        return false;
+    }
     QString fileName = QFileDialog::getSaveFileName(this, "Save File As");
     if (fileName.isEmpty()) return false;
 
-    currentFile = fileName;
+    setFileName(current, fileName);
     return saveFile();
 }
 
+// For a document about to be closed, which must be on disk before it goes.
+bool CodeEditor::saveFileAndWait() {
+    if (current->loading)
+        return false;
+    if (current->fileName.isEmpty()) {
+        QString fileName = QFileDialog::getSaveFileName(this, "Save File As");
+        if (fileName.isEmpty()) return false;
+        setFileName(current, fileName);
+    }
+
+    if (isViewing()) {
+        // handleSaved() or handleSaveFailed() reports the outcome.
+        current->viewer->waitForSave();
+        if (!current->viewer->save(current->fileName, current->encoding)) {
+            QMessageBox::warning(this, "Save Failed", "Cannot save file before indexing is done");
+            return false;
+        }
+        current->viewer->waitForSave();
+        return !current->viewer->isModified();
+    }
+
+    QString error;
+    if (!saver->saveAndWait(current->fileName, current->encoding, &error)) {
+        QMessageBox::warning(this, "Save Failed", "Cannot save file: " + error);
+        return false;
+    }
+
+    watcher->watch(current->fileName);
+    current->journal->restart(current->fileName, current->untitled);
+    statusBar()->showMessage("Saved: " + current->fileName);
+    return true;
+}
+
+void CodeEditor::showSaveProgress(qint64 bytesWritten, qint64 totalBytes) {
+    // Progress of a save that waitForDone() already finished can still be queued.
+    if (!isSaving())
+        return;
+    saveProgress->setValue(totalBytes > 0 ? static_cast<int>(bytesWritten * 100 / totalBytes) : 100);
+    saveProgress->show();
+}
+
+void CodeEditor::handleSaved(const QString &fileName) {
+    if (!isSaving())
+        saveProgress->hide();
+    // Our own write is not a change on disk.
+    if (fileName == current->fileName && !isViewing()) {
+        watcher->watch(fileName);
+        // Edits made while the save ran are not in the file.
+        current->journal->restart(fileName, current->untitled);
+    }
+    statusBar()->showMessage("Saved: " + fileName);
+}
+
+void CodeEditor::handleDocumentSaved(void *pointer) {
+    for (const auto &document : documents) {
+        if (document->pointer != pointer || document.get() == current)
+            continue;
+        document->modified = false;
+        document->savedAway = true;
+        // Our own write is not a change on disk.
+        document->watched = FileWatcher::stateOf(document->fileName);
+        updateTab(document.get());
+        return;
+    }
+}
+
+void CodeEditor::handleSaveFailed(const QString &fileName, const QString &error) {
+    if (!isSaving())
+        saveProgress->hide();
+    QMessageBox::warning(this, "Save Failed", "Cannot save " + fileName + ": " + error);
+}
+
+void CodeEditor::handleChangedOnDisk(const QString &fileName) {
+    if (isViewing() || fileName != current->fileName || askingToReload)
+        return;
+    // Not while the document is being written; ask again later.
+    if (saver->isSaving()) {
+        QTimer::singleShot(500, watcher, &FileWatcher::check);
+        return;
+    }
+
+    if (editor->isModified()) {
+        askingToReload = true;
+        const auto ret = QMessageBox::question(this, "File Changed",
+                                               fileName + " has changed on disk. Reload it and lose your changes?",
+                                               QMessageBox::Yes | QMessageBox::No);
+        askingToReload = false;
+        if (ret != QMessageBox::Yes || fileName != current->fileName) {
+            watcher->markCurrent();
+            return;
+        }
+    }
+
+    // Only the lines that differ are replaced; handleReloaded() reports back.
+    watcher->reload(current->encoding);
+}
+
+void CodeEditor::handleRemovedFromDisk(const QString &fileName) {
+    if (fileName == current->fileName)
+        statusBar()->showMessage("Removed from disk: " + fileName);
+}
+
+void CodeEditor::handleReloaded(const QString &fileName, int changes, qint64 bytes) {
+    if (changes == 0 && bytes == 0)
+        return;
+    statusBar()->showMessage(changes == 0
+        ? QString("Reloaded: %1 (%2 bytes appended)").arg(fileName).arg(bytes)
+        : QString("Reloaded: %1 (%2 ranges changed)").arg(fileName).arg(changes));
+}
+
+void CodeEditor::handleReloadFailed(const QString &fileName, const QString &error) {
+    statusBar()->showMessage("Cannot reload " + fileName + ": " + error);
+}
+
+void CodeEditor::toggleFollow(bool on) {
+    if (!on) {
+        follower->stop();
+        if (follower->hasDroppedLines()) {
+            // Saving what is left would cut the start off the file.
+            statusBar()->showMessage("Stopped following; the lines kept are no longer tied to " + current->fileName);
+            setFileName(current, QString());
+            current->journal->restart(QString(), current->untitled);
+            return;
+        }
+        current->journal->restart(current->fileName, current->untitled);
+        // Pick up what was written since the last batch.
+        watcher->watch(current->fileName);
+        watcher->reload(current->encoding);
+        statusBar()->showMessage("Stopped following: " + current->fileName);
+        return;
+    }
+
+    QString reason;
+    if (isViewing())
+        reason = "Following is not available in large file mode";
+    else if (current->fileName.isEmpty() || current->loading)
+        reason = "Open a file to follow it";
+    else if (editor->isModified())
+        reason = "Save the document before following the file";
+    if (!reason.isEmpty()) {
+        followAct->setChecked(false);
+        statusBar()->showMessage(reason);
+        return;
+    }
+
+    // Where the document ends in the file. UTF-8 maps byte for byte; other
+    // encodings are taken to be as unmodified as the document.
+    const qint64 offset = current->encoding.isUtf8()
+        ? static_cast<qint64>(current->encoding.byteOrderMark().size())
+              + editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH)
+        : QFileInfo(current->fileName).size();
+    watcher->unwatch();
+    // The text comes from the file; there is nothing to recover.
+    current->journal->close();
+    follower->start(current->fileName, offset, current->encoding);
+    statusBar()->showMessage("Following: " + current->fileName);
+}
+
+void CodeEditor::endFollowing() {
+    follower->stop();
+    if (followAct)
+        followAct->setChecked(false);
+}
+
+void CodeEditor::chooseFollowLimit() {
+    bool ok = false;
+    const int lines = QInputDialog::getInt(this, "Follow Line Limit",
+                                           "Lines to keep while following (0 keeps all):",
+                                           follower->lineLimit(), 0, 100000000, 1000, &ok);
+    if (ok)
+        follower->setLineLimit(lines);
+}
+
+void CodeEditor::handleFollowTruncated(const QString &fileName) {
+    statusBar()->showMessage("File truncated, following from its start: " + fileName);
+}
+
+void CodeEditor::handleFollowFailed(const QString &fileName, const QString &error) {
+    followAct->setChecked(false);
+    statusBar()->showMessage("Stopped following " + fileName + ": " + error);
+}
+
+void CodeEditor::offerRecovery(Document *document) {
+    const QString &fileName = document->fileName;
+    if (!Journal::exists(fileName, document->untitled))
+        return;
+    const QString name = fileName.isEmpty() ? "an untitled document" : fileName;
+    const auto ret = QMessageBox::question(this, "Recover Changes",
+                                           "Unsaved changes to " + name + " from an earlier session were found. Recover them?",
+                                           QMessageBox::Yes | QMessageBox::No);
+    QString error;
+    if (ret == QMessageBox::Yes && !Journal::replay(fileName, editor, &error, document->untitled))
+        QMessageBox::warning(this, "Recovery Failed", "Cannot recover the changes: " + error);
+    else if (ret == QMessageBox::Yes)
+        statusBar()->showMessage("Recovered unsaved changes to " + name);
+    // What was recovered is journaled afresh.
+    Journal::discard(fileName, document->untitled);
+}
+
+void CodeEditor::handleJournalFailed(const QString &error) {
+    statusBar()->showMessage("Cannot write the recovery journal: " + error);
+}
+
+void CodeEditor::find() {
+    bool ok = false;
+    const QString text = QInputDialog::getText(this, "Find", "Find:", QLineEdit::Normal,
+                                               findText, &ok);
+    if (!ok || text.isEmpty()) return;
+
+    findText = text;
+    if (isViewing()) {
+        // Large files are searched on a worker; handleViewerFound() reports back.
+        current->viewer->find(text.toUtf8());
+        statusBar()->showMessage("Searching...");
+        return;
+    }
+    searched = activeView();
+    if (!searched->findFirst(text, false, true, false, true))
+        statusBar()->showMessage("Not found: " + text);
+}
+
+void CodeEditor::findNext() {
+    if (findText.isEmpty()) {
+        find();
+        return;
+    }
+    if (isViewing()) {
+        current->viewer->findNext();
+        statusBar()->showMessage("Searching...");
+        return;
+    }
+    // Each pane keeps its own search; one that has none starts it afresh
+    // from its caret.
+    QsciScintilla *view = activeView();
+    const bool found = view == searched ? view->findNext()
+                                        : view->findFirst(findText, false, true, false, true);
+    searched = view;
+    if (!found)
+        statusBar()->showMessage("Not found: " + findText);
+}
+
+void CodeEditor::handleViewerFound(bool found) {
+    statusBar()->showMessage(found ? "Found: " + findText : "Not found: " + findText);
+}
+
+void CodeEditor::chooseStatsLocale() {
+    // Word rules differ per language; dictionary-based scripts (Thai, Lao,
+    // Khmer, Burmese, CJK) need their locale for sensible word counts.
+    const QString systemDefault = "System default";
+    QStringList locales = {systemDefault, "en_US", "de_DE", "fr_FR", "ja_JP",
+                           "zh_CN", "ko_KR", "th_TH", "lo_LA", "km_KH", "my_MM"};
+
+    const QString current = QString::fromUtf8(stats->locale().getName());
+    int index = locales.indexOf(current);
+    if (index < 0) {
+        locales.append(current);
+        index = locales.size() - 1;
+    }
+
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, "Statistics Locale",
+                                                 "Count words using the rules of:",
+                                                 locales, index, true, &ok);
+    if (!ok || choice.isEmpty()) return;
+
+    stats->setLocale(choice == systemDefault
+                         ? icu::Locale::getDefault()
+                         : icu::Locale(choice.toUtf8().constData()));
+}
+
+void CodeEditor::setEncoding(const TextEncoding &fileEncoding) {
+    current->encoding = fileEncoding;
+    encodingLabel->setText(QString::fromStdString(fileEncoding.displayName()));
+}
+
+void CodeEditor::chooseEncoding() {
+    // Takes effect with the next save; the text in the editor is unchanged.
+    QStringList encodings = {"UTF-8", "UTF-8 with BOM", "UTF-16LE with BOM", "UTF-16BE with BOM",
+                             "windows-1252", "ISO-8859-1", "ISO-8859-15", "windows-1251",
+                             "KOI8-R", "Shift_JIS", "EUC-JP", "GB18030", "Big5", "EUC-KR"};
+
+    const QString shown = QString::fromStdString(current->encoding.displayName());
+    int index = encodings.indexOf(shown);
+    if (index < 0) {
+        encodings.append(shown);
+        index = encodings.size() - 1;
+    }
+
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, "Encoding", "Save the file as:",
+                                                 encodings, index, true, &ok);
+    if (!ok || choice.isEmpty()) return;
+
+    TextEncoding chosen;
+    if (!TextEncoding::fromDisplayName(choice.toStdString(), chosen)) {
+        QMessageBox::warning(this, "Unknown Encoding", "Unknown encoding: " + choice);
+        return;
+    }
+    setEncoding(chosen);
+    statusBar()->showMessage("The next save uses " + choice);
+}
+
+void CodeEditor::openFromCommandLine(const std::vector<FileRequest> &files) {
+    // Folders alone leave the last session's tabs to be restored.
+    startupFile = std::any_of(files.begin(), files.end(),
+                              [](const FileRequest &file) { return !QFileInfo(file.fileName).isDir(); });
+    openFiles(files);
+}
+
+void CodeEditor::openFromInstance(const QString &workingDirectory, const QStringList &arguments) {
+    setWindowState(windowState() & ~Qt::WindowMinimized);
+    raise();
+    activateWindow();
+
+    std::vector<FileRequest> files = parseArguments(arguments);
+    for (FileRequest &file : files)
+        file.fileName = QDir(workingDirectory).absoluteFilePath(file.fileName);
+    // Each opens in a tab of its own; the documents open so far stay as they are.
+    openFiles(files);
+}
+
+void CodeEditor::openFiles(const std::vector<FileRequest> &files) {
+    Document *blank = isBlank(current) ? current : nullptr;
+    Document *first = nullptr;
+    for (const FileRequest &file : files) {
+        const QFileInfo info(file.fileName);
+        if (info.isDir()) {
+            showFolder(file.fileName);
+        } else if (!info.exists() || documentFor(file.fileName) || (!first && !loading)) {
+            openAt(file.fileName, file.line, file.column);
+            if (!first)
+                first = current;
+        } else {
+            // The loader takes one file at a time, and would drop the one it
+            // has; this one waits for its turn.
+            Document *document = addUnloadedDocument(file.fileName);
+            document->gotoLine = file.line;
+            document->gotoColumn = file.column;
+            if (!first)
+                first = document;
+        }
+    }
+    if (first && first != current && indexOf(first) >= 0)
+        showDocument(first);
+    if (blank && blank != current && indexOf(blank) >= 0)
+        removeDocument(blank);
+}
+
+CodeEditor::Document *CodeEditor::addUnloadedDocument(const QString &fileName) {
+    // An empty placeholder, which takes the file when first shown, the way
+    // one eviction unloaded does.
+    Document *document = addDocument(fileName);
+    document->unloaded = true;
+    document->loading = true;
+    document->leftAt = startupClock.elapsed();
+    return document;
+}
+
+void CodeEditor::openAt(const QString &fileName, int line, int column) {
+    if (QFileInfo(fileName).isDir()) {
+        showFolder(fileName);
+        return;
+    }
+    if (QFileInfo::exists(fileName)) {
+        Document *document = openPath(fileName);
+        if (!document || document->viewer || line <= 0)
+            return;
+        if (document->loading || document->fresh) {
+            document->gotoLine = line;
+            document->gotoColumn = column;
+        } else {
+            gotoPosition(line, column);
+        }
+        return;
+    }
+
+    if (Document *open = documentFor(fileName)) {
+        showDocument(open);
+        return;
+    }
+
+    // The first save creates it.
+    Document *blank = isBlank(current) ? current : nullptr;
+    Document *document = addDocument(fileName);
+    showDocument(document);
+    if (blank)
+        removeDocument(blank);
+    document->journal->restart(fileName, document->untitled);
+    statusBar()->showMessage("New file: " + fileName);
+}
+
+void CodeEditor::gotoPosition(int line, int column) {
+    editor->setCursorPosition(line - 1, std::max(column - 1, 0));
+    editor->SendScintilla(QsciScintillaBase::SCI_VERTICALCENTRECARET);
+}
+
+bool CodeEditor::eventFilter(QObject *watched, QEvent *event) {
+    // The first paint of the editor, or of the large file view a file from
+    // the command line opened in, is the first frame that shows text; the
+    // rest of startup runs once it is done.
+    if (firstPaint && event->type() == QEvent::Paint
+        && (watched == editor->viewport() || qobject_cast<LargeFileView *>(watched->parent()))) {
+        firstPaint = false;
+        editor->viewport()->removeEventFilter(this);
+        for (const auto &document : documents) {
+            if (document->viewer)
+                document->viewer->viewport()->removeEventFilter(this);
+        }
+        QTimer::singleShot(0, this, &CodeEditor::finishStartup);
+    }
+    if (event->type() == QEvent::FocusIn && (watched == editor || (pane && watched == pane))) {
+        focused = static_cast<QsciScintilla *>(watched);
+        // The selection shown is the focused pane's.
+        updateStats();
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void CodeEditor::finishStartup() {
+    const qint64 paintMsecs = startupClock.elapsed();
+
+    setupFont();
+    setupLexer();
+    setupMenuBar();
+    // The statistics take their break iterators on the first count; load
+    // ICU's rules for them in the background meanwhile.
+    QThreadPool::globalInstance()->start([] {
+        BreakIteratorPool::instance().hasRootRules(icu::Locale::getDefault());
+    });
+
+    // Set CODEIT_STARTUP_TIME to see where startup goes.
+    if (qEnvironmentVariableIsSet("CODEIT_STARTUP_TIME")) {
+        std::fprintf(stderr, "codeit: window built %lld ms, first paint %lld ms, ready %lld ms\n",
+                     static_cast<long long>(windowMsecs), static_cast<long long>(paintMsecs),
+                     static_cast<long long>(startupClock.elapsed()));
+    }
+    // CODEIT_QUIT_AFTER_STARTUP ends the run here, for the startup check.
+    if (qEnvironmentVariableIsSet("CODEIT_QUIT_AFTER_STARTUP")) {
+        QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+        return;
+    }
+
+    if (startupFile)
+        return;
+    // Each untitled document an earlier session left a journal for gets a
+    // tab to recover it into; the first takes the empty one.
+    Document *first = current;
+    const QList<int> untitled = Journal::untitledJournals();
+    if (!untitled.contains(first->untitled))
+        first->journal->restart(QString(), first->untitled);
+    for (int number : untitled) {
+        Document *document = number == first->untitled ? first : addDocument(QString());
+        document->untitled = number;
+        updateTab(document);
+        showDocument(document);
+        offerRecovery(document);
+        if (document != first && isBlank(document)) {
+            removeDocument(document);
+            continue;
+        }
+        document->journal->restart(QString(), number);
+    }
+    restoreSession();
+}
+
+void CodeEditor::restoreSession() {
+    const Session session = Session::load();
+    Document *blank = isBlank(current) ? current : nullptr;
+    Document *shown = nullptr;
+    for (size_t i = 0; i < session.files.size(); ++i) {
+        const Session::File &saved = session.files[i];
+        // A file that has gone since is left out rather than shown empty.
+        if (documentFor(saved.fileName) || !QFileInfo::exists(saved.fileName))
+            continue;
+        Document *document = addUnloadedDocument(saved.fileName);
+        document->view.anchor = saved.anchor;
+        document->view.caret = saved.caret;
+        document->view.firstLine = saved.firstLine;
+        document->view.xOffset = saved.xOffset;
+        document->view.folds = saved.folds;
+        if (static_cast<int>(i) == session.current || !shown)
+            shown = document;
+    }
+    if (!shown)
+        return;
+    showDocument(shown);
+    if (blank)
+        removeDocument(blank);
+}
+
+void CodeEditor::saveSession() {
+    Session session;
+    for (const auto &document : documents) {
+        if (document->fileName.isEmpty())
+            continue;
+        const bool live = document.get() == current && !document->viewer && !document->loading;
+        const ViewState state = live ? viewState(editor) : document->view;
+        if (document.get() == current)
+            session.current = static_cast<int>(session.files.size());
+        Session::File saved;
+        saved.fileName = QFileInfo(document->fileName).absoluteFilePath();
+        saved.anchor = state.anchor;
+        saved.caret = state.caret;
+        saved.firstLine = state.firstLine;
+        saved.xOffset = state.xOffset;
+        saved.folds = state.folds;
+        session.files.push_back(saved);
+    }
+    QString error;
+    if (!session.save(&error))
+        std::fprintf(stderr, "codeit: cannot save the session: %s\n", error.toLocal8Bit().constData());
+}
+
+void CodeEditor::closeEvent(QCloseEvent *event) {
+    // An editor started for files, as $EDITOR is, leaves the session to
+    // the one that was not.
+    if (!startupFile)
+        saveSession();
+    QMainWindow::closeEvent(event);
+}
+
 int main(int argc, char *argv[]) {
+    QElapsedTimer startupClock;
+    startupClock.start();
+
+    // With --reuse, an editor already running opens the file, and this one
+    // is done before any of Qt starts. Without it the process lives as long
+    // as its window, as $EDITOR needs.
+    std::vector<std::string> rawArguments(argv + 1, argv + argc);
+    if (std::find(rawArguments.begin(), rawArguments.end(), "--reuse") != rawArguments.end()) {
+        std::string workingDirectory;
+#ifdef Q_OS_UNIX
+        if (char *cwd = ::getcwd(nullptr, 0)) {
+            workingDirectory = cwd;
+            std::free(cwd);
+        }
+#endif
+        if (sendToRunningInstance(workingDirectory, rawArguments))
+            return 0;
+    }
+
     QApplication app(argc, argv);
-    CodeEditor editor;
+
+    const std::vector<FileRequest> files = parseArguments(QCoreApplication::arguments().mid(1));
+
+    CodeEditor editor(startupClock);
+    // The first file loads on a worker thread while the window comes up.
+    if (!files.empty())
+        editor.openFromCommandLine(files);
     editor.show();
+
+    // Only the first editor running serves later invocations.
+    InstanceServer server;
+    if (server.listen())
+        QObject::connect(&server, &InstanceServer::received, &editor, &CodeEditor::openFromInstance);
+
     return app.exec();
 }
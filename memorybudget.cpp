@@ -0,0 +1,115 @@
+#include "memorybudget.h"
+
+#include <QWidget>
+
+#include <Qsci/qsciscintillabase.h>
+
+#include <climits>
+#include <cstddef>
+
+namespace {
+
+// Replaces the default if name is set to an integer.
+void readSetting(const char *name, int *value) {
+    bool ok = false;
+    const int set = qEnvironmentVariableIntValue(name, &ok);
+    if (ok)
+        *value = set;
+}
+
+} // namespace
+
+MemoryPolicy MemoryPolicy::fromEnvironment() {
+    MemoryPolicy policy;
+    int megabytes = static_cast<int>(policy.budget >> 20);
+    readSetting("CODEIT_MEMORY_BUDGET", &megabytes);
+    if (megabytes > 0)
+        policy.budget = qint64(megabytes) << 20;
+    readSetting("CODEIT_EVICT_STYLES", &policy.stylesAfter);
+    readSetting("CODEIT_EVICT_UNDO", &policy.undoAfter);
+    readSetting("CODEIT_EVICT_TEXT", &policy.textAfter);
+    return policy;
+}
+
+MemoryBudget::MemoryBudget(QWidget *parent) : QObject(parent) {
+    scratch = new QsciScintillaBase(parent);
+    scratch->hide();
+    idle = reinterpret_cast<void *>(scratch->SendScintilla(QsciScintillaBase::SCI_GETDOCPOINTER));
+    scratch->SendScintilla(QsciScintillaBase::SCI_ADDREFDOCUMENT, 0, idle);
+}
+
+MemoryBudget::~MemoryBudget() {
+    scratch->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, idle);
+}
+
+DocumentMemory MemoryBudget::measure(QsciScintillaBase *view, bool styled) {
+    const qint64 length = view->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const qint64 lines = view->SendScintilla(QsciScintillaBase::SCI_GETLINECOUNT);
+    DocumentMemory memory;
+    memory.text = length;
+    memory.styles = styled ? length : 0;
+    // A line start each; a lexer adds a line state and a fold level.
+    memory.lines = lines * static_cast<qint64>(sizeof(std::ptrdiff_t) + (styled ? 2 * sizeof(int) : 0));
+    return memory;
+}
+
+DocumentMemory MemoryBudget::measure(void *document, bool styled) {
+    attach(document);
+    const DocumentMemory memory = measure(scratch, styled);
+    attach(idle);
+    return memory;
+}
+
+void *MemoryBudget::withoutStyles(void *document) {
+    return copy(document, QsciScintillaBase::SC_DOCUMENTOPTION_STYLES_NONE);
+}
+
+void *MemoryBudget::withStyles(void *document) {
+    return copy(document, QsciScintillaBase::SC_DOCUMENTOPTION_DEFAULT);
+}
+
+void MemoryBudget::forgetUndo(void *document) {
+    attach(document);
+    scratch->SendScintilla(QsciScintillaBase::SCI_EMPTYUNDOBUFFER);
+    attach(idle);
+}
+
+void *MemoryBudget::copy(void *document, int options) {
+    attach(document);
+    const long length = scratch->SendScintilla(QsciScintillaBase::SCI_GETLENGTH);
+    const long eolMode = scratch->SendScintilla(QsciScintillaBase::SCI_GETEOLMODE);
+    // Closes the gap, so the text is one block, which stays where it is
+    // while nobody edits document.
+    const char *text = reinterpret_cast<const char *>(
+        scratch->SendScintilla(QsciScintillaBase::SCI_GETCHARACTERPOINTER));
+    if (length > INT_MAX)
+        options |= QsciScintillaBase::SC_DOCUMENTOPTION_TEXT_LARGE;
+
+    void *copied = reinterpret_cast<void *>(scratch->SendScintilla(
+        QsciScintillaBase::SCI_CREATEDOCUMENT, static_cast<unsigned long>(length), options));
+    if (!copied) {
+        attach(idle);
+        return nullptr;
+    }
+    attach(copied);
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETSTATUS,
+                           static_cast<unsigned long>(QsciScintillaBase::SC_STATUS_OK));
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETUNDOCOLLECTION, 0UL);
+    scratch->SendScintilla(QsciScintillaBase::SCI_APPENDTEXT, static_cast<uintptr_t>(length), text);
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETUNDOCOLLECTION, 1UL);
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETEOLMODE, static_cast<unsigned long>(eolMode));
+    // Scintilla reports running out of memory through the status.
+    const bool failed = scratch->SendScintilla(QsciScintillaBase::SCI_GETSTATUS) != QsciScintillaBase::SC_STATUS_OK;
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETSTATUS,
+                           static_cast<unsigned long>(QsciScintillaBase::SC_STATUS_OK));
+    attach(idle);
+    if (failed) {
+        scratch->SendScintilla(QsciScintillaBase::SCI_RELEASEDOCUMENT, 0, copied);
+        return nullptr;
+    }
+    return copied;
+}
+
+void MemoryBudget::attach(void *document) {
+    scratch->SendScintilla(QsciScintillaBase::SCI_SETDOCPOINTER, 0, document);
+}
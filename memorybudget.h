@@ -0,0 +1,79 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QObject>
+
+class QsciScintillaBase;
+class QWidget;
+
+// How much memory the open documents may take together, and how long one
+// must have been in the background before a stage of eviction takes it. The
+// stages go from the cheapest to undo to the dearest:
+//
+//   styles  the document is copied without style bytes, which halves it;
+//           the styles come back, restyled, when it is shown
+//   undo    the undo history of a document that matches its file is let go
+//   text    the text of a document that matches its file is let go, and
+//           loads from the file again when it is shown
+//
+// A document with unsaved changes is never evicted. The defaults suit a
+// developer VM with 8 GB, which shares them with a compiler and a browser.
+struct MemoryPolicy {
+    qint64 budget = qint64(1024) << 20;
+    // Seconds in the background; negative turns the stage off.
+    int stylesAfter = 30;
+    int undoAfter = 600;
+    int textAfter = 120;
+
+    // The defaults, overridden by CODEIT_MEMORY_BUDGET (MB) and by
+    // CODEIT_EVICT_STYLES, CODEIT_EVICT_UNDO and CODEIT_EVICT_TEXT (seconds).
+    static MemoryPolicy fromEnvironment();
+};
+
+// What a Scintilla document takes, as far as Scintilla lets on. The undo
+// history is counted by the editor, from the edits it saw.
+struct DocumentMemory {
+    qint64 text = 0;
+    qint64 styles = 0;
+    // The line index, and the line states and fold levels of a lexer.
+    qint64 lines = 0;
+    qint64 undo = 0;
+
+    qint64 total() const { return text + styles + lines + undo; }
+};
+
+// Measures and evicts Scintilla documents no view shows, through a hidden
+// view of its own, so that the editor and its listeners never see them.
+class MemoryBudget : public QObject {
+    Q_OBJECT
+
+public:
+    explicit MemoryBudget(QWidget *parent);
+    ~MemoryBudget() override;
+
+    // The document view shows; styled is false for one copied without
+    // style bytes.
+    static DocumentMemory measure(QsciScintillaBase *view, bool styled);
+    DocumentMemory measure(void *document, bool styled);
+
+    // A copy of document without style bytes, or with them, holding one
+    // reference, or null if there is not enough memory for it. The copy
+    // has no undo history; the caller releases document.
+    void *withoutStyles(void *document);
+    void *withStyles(void *document);
+
+    // Lets go of the undo and redo history of document. One that matched
+    // its file still does.
+    void forgetUndo(void *document);
+
+private:
+    void *copy(void *document, int options);
+    void attach(void *document);
+
+    QsciScintillaBase *scratch;
+    // The document the scratch view was made with, which it holds between
+    // jobs.
+    void *idle;
+};
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,81 @@
+#include "memorypanel.h"
+
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+namespace {
+
+QString megabytes(qint64 bytes) {
+    return QString::number(bytes / double(1 << 20), 'f', 1);
+}
+
+} // namespace
+
+MemoryPanel::MemoryPanel(QWidget *parent) : QDockWidget("Memory", parent) {
+    setObjectName("memoryPanel");
+
+    table = new QTableWidget(0, 8);
+    table->setHorizontalHeaderLabels({"Document", "State", "Text (MB)", "Styles (MB)", "Lines (MB)",
+                                      "Undo (MB)", "Total (MB)", "Idle (s)"});
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->hide();
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    totalLabel = new QLabel;
+
+    budgetBox = new QSpinBox;
+    budgetBox->setRange(64, 1 << 20);
+    budgetBox->setSingleStep(64);
+    budgetBox->setSuffix(" MB");
+    connect(budgetBox, &QSpinBox::valueChanged, this, [this](int value) {
+        if ((qint64(value) << 20) != budget)
+            emit budgetChanged(qint64(value) << 20);
+    });
+
+    auto *controls = new QHBoxLayout;
+    controls->addWidget(totalLabel, 1);
+    controls->addWidget(new QLabel("Budget:"));
+    controls->addWidget(budgetBox);
+
+    auto *contents = new QWidget;
+    auto *layout = new QVBoxLayout(contents);
+    layout->addWidget(table);
+    layout->addLayout(controls);
+    setWidget(contents);
+}
+
+void MemoryPanel::setBudget(qint64 bytes) {
+    budget = bytes;
+    budgetBox->setValue(static_cast<int>(bytes >> 20));
+}
+
+void MemoryPanel::setRows(const std::vector<Row> &rows) {
+    table->setRowCount(static_cast<int>(rows.size()));
+    qint64 total = 0;
+    for (int row = 0; row < static_cast<int>(rows.size()); ++row) {
+        const Row &r = rows[row];
+        const DocumentMemory &m = r.memory;
+        const QString values[] = {r.name, r.state, megabytes(m.text), megabytes(m.styles),
+                                  megabytes(m.lines), megabytes(m.undo), megabytes(m.total()),
+                                  r.idleMsecs < 0 ? QString() : QString::number(r.idleMsecs / 1000)};
+        for (int column = 0; column < 8; ++column) {
+            QTableWidgetItem *item = table->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                if (column >= 2)
+                    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                table->setItem(row, column, item);
+            }
+            item->setText(values[column]);
+        }
+        total += m.total();
+    }
+    totalLabel->setText(QString("%1 MB of %2 MB in %3 documents")
+                            .arg(megabytes(total))
+                            .arg(budget >> 20)
+                            .arg(rows.size()));
+}
@@ -0,0 +1,45 @@
+#ifndef MEMORYPANEL_H
+#define MEMORYPANEL_H
+
+#include <QDockWidget>
+#include <QString>
+
+#include <vector>
+
+#include "memorybudget.h"
+
+class QLabel;
+class QSpinBox;
+class QTableWidget;
+
+// Debug panel with what each open document takes in memory, against the
+// budget, which it lets the user change.
+class MemoryPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    struct Row {
+        QString name;
+        // Shown, in memory, or how far eviction took it.
+        QString state;
+        DocumentMemory memory;
+        // Milliseconds in the background; -1 for the document shown.
+        qint64 idleMsecs = -1;
+    };
+
+    explicit MemoryPanel(QWidget *parent = nullptr);
+
+    void setBudget(qint64 budget);
+    void setRows(const std::vector<Row> &rows);
+
+signals:
+    void budgetChanged(qint64 budget);
+
+private:
+    QTableWidget *table;
+    QLabel *totalLabel;
+    QSpinBox *budgetBox;
+    qint64 budget = 0;
+};
+
+#endif // MEMORYPANEL_H
@@ -0,0 +1,321 @@
+#include "piecetree.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "textscan.h"
+
+struct PieceTree::Node {
+    Piece piece;
+    uint32_t priority;
+    // Of the whole subtree.
+    int64_t bytes;
+    int64_t lineFeeds;
+    Node *left = nullptr;
+    Node *right = nullptr;
+};
+
+namespace {
+
+int64_t countLineFeeds(const char *data, int64_t length) {
+    return static_cast<int64_t>(textscan::countLineFeeds(data, static_cast<size_t>(length)));
+}
+
+// Offset of the count-th LF in data; there must be that many. Whole blocks
+// are skipped by their count, so the search is as fast as the SIMD count.
+int64_t findLineFeed(const char *data, int64_t length, int64_t count) {
+    constexpr int64_t blockBytes = 4096;
+    int64_t at = 0;
+    for (;;) {
+        const int64_t n = std::min(blockBytes, length - at);
+        const int64_t feeds = countLineFeeds(data + at, n);
+        if (feeds >= count)
+            break;
+        count -= feeds;
+        at += n;
+    }
+
+    const char *p = data + at;
+    for (;;) {
+        p = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(data + length - p)));
+        if (--count == 0)
+            return p - data;
+        ++p;
+    }
+}
+
+} // namespace
+
+PieceTree::PieceTree() = default;
+
+PieceTree::~PieceTree() {
+    destroy(root);
+}
+
+void PieceTree::clear() {
+    destroy(root);
+    root = nullptr;
+    blocks.clear();
+    blockEnd = nullptr;
+    blockFree = 0;
+}
+
+int64_t PieceTree::length() const {
+    return root ? root->bytes : 0;
+}
+
+int64_t PieceTree::lineCount() const {
+    return (root ? root->lineFeeds : 0) + 1;
+}
+
+PieceTree::Node *PieceTree::makeNode(const Piece &piece) {
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    Node *node = new Node{piece, seed, piece.length, piece.lineFeeds};
+    return node;
+}
+
+void PieceTree::update(Node *node) {
+    node->bytes = node->piece.length;
+    node->lineFeeds = node->piece.lineFeeds;
+    for (const Node *child : {node->left, node->right}) {
+        if (child) {
+            node->bytes += child->bytes;
+            node->lineFeeds += child->lineFeeds;
+        }
+    }
+}
+
+PieceTree::Node *PieceTree::merge(Node *left, Node *right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+    if (left->priority > right->priority) {
+        left->right = merge(left->right, right);
+        update(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+}
+
+void PieceTree::split(Node *node, int64_t offset, Node *&left, Node *&right) {
+    if (!node) {
+        left = right = nullptr;
+        return;
+    }
+
+    const int64_t leftBytes = node->left ? node->left->bytes : 0;
+    const Piece piece = node->piece;
+    if (offset <= leftBytes) {
+        split(node->left, offset, left, node->left);
+        update(node);
+        right = node;
+    } else if (offset >= leftBytes + piece.length) {
+        split(node->right, offset - leftBytes - piece.length, node->right, right);
+        update(node);
+        left = node;
+    } else {
+        // Count the line feeds of the shorter half; the other half has the rest.
+        const int64_t at = offset - leftBytes;
+        const int64_t headFeeds = at <= piece.length / 2
+            ? countLineFeeds(piece.data, at)
+            : piece.lineFeeds - countLineFeeds(piece.data + at, piece.length - at);
+
+        Node *tail = makeNode({piece.data + at, piece.length - at, piece.lineFeeds - headFeeds});
+        right = merge(tail, node->right);
+        node->piece = {piece.data, at, headFeeds};
+        node->right = nullptr;
+        update(node);
+        left = node;
+    }
+}
+
+bool PieceTree::extendLast(Node *node, const char *data, int64_t length, int64_t lineFeeds) {
+    if (!node)
+        return false;
+    if (node->right) {
+        if (!extendLast(node->right, data, length, lineFeeds))
+            return false;
+    } else {
+        Piece &piece = node->piece;
+        if (piece.data + piece.length != data || piece.length + length > maxPieceBytes)
+            return false;
+        piece.length += length;
+        piece.lineFeeds += lineFeeds;
+    }
+    node->bytes += length;
+    node->lineFeeds += lineFeeds;
+    return true;
+}
+
+void PieceTree::collect(const Node *node, std::vector<Piece> &pieces) {
+    if (!node)
+        return;
+    collect(node->left, pieces);
+    pieces.push_back(node->piece);
+    collect(node->right, pieces);
+}
+
+void PieceTree::destroy(Node *node) {
+    if (!node)
+        return;
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+void PieceTree::copyRange(const Node *node, int64_t from, int64_t to, std::string &out) {
+    if (!node || from >= to)
+        return;
+    const int64_t leftBytes = node->left ? node->left->bytes : 0;
+    if (from < leftBytes)
+        copyRange(node->left, from, std::min(to, leftBytes), out);
+
+    const int64_t begin = std::max(from, leftBytes);
+    const int64_t end = std::min(to, leftBytes + node->piece.length);
+    if (begin < end)
+        out.append(node->piece.data + (begin - leftBytes), static_cast<size_t>(end - begin));
+
+    const int64_t rightStart = leftBytes + node->piece.length;
+    if (to > rightStart)
+        copyRange(node->right, std::max<int64_t>(0, from - rightStart), to - rightStart, out);
+}
+
+void PieceTree::append(const char *data, int64_t length, int64_t lineFeeds) {
+    for (int64_t done = 0; done < length;) {
+        const int64_t n = std::min(maxPieceBytes, length - done);
+        const int64_t feeds = lineFeeds >= 0 && n == length ? lineFeeds : countLineFeeds(data + done, n);
+        root = merge(root, makeNode({data + done, n, feeds}));
+        done += n;
+    }
+}
+
+int64_t PieceTree::lineStart(int64_t line) const {
+    line = std::min(line, lineCount() - 1);
+    if (line <= 0)
+        return 0;
+
+    // Find the offset just past the line-th line feed.
+    int64_t base = 0;
+    for (const Node *node = root; node;) {
+        const int64_t leftFeeds = node->left ? node->left->lineFeeds : 0;
+        if (line <= leftFeeds) {
+            node = node->left;
+            continue;
+        }
+        line -= leftFeeds;
+        base += node->left ? node->left->bytes : 0;
+
+        const Piece &piece = node->piece;
+        if (line <= piece.lineFeeds)
+            return base + findLineFeed(piece.data, piece.length, line) + 1;
+        line -= piece.lineFeeds;
+        base += piece.length;
+        node = node->right;
+    }
+    return base;
+}
+
+int64_t PieceTree::lineFromOffset(int64_t offset) const {
+    // Count the line feeds before offset.
+    int64_t line = 0;
+    for (const Node *node = root; node;) {
+        const int64_t leftBytes = node->left ? node->left->bytes : 0;
+        if (offset < leftBytes) {
+            node = node->left;
+            continue;
+        }
+        offset -= leftBytes;
+        line += node->left ? node->left->lineFeeds : 0;
+
+        const Piece &piece = node->piece;
+        if (offset < piece.length)
+            return line + countLineFeeds(piece.data, offset);
+        offset -= piece.length;
+        line += piece.lineFeeds;
+        node = node->right;
+    }
+    return line;
+}
+
+std::string PieceTree::text(int64_t offset, int64_t length) const {
+    std::string out;
+    offset = std::max<int64_t>(0, offset);
+    const int64_t end = std::min(this->length(), offset + length);
+    if (offset < end) {
+        out.reserve(static_cast<size_t>(end - offset));
+        copyRange(root, offset, end, out);
+    }
+    return out;
+}
+
+std::vector<PieceTree::Span> PieceTree::spans() const {
+    std::vector<Piece> pieces;
+    collect(root, pieces);
+    std::vector<Span> spans;
+    spans.reserve(pieces.size());
+    for (const Piece &piece : pieces)
+        spans.push_back({piece.data, piece.length});
+    return spans;
+}
+
+const char *PieceTree::store(const char *text, int64_t length) {
+    if (length > blockFree) {
+        const int64_t size = std::max(maxPieceBytes, length);
+        blocks.push_back(std::make_unique<char[]>(static_cast<size_t>(size)));
+        blockEnd = blocks.back().get();
+        blockFree = size;
+    }
+    char *data = blockEnd;
+    std::memcpy(data, text, static_cast<size_t>(length));
+    blockEnd += length;
+    blockFree -= length;
+    return data;
+}
+
+void PieceTree::insert(int64_t offset, const char *text, int64_t length) {
+    offset = std::clamp<int64_t>(offset, 0, this->length());
+    for (int64_t done = 0; done < length;) {
+        const int64_t n = std::min(maxPieceBytes, length - done);
+        const char *data = store(text + done, n);
+        const int64_t feeds = countLineFeeds(data, n);
+
+        Node *left, *right;
+        split(root, offset, left, right);
+        if (!extendLast(left, data, n, feeds))
+            left = merge(left, makeNode({data, n, feeds}));
+        root = merge(left, right);
+
+        offset += n;
+        done += n;
+    }
+}
+
+std::vector<PieceTree::Piece> PieceTree::remove(int64_t offset, int64_t length) {
+    offset = std::clamp<int64_t>(offset, 0, this->length());
+    length = std::clamp<int64_t>(length, 0, this->length() - offset);
+
+    Node *left, *middle, *right;
+    split(root, offset, left, middle);
+    split(middle, length, middle, right);
+    std::vector<Piece> pieces;
+    collect(middle, pieces);
+    destroy(middle);
+    root = merge(left, right);
+    return pieces;
+}
+
+void PieceTree::insertPieces(int64_t offset, const std::vector<Piece> &pieces) {
+    Node *inserted = nullptr;
+    for (const Piece &piece : pieces)
+        inserted = merge(inserted, makeNode(piece));
+
+    Node *left, *right;
+    split(root, std::clamp<int64_t>(offset, 0, length()), left, right);
+    root = merge(merge(left, inserted), right);
+}
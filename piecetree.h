@@ -0,0 +1,102 @@
+#ifndef PIECETREE_H
+#define PIECETREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Text of a file too large to hold in memory, as a sequence of pieces. A
+// piece is a run of bytes either in the original file, which stays mapped
+// and is never written to, or in an append-only buffer that receives every
+// insertion. Editing splits and reorders pieces and copies no file text, so
+// memory grows only with the edits.
+//
+// The pieces form a treap ordered by position. Each node caches the bytes
+// and line feeds of its subtree, so finding an offset or a line, inserting
+// and removing all take time logarithmic in the number of pieces. Pieces
+// hold at most maxPieceBytes, which bounds the scans within one piece.
+//
+// Lines end at LF; a CR before it belongs to the line. Not thread-safe:
+// readers on other threads must work from spans(), whose data stays valid
+// for the lifetime of the tree.
+class PieceTree {
+public:
+    struct Piece {
+        const char *data;
+        int64_t length;
+        int64_t lineFeeds;
+    };
+
+    struct Span {
+        const char *data;
+        int64_t length;
+    };
+
+    static constexpr int64_t maxPieceBytes = 1 << 20;
+
+    PieceTree();
+    ~PieceTree();
+
+    PieceTree(const PieceTree &) = delete;
+    PieceTree &operator=(const PieceTree &) = delete;
+
+    // Appends data, which must outlive the tree, in pieces of maxPieceBytes.
+    // lineFeeds, if not negative, is the number of LF bytes in data.
+    void append(const char *data, int64_t length, int64_t lineFeeds = -1);
+
+    void clear();
+
+    int64_t length() const;
+    // Number of lines, one more than the number of line feeds.
+    int64_t lineCount() const;
+
+    // Offset of the first byte of line, clamped to the last line.
+    int64_t lineStart(int64_t line) const;
+    // Line holding the byte at offset.
+    int64_t lineFromOffset(int64_t offset) const;
+
+    // Copies up to length bytes from offset.
+    std::string text(int64_t offset, int64_t length) const;
+    // The text as spans in order.
+    std::vector<Span> spans() const;
+
+    // Copies text into the append buffer and inserts it at offset.
+    void insert(int64_t offset, const char *text, int64_t length);
+    // Removes length bytes at offset and returns their pieces, which
+    // insertPieces() puts back, as for undo.
+    std::vector<Piece> remove(int64_t offset, int64_t length);
+    void insertPieces(int64_t offset, const std::vector<Piece> &pieces);
+
+private:
+    struct Node;
+
+    Node *makeNode(const Piece &piece);
+    // Splits node into the first offset bytes and the rest, splitting the
+    // piece across offset if needed.
+    void split(Node *node, int64_t offset, Node *&left, Node *&right);
+    static Node *merge(Node *left, Node *right);
+    static void update(Node *node);
+    static void collect(const Node *node, std::vector<Piece> &pieces);
+    // Appends the bytes of node in [from, to), relative to its subtree.
+    static void copyRange(const Node *node, int64_t from, int64_t to, std::string &out);
+    static void destroy(Node *node);
+    // Extends the last piece of node by bytes if it ends where data starts,
+    // the way a run of typing grows one piece.
+    static bool extendLast(Node *node, const char *data, int64_t length, int64_t lineFeeds);
+
+    // Appends text to the append buffer and returns where it went.
+    const char *store(const char *text, int64_t length);
+
+    Node *root = nullptr;
+    uint32_t seed = 0x9E3779B9;
+
+    // Blocks of the append buffer. Text is never moved or freed before the
+    // tree, so pieces and spans can point into it.
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *blockEnd = nullptr;
+    int64_t blockFree = 0;
+};
+
+#endif // PIECETREE_H
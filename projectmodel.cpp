@@ -0,0 +1,292 @@
+#include "projectmodel.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QStyle>
+
+#include <algorithm>
+
+namespace {
+
+// How long the watcher waits for a burst of changes to settle, in
+// milliseconds.
+constexpr int settleMsecs = 200;
+
+} // namespace
+
+ProjectModel::ProjectModel(QObject *parent) : QAbstractItemModel(parent) {
+    scanner = new DirectoryScanner(this);
+    connect(scanner, &DirectoryScanner::listed, this, &ProjectModel::handleListed);
+
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &ProjectModel::handleDirectoryChanged);
+    settle.setSingleShot(true);
+    settle.setInterval(settleMsecs);
+    connect(&settle, &QTimer::timeout, this, &ProjectModel::listChanged);
+
+    directoryIcon = QApplication::style()->standardIcon(QStyle::SP_DirIcon);
+    fileIcon = QApplication::style()->standardIcon(QStyle::SP_FileIcon);
+}
+
+ProjectModel::~ProjectModel() = default;
+
+void ProjectModel::setRoot(const QString &root) {
+    beginResetModel();
+    if (rootNode)
+        forget(rootNode.get());
+    changed.clear();
+    rootPath = QDir::cleanPath(QFileInfo(root).absoluteFilePath());
+    rootNode = std::make_unique<Node>();
+    rootNode->name = QFileInfo(rootPath).fileName();
+    rootNode->isDirectory = true;
+    scanner->setRoot(rootPath);
+    endResetModel();
+    // The top level is wanted at once; the rest waits to be expanded.
+    list(rootNode.get());
+}
+
+QString ProjectModel::filePath(const QModelIndex &index) const {
+    const Node *node = nodeOf(index);
+    return node ? absolutePath(node) : QString();
+}
+
+bool ProjectModel::isDirectory(const QModelIndex &index) const {
+    const Node *node = nodeOf(index);
+    return node && node->isDirectory;
+}
+
+QModelIndex ProjectModel::index(int row, int column, const QModelIndex &parent) const {
+    const Node *node = nodeOf(parent);
+    if (!node || column != 0 || row < 0 || row >= static_cast<int>(node->children.size()))
+        return QModelIndex();
+    return createIndex(row, 0, node->children[row].get());
+}
+
+QModelIndex ProjectModel::parent(const QModelIndex &index) const {
+    if (!index.isValid())
+        return QModelIndex();
+    return indexOf(nodeOf(index)->parent);
+}
+
+int ProjectModel::rowCount(const QModelIndex &parent) const {
+    const Node *node = nodeOf(parent);
+    if (!node || parent.column() > 0)
+        return 0;
+    return static_cast<int>(node->children.size());
+}
+
+int ProjectModel::columnCount(const QModelIndex &) const {
+    return 1;
+}
+
+QVariant ProjectModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid())
+        return QVariant();
+    const Node *node = nodeOf(index);
+    switch (role) {
+    case Qt::DisplayRole:
+        return node->name;
+    case Qt::DecorationRole:
+        return node->isDirectory ? directoryIcon : fileIcon;
+    case Qt::ToolTipRole:
+        return absolutePath(node);
+    default:
+        return QVariant();
+    }
+}
+
+bool ProjectModel::hasChildren(const QModelIndex &parent) const {
+    const Node *node = nodeOf(parent);
+    // A directory not listed yet may have children; the view asks for them
+    // when it is expanded.
+    return node && node->isDirectory && (node->state != Node::Listed || !node->children.empty());
+}
+
+bool ProjectModel::canFetchMore(const QModelIndex &parent) const {
+    const Node *node = nodeOf(parent);
+    return node && node->isDirectory && node->state == Node::Unlisted;
+}
+
+void ProjectModel::fetchMore(const QModelIndex &parent) {
+    Node *node = nodeOf(parent);
+    if (node && node->isDirectory && node->state == Node::Unlisted)
+        list(node);
+}
+
+ProjectModel::Node *ProjectModel::nodeOf(const QModelIndex &index) const {
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : rootNode.get();
+}
+
+QModelIndex ProjectModel::indexOf(const Node *node) const {
+    if (!node || node == rootNode.get())
+        return QModelIndex();
+    return createIndex(node->row, 0, node);
+}
+
+QString ProjectModel::relativePath(const Node *node) const {
+    QString path;
+    for (; node && node != rootNode.get(); node = node->parent)
+        path.prepend(node->isDirectory ? node->name + "/" : node->name);
+    return path;
+}
+
+QString ProjectModel::absolutePath(const Node *node) const {
+    QString path = rootPath;
+    const QString relative = relativePath(node);
+    if (!relative.isEmpty())
+        path += "/" + relative;
+    if (path.endsWith("/") && path.size() > 1)
+        path.chop(1);
+    return path;
+}
+
+void ProjectModel::list(Node *node) {
+    if (node->state == Node::Unlisted)
+        node->state = Node::Listing;
+    node->relisted.clear();
+    node->request = scanner->list(relativePath(node));
+    pending.insert(node->request, node);
+}
+
+void ProjectModel::handleListed(const DirectoryScanner::Listing &listing) {
+    Node *node = pending.value(listing.request);
+    if (!node)
+        return;
+
+    if (node->state == Node::Listing) {
+        // The batches come in order, so each goes at the end.
+        insertChildren(node, static_cast<int>(node->children.size()), listing.entries);
+    } else {
+        node->relisted.insert(node->relisted.end(), listing.entries.begin(), listing.entries.end());
+    }
+    if (!listing.done)
+        return;
+
+    pending.remove(listing.request);
+    node->request = 0;
+    if (node->state == Node::Listing) {
+        node->state = Node::Listed;
+        const QString path = absolutePath(node);
+        watched.insert(path, node);
+        watcher->addPath(path);
+    } else {
+        merge(node, std::move(node->relisted));
+        node->relisted.clear();
+    }
+
+    // What the old rules hid or showed below may be wrong now.
+    if (listing.rulesChanged) {
+        const QString below = absolutePath(node) + "/";
+        for (auto it = watched.constBegin(); it != watched.constEnd(); ++it) {
+            if (it.key().startsWith(below) && !it.value()->request)
+                list(it.value());
+        }
+    }
+    if (node->stale) {
+        node->stale = false;
+        list(node);
+    }
+}
+
+void ProjectModel::handleDirectoryChanged(const QString &path) {
+    changed.insert(path);
+    settle.start();
+}
+
+void ProjectModel::listChanged() {
+    for (const QString &path : changed) {
+        Node *node = watched.value(path);
+        if (!node)
+            continue;
+        if (node->request)
+            node->stale = true;
+        else
+            list(node);
+    }
+    changed.clear();
+}
+
+void ProjectModel::insertChildren(Node *node, int row, std::vector<DirectoryScanner::Entry> entries) {
+    if (entries.empty())
+        return;
+    const int count = static_cast<int>(entries.size());
+    beginInsertRows(indexOf(node), row, row + count - 1);
+    std::vector<std::unique_ptr<Node>> added;
+    added.reserve(entries.size());
+    for (DirectoryScanner::Entry &entry : entries) {
+        auto child = std::make_unique<Node>();
+        child->name = std::move(entry.name);
+        child->isDirectory = entry.isDirectory;
+        child->parent = node;
+        added.push_back(std::move(child));
+    }
+    node->children.insert(node->children.begin() + row, std::make_move_iterator(added.begin()),
+                          std::make_move_iterator(added.end()));
+    for (int i = row; i < static_cast<int>(node->children.size()); ++i)
+        node->children[i]->row = i;
+    endInsertRows();
+}
+
+void ProjectModel::removeChildren(Node *node, int row, int count) {
+    if (count <= 0)
+        return;
+    beginRemoveRows(indexOf(node), row, row + count - 1);
+    for (int i = row; i < row + count; ++i)
+        forget(node->children[i].get());
+    node->children.erase(node->children.begin() + row, node->children.begin() + row + count);
+    for (int i = row; i < static_cast<int>(node->children.size()); ++i)
+        node->children[i]->row = i;
+    endRemoveRows();
+}
+
+void ProjectModel::merge(Node *node, std::vector<DirectoryScanner::Entry> entries) {
+    auto entryOf = [node](size_t i) {
+        return DirectoryScanner::Entry{node->children[i]->name, node->children[i]->isDirectory};
+    };
+    // Walks both in step, taking out what has gone and putting in what is
+    // new a run at a time; what is in both stays, with what is below it.
+    size_t i = 0;
+    size_t j = 0;
+    while (i < node->children.size() || j < entries.size()) {
+        size_t gone = 0;
+        while (i + gone < node->children.size()
+               && (j == entries.size() || DirectoryScanner::lessThan(entryOf(i + gone), entries[j])))
+            ++gone;
+        if (gone > 0) {
+            removeChildren(node, static_cast<int>(i), static_cast<int>(gone));
+            continue;
+        }
+        size_t added = 0;
+        while (j + added < entries.size()
+               && (i == node->children.size() || DirectoryScanner::lessThan(entries[j + added], entryOf(i))))
+            ++added;
+        if (added > 0) {
+            std::vector<DirectoryScanner::Entry> run(std::make_move_iterator(entries.begin() + j),
+                                                     std::make_move_iterator(entries.begin() + j + added));
+            insertChildren(node, static_cast<int>(i), std::move(run));
+            i += added;
+            j += added;
+            continue;
+        }
+        ++i;
+        ++j;
+    }
+}
+
+void ProjectModel::forget(Node *node) {
+    if (node->request) {
+        pending.remove(node->request);
+        node->request = 0;
+    }
+    if (node->state == Node::Listed) {
+        const QString path = absolutePath(node);
+        watched.remove(path);
+        watcher->removePath(path);
+    }
+    for (const auto &child : node->children) {
+        if (child->isDirectory)
+            forget(child.get());
+    }
+}
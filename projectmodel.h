@@ -0,0 +1,102 @@
+#ifndef PROJECTMODEL_H
+#define PROJECTMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include <memory>
+#include <vector>
+
+#include "directoryscanner.h"
+
+class QFileSystemWatcher;
+
+// The files of a project as a tree, listed only as far as the view goes: a
+// directory is listed the first time it is expanded, by a DirectoryScanner,
+// and its entries go in as the batches come. Only the root is listed up
+// front, so a project of any size shows its top level at once.
+//
+// Each directory listed is watched, through inotify on Linux, and listed
+// again when it changes; the new listing is merged into the old one, so
+// what is expanded stays expanded.
+class ProjectModel : public QAbstractItemModel {
+    Q_OBJECT
+
+public:
+    explicit ProjectModel(QObject *parent = nullptr);
+    ~ProjectModel() override;
+
+    QString root() const { return rootPath; }
+    // Shows the directory root, dropping what was shown before.
+    void setRoot(const QString &root);
+
+    QString filePath(const QModelIndex &index) const;
+    bool isDirectory(const QModelIndex &index) const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+private slots:
+    void handleListed(const DirectoryScanner::Listing &listing);
+    void handleDirectoryChanged(const QString &path);
+    void listChanged();
+
+private:
+    struct Node {
+        enum State { Unlisted, Listing, Listed };
+
+        QString name;
+        bool isDirectory = false;
+        Node *parent = nullptr;
+        // Its place among its parent's children.
+        int row = 0;
+        std::vector<std::unique_ptr<Node>> children;
+        State state = Unlisted;
+        // The listing under way, if any.
+        quint64 request = 0;
+        // Of a directory listed again: the entries so far.
+        std::vector<DirectoryScanner::Entry> relisted;
+        // Changed while being listed, so to be listed again.
+        bool stale = false;
+    };
+
+    Node *nodeOf(const QModelIndex &index) const;
+    QModelIndex indexOf(const Node *node) const;
+    // Relative to the root, with a / after each directory.
+    QString relativePath(const Node *node) const;
+    QString absolutePath(const Node *node) const;
+    void list(Node *node);
+    // Inserts entries as children of node from row on.
+    void insertChildren(Node *node, int row, std::vector<DirectoryScanner::Entry> entries);
+    void removeChildren(Node *node, int row, int count);
+    // Makes node's children match entries, which are in the same order.
+    void merge(Node *node, std::vector<DirectoryScanner::Entry> entries);
+    // Drops the listings and watches of node and everything below it.
+    void forget(Node *node);
+
+    DirectoryScanner *scanner;
+    QFileSystemWatcher *watcher;
+    // Collects the changes of a burst, like a checkout, into one listing
+    // per directory.
+    QTimer settle;
+    QSet<QString> changed;
+    QString rootPath;
+    std::unique_ptr<Node> rootNode;
+    QHash<quint64, Node *> pending;
+    // The directories listed, which are watched, by absolute path.
+    QHash<QString, Node *> watched;
+    QIcon directoryIcon;
+    QIcon fileIcon;
+};
+
+#endif // PROJECTMODEL_H
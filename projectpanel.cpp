@@ -0,0 +1,33 @@
+#include "projectpanel.h"
+
+#include <QFileInfo>
+#include <QTreeView>
+
+#include "projectmodel.h"
+
+ProjectPanel::ProjectPanel(QWidget *parent) : QDockWidget("Project", parent) {
+    setObjectName("projectPanel");
+
+    model = new ProjectModel(this);
+    tree = new QTreeView;
+    tree->setHeaderHidden(true);
+    // Rows of one height spare the view measuring each of a huge directory.
+    tree->setUniformRowHeights(true);
+    tree->setModel(model);
+    connect(tree, &QTreeView::activated, this, &ProjectPanel::handleActivated);
+    setWidget(tree);
+}
+
+QString ProjectPanel::folder() const {
+    return model->root();
+}
+
+void ProjectPanel::openFolder(const QString &path) {
+    model->setRoot(path);
+    setWindowTitle("Project: " + QFileInfo(model->root()).fileName());
+}
+
+void ProjectPanel::handleActivated(const QModelIndex &index) {
+    if (index.isValid() && !model->isDirectory(index))
+        emit fileActivated(model->filePath(index));
+}
@@ -0,0 +1,33 @@
+#ifndef PROJECTPANEL_H
+#define PROJECTPANEL_H
+
+#include <QDockWidget>
+#include <QString>
+
+class ProjectModel;
+class QModelIndex;
+class QTreeView;
+
+// The files of a project folder as a tree, which opens a file when it is
+// activated. See ProjectModel for how the tree is listed.
+class ProjectPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    explicit ProjectPanel(QWidget *parent = nullptr);
+
+    QString folder() const;
+    void openFolder(const QString &path);
+
+signals:
+    void fileActivated(const QString &fileName);
+
+private slots:
+    void handleActivated(const QModelIndex &index);
+
+private:
+    ProjectModel *model;
+    QTreeView *tree;
+};
+
+#endif // PROJECTPANEL_H
@@ -0,0 +1,91 @@
+#include "session.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cstring>
+
+namespace {
+
+// Starts every session file, so that a stray file is never taken for one.
+constexpr char magic[8] = {'C', 'O', 'D', 'E', 'I', 'T', 'S', '1'};
+
+} // namespace
+
+QString Session::path() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/session";
+}
+
+Session Session::load() {
+    QFile file(path());
+    if (!file.open(QIODevice::ReadOnly))
+        return Session();
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    char head[sizeof magic];
+    if (in.readRawData(head, sizeof head) != sizeof head || std::memcmp(head, magic, sizeof magic) != 0)
+        return Session();
+
+    Session session;
+    qint32 current = -1;
+    qint32 count = 0;
+    in >> current >> count;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        File saved;
+        qint64 anchor = 0;
+        qint64 caret = 0;
+        qint64 firstLine = 0;
+        qint64 xOffset = 0;
+        qint32 folds = 0;
+        in >> saved.fileName >> anchor >> caret >> firstLine >> xOffset >> folds;
+        for (qint32 f = 0; f < folds && in.status() == QDataStream::Ok; ++f) {
+            qint64 line = 0;
+            in >> line;
+            saved.folds.push_back(static_cast<long>(line));
+        }
+        saved.anchor = static_cast<long>(anchor);
+        saved.caret = static_cast<long>(caret);
+        saved.firstLine = static_cast<long>(firstLine);
+        saved.xOffset = static_cast<long>(xOffset);
+        session.files.push_back(saved);
+    }
+    // A session cut short is no session.
+    if (in.status() != QDataStream::Ok)
+        return Session();
+    session.current = current < static_cast<qint32>(session.files.size()) ? current : -1;
+    return session;
+}
+
+bool Session::save(QString *error) const {
+    QDir().mkpath(QFileInfo(path()).absolutePath());
+    // Written next to the old one and renamed over it, so a crash leaves
+    // one or the other.
+    QSaveFile file(path());
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out.writeRawData(magic, sizeof magic);
+    out << qint32(current) << qint32(files.size());
+    for (const File &saved : files) {
+        out << saved.fileName << qint64(saved.anchor) << qint64(saved.caret) << qint64(saved.firstLine)
+            << qint64(saved.xOffset) << qint32(saved.folds.size());
+        for (long line : saved.folds)
+            out << qint64(line);
+    }
+    if (!file.commit()) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
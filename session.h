@@ -0,0 +1,37 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QString>
+
+#include <vector>
+
+// The files open when the editor last closed, which the next editor opens
+// again, each where its view was. Untitled documents are not part of it;
+// their journals bring them back.
+struct Session {
+    struct File {
+        QString fileName;
+        long anchor = 0;
+        long caret = 0;
+        long firstLine = 0;
+        long xOffset = 0;
+        // The lines whose folds were contracted.
+        std::vector<long> folds;
+    };
+
+    // In the order of their tabs.
+    std::vector<File> files;
+    // The tab that was current, or -1.
+    int current = -1;
+
+    // The session saved last; an empty one if there is none, or it cannot
+    // be read.
+    static Session load();
+    // Replaces the session saved last. Returns false and sets error if it
+    // cannot be written.
+    bool save(QString *error) const;
+
+    static QString path();
+};
+
+#endif // SESSION_H
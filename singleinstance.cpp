@@ -0,0 +1,192 @@
+#include "singleinstance.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// More than any command line needs; a client sending more is dropped.
+constexpr qint64 maxMessageBytes = 1 << 20;
+
+#ifdef Q_OS_UNIX
+// Whether path itself, not what a link points to, is a socket the user owns.
+bool isOwnSocket(const std::string &path) {
+    struct stat status;
+    return ::lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode) && status.st_uid == ::getuid();
+}
+
+// Whether the process at the other end of fd runs as the user.
+bool isOwnPeer(int fd) {
+#if defined(Q_OS_LINUX)
+    ucred credentials{};
+    socklen_t length = sizeof credentials;
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0
+        && credentials.uid == ::getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return ::getpeereid(fd, &uid, &gid) == 0 && uid == ::getuid();
+#endif
+}
+
+// The directory the socket goes in: $XDG_RUNTIME_DIR, which is the user's
+// own, or else /tmp/codeit-<uid>, made if missing. Empty if that directory
+// belongs to someone else or is open to others, who could put their own
+// socket in it.
+std::string socketDirectory() {
+    const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+        return runtime;
+    const std::string dir = "/tmp/codeit-" + std::to_string(::getuid());
+    if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+        return std::string();
+    struct stat status;
+    if (::lstat(dir.c_str(), &status) != 0 || !S_ISDIR(status.st_mode) || status.st_uid != ::getuid()
+        || (status.st_mode & 077) != 0)
+        return std::string();
+    return dir;
+}
+
+// A socket connected to path, or -1. Only a socket of the user's, with an
+// editor of the user's at the other end, qualifies; anyone else listening
+// there would be sent the user's file names.
+int connectTo(const std::string &path) {
+    if (!isOwnSocket(path))
+        return -1;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path)
+        return -1;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof address) != 0
+        || !isOwnPeer(fd)) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+} // namespace
+
+std::string instanceSocketPath() {
+#ifdef Q_OS_UNIX
+    const std::string dir = socketDirectory();
+    if (dir.empty())
+        return std::string();
+    return dir + "/codeit-" + std::to_string(::getuid()) + ".sock";
+#else
+    return "codeit";
+#endif
+}
+
+bool sendToRunningInstance(const std::string &workingDirectory,
+                           const std::vector<std::string> &arguments) {
+#ifdef Q_OS_UNIX
+    const std::string path = instanceSocketPath();
+    if (path.empty())
+        return false;
+    const int fd = connectTo(path);
+    if (fd < 0)
+        return false;
+
+    // The directory and each argument, each ending in a NUL; the end of the
+    // connection ends the message.
+    std::string message = workingDirectory;
+    message += '\0';
+    for (const std::string &argument : arguments) {
+        message += argument;
+        message += '\0';
+    }
+
+    size_t done = 0;
+    while (done < message.size()) {
+        const ssize_t n = ::send(fd, message.data() + done, message.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    return done == message.size();
+#else
+    (void)workingDirectory;
+    (void)arguments;
+    return false;
+#endif
+}
+
+InstanceServer::InstanceServer(QObject *parent) : QObject(parent) {
+    server = new QLocalServer(this);
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(server, &QLocalServer::newConnection, this, &InstanceServer::handleConnection);
+}
+
+bool InstanceServer::listen() {
+    const std::string socketPath = instanceSocketPath();
+    if (socketPath.empty())
+        return false;
+    const QString path = QFile::decodeName(socketPath.c_str());
+    if (server->listen(path))
+        return true;
+#ifdef Q_OS_UNIX
+    // What is there is someone else's, and stays.
+    if (!isOwnSocket(socketPath))
+        return false;
+    // A socket nobody answers on is left from a crash.
+    const int fd = connectTo(socketPath);
+    if (fd >= 0) {
+        ::close(fd);
+        return false;
+    }
+#endif
+    QLocalServer::removeServer(path);
+    return server->listen(path);
+}
+
+void InstanceServer::handleConnection() {
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        auto message = std::make_shared<QByteArray>();
+        connect(socket, &QLocalSocket::readyRead, this, [socket, message] {
+            *message += socket->readAll();
+            if (message->size() > maxMessageBytes)
+                socket->abort();
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket, message] {
+            *message += socket->readAll();
+            socket->deleteLater();
+            if (message->isEmpty() || message->size() > maxMessageBytes)
+                return;
+
+            QList<QByteArray> fields = message->split('\0');
+            // The message ends in a NUL, which leaves an empty last field.
+            fields.removeLast();
+            if (fields.isEmpty())
+                return;
+            const QString workingDirectory = QFile::decodeName(fields.takeFirst());
+            QStringList arguments;
+            for (const QByteArray &field : fields)
+                arguments.append(QFile::decodeName(field));
+            emit received(workingDirectory, arguments);
+        });
+    }
+}
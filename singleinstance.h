@@ -0,0 +1,55 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <string>
+#include <vector>
+
+class QLocalServer;
+
+// Lets a new invocation of codeit hand its files to one already running
+// instead of starting a second editor. The running editor listens on a
+// local socket private to the user, $XDG_RUNTIME_DIR/codeit-<uid>.sock, or
+// without that in /tmp/codeit-<uid>, a directory only the user can enter. A
+// socket, or a process at its other end, that is not the user's is never
+// sent anything.
+//
+// The new invocation connects with a plain Unix domain socket before any Qt
+// object exists, writes its working directory and arguments, and exits, so
+// handing a file over costs a connect and a write, not a QApplication.
+
+// The socket the running editor listens on; empty if there is no private
+// place for it.
+std::string instanceSocketPath();
+
+// Sends workingDirectory and arguments to a running editor. Returns false if
+// none is listening, or on platforms without Unix domain sockets.
+bool sendToRunningInstance(const std::string &workingDirectory,
+                           const std::vector<std::string> &arguments);
+
+// The running editor's end.
+class InstanceServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit InstanceServer(QObject *parent = nullptr);
+
+    // Starts listening, taking over a socket left by an editor that
+    // crashed. Returns false if another editor listens already.
+    bool listen();
+
+signals:
+    // Arguments of an invocation, with the directory it ran in.
+    void received(const QString &workingDirectory, const QStringList &arguments);
+
+private slots:
+    void handleConnection();
+
+private:
+    QLocalServer *server;
+};
+
+#endif // SINGLEINSTANCE_H
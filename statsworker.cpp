@@ -0,0 +1,62 @@
+#include "statsworker.h"
+
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+
+// Snapshots are cut into chunks of about this size. A chunk is the unit of
+// work for the pool and the granularity of cancellation.
+constexpr int64_t chunkBytes = 1 << 20;
+
+} // namespace
+
+StatsWorker::StatsWorker(const std::atomic<quint64> &latestGeneration)
+    : latestGeneration(latestGeneration) {
+    pool.setThreadPriority(QThread::LowPriority);
+}
+
+void StatsWorker::count(quint64 generation, const QByteArray &text,
+                        qsizetype firstLine, qsizetype lineCount, const icu::Locale &locale) {
+    const char *data = text.constData();
+    const int64_t length = text.size();
+
+    std::vector<int64_t> cuts{0};
+    while (cuts.back() < length)
+        cuts.push_back(splitPointAfter(data, length, std::min(length, cuts.back() + chunkBytes)));
+
+    std::vector<std::vector<LineCounts>> chunks(cuts.size() - 1);
+    if (chunks.size() == 1) {
+        if (counter.locale() != locale)
+            counter = TextCounter(locale);
+        counter.countLines(data, length, chunks.front());
+    } else {
+        // Each task takes its own iterators from the pool; the chunks never
+        // share a word, so they can be counted in any order.
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            pool.start([&, i] {
+                if (latestGeneration.load(std::memory_order_relaxed) != generation)
+                    return;
+                TextCounter chunkCounter(locale);
+                chunkCounter.countLines(data + cuts[i], cuts[i + 1] - cuts[i], chunks[i]);
+            });
+        }
+        pool.waitForDone();
+    }
+
+    if (latestGeneration.load(std::memory_order_relaxed) != generation)
+        return;
+
+    // A chunk's first entry continues the previous chunk's last line; that
+    // line is empty when the cut fell on a line start.
+    auto counts = std::make_shared<std::vector<LineCounts>>(static_cast<size_t>(lineCount));
+    size_t line = 0;
+    for (const std::vector<LineCounts> &chunk : chunks) {
+        for (size_t i = 0; i < chunk.size(); ++i)
+            (*counts)[std::min(line + i, counts->size() - 1)] += chunk[i];
+        line += chunk.size() - 1;
+    }
+
+    emit counted(generation, firstLine, counts);
+}
@@ -0,0 +1,39 @@
+#ifndef STATSWORKER_H
+#define STATSWORKER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "textstats.h"
+
+using LineCountsList = std::shared_ptr<const std::vector<LineCounts>>;
+
+// Counts snapshots of document lines on a worker thread. Large snapshots are
+// cut at splitPointAfter() offsets and the chunks counted on a thread pool.
+// A count is abandoned as soon as the shared generation moves past the one
+// it was started for, so a newer edit never waits for a stale scan.
+class StatsWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit StatsWorker(const std::atomic<quint64> &latestGeneration);
+
+    // text holds lineCount whole lines starting at document line firstLine.
+    void count(quint64 generation, const QByteArray &text,
+               qsizetype firstLine, qsizetype lineCount, const icu::Locale &locale);
+
+signals:
+    void counted(quint64 generation, qsizetype firstLine, LineCountsList counts);
+
+private:
+    const std::atomic<quint64> &latestGeneration;
+    TextCounter counter;
+    QThreadPool pool;
+};
+
+#endif // STATSWORKER_H
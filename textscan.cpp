@@ -0,0 +1,537 @@
+#include "textscan.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEXTSCAN_X86 1
+#endif
+
+namespace textscan {
+namespace {
+
+enum ClassBit : uint8_t {
+    Letter = 1,
+    Digit = 2,
+    Underscore = 4,
+    LetterJoiner = 8,
+    DigitJoiner = 16,
+};
+
+struct ClassTable {
+    uint8_t bits[256] = {};
+
+    ClassTable() {
+        for (int c = 'a'; c <= 'z'; ++c)
+            bits[c] = bits[c - 'a' + 'A'] = Letter;
+        for (int c = '0'; c <= '9'; ++c)
+            bits[c] = Digit;
+        bits[static_cast<uint8_t>('@')] = Letter;
+        bits[static_cast<uint8_t>('_')] = Underscore;
+        bits[static_cast<uint8_t>('\'')] = LetterJoiner | DigitJoiner;
+        bits[static_cast<uint8_t>(',')] = DigitJoiner;
+        bits[static_cast<uint8_t>(';')] = DigitJoiner;
+        bits[static_cast<uint8_t>('.')] = LetterJoiner | DigitJoiner;
+    }
+};
+
+const ClassTable classTable;
+
+// ---- Scalar kernels --------------------------------------------------------
+
+size_t findNonAsciiScalar(const char *data, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+    for (; i < length; ++i) {
+        if (static_cast<uint8_t>(data[i]) >= 0x80)
+            return i;
+    }
+    return length;
+}
+
+size_t countCodePointsScalar(const char *data, size_t length) {
+    // Every byte but a continuation byte (10xxxxxx) starts a code point.
+    size_t continuations = 0;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        continuations += __builtin_popcountll(word & ~(word << 1) & 0x8080808080808080ull);
+    }
+    for (; i < length; ++i)
+        continuations += (static_cast<uint8_t>(data[i]) & 0xC0) == 0x80;
+    return length - continuations;
+}
+
+// Validates data, skipping ASCII runs with findNonAsciiIn.
+bool validUtf8With(size_t (*findNonAsciiIn)(const char *, size_t), const char *data, size_t length) {
+    const auto *s = reinterpret_cast<const uint8_t *>(data);
+    size_t i = 0;
+    for (;;) {
+        i += findNonAsciiIn(data + i, length - i);
+        if (i == length)
+            return true;
+
+        // Ranges of the second byte per lead byte, from RFC 3629.
+        const uint8_t lead = s[i];
+        size_t trail;
+        uint8_t low = 0x80, high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            trail = 1;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            trail = 2;
+            if (lead == 0xE0)
+                low = 0xA0;
+            else if (lead == 0xED)
+                high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            trail = 3;
+            if (lead == 0xF0)
+                low = 0x90;
+            else if (lead == 0xF4)
+                high = 0x8F;
+        } else {
+            return false;
+        }
+
+        if (length - i <= trail || s[i + 1] < low || s[i + 1] > high)
+            return false;
+        for (size_t k = 2; k <= trail; ++k) {
+            if ((s[i + k] & 0xC0) != 0x80)
+                return false;
+        }
+        i += trail + 1;
+    }
+}
+
+bool validUtf8Scalar(const char *data, size_t length) {
+    return validUtf8With(findNonAsciiScalar, data, length);
+}
+
+void newlinesScalar(const char *data, uint64_t &lf, uint64_t &cr) {
+    lf = cr = 0;
+    for (int i = 0; i < 64; ++i) {
+        lf |= uint64_t(data[i] == '\n') << i;
+        cr |= uint64_t(data[i] == '\r') << i;
+    }
+}
+
+void classifyScalar(const char *data, size_t length, AsciiClasses &c) {
+    c = AsciiClasses();
+    for (size_t i = 0; i < length; ++i) {
+        const uint8_t bits = classTable.bits[static_cast<uint8_t>(data[i])];
+        c.letters |= uint64_t((bits & Letter) != 0) << i;
+        c.digits |= uint64_t((bits & Digit) != 0) << i;
+        c.underscores |= uint64_t((bits & Underscore) != 0) << i;
+        c.letterJoiners |= uint64_t((bits & LetterJoiner) != 0) << i;
+        c.digitJoiners |= uint64_t((bits & DigitJoiner) != 0) << i;
+    }
+}
+
+void classify64Scalar(const char *data, AsciiClasses &c) {
+    classifyScalar(data, 64, c);
+}
+
+#if TEXTSCAN_X86
+
+// ---- SSE2 kernels ----------------------------------------------------------
+
+__attribute__((target("sse2")))
+size_t findNonAsciiSse2(const char *data, size_t length) {
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 32));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+            break;
+    }
+    for (; i + 16 <= length; i += 16) {
+        const int mask = _mm_movemask_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + findNonAsciiScalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+size_t countCodePointsSse2(const char *data, size_t length) {
+    // As signed bytes, continuation bytes are exactly those below -64.
+    const __m128i limit = _mm_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        count += __builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit))));
+    }
+    return count + countCodePointsScalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+bool validUtf8Sse2(const char *data, size_t length) {
+    return validUtf8With(findNonAsciiSse2, data, length);
+}
+
+__attribute__((target("sse2")))
+uint64_t eqMaskSse2(const char *data, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i));
+        mask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)))) << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("sse2")))
+void newlinesSse2(const char *data, uint64_t &lf, uint64_t &cr) {
+    lf = eqMaskSse2(data, '\n');
+    cr = eqMaskSse2(data, '\r');
+}
+
+__attribute__((target("sse2")))
+void classify64Sse2(const char *data, AsciiClasses &c) {
+    c = AsciiClasses();
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i));
+        // Bytes are ASCII here, so signed compares work as unsigned ones.
+        const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i letter = _mm_or_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                          _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('@')));
+        const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                            _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        const __m128i letterJoiner = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+                                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+        const __m128i digitJoiner = _mm_or_si128(
+            letterJoiner, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))));
+
+        const int shift = 16 * i;
+        c.letters |= uint64_t(uint16_t(_mm_movemask_epi8(letter))) << shift;
+        c.digits |= uint64_t(uint16_t(_mm_movemask_epi8(digit))) << shift;
+        c.underscores |= uint64_t(uint16_t(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))))) << shift;
+        c.letterJoiners |= uint64_t(uint16_t(_mm_movemask_epi8(letterJoiner))) << shift;
+        c.digitJoiners |= uint64_t(uint16_t(_mm_movemask_epi8(digitJoiner))) << shift;
+    }
+}
+
+// ---- AVX2 kernels ----------------------------------------------------------
+
+__attribute__((target("avx2")))
+size_t findNonAsciiAvx2(const char *data, size_t length) {
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 64));
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 96));
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d))))
+            break;
+    }
+    for (; i + 32 <= length; i += 32) {
+        const int mask = _mm256_movemask_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+        if (mask)
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+    return i + findNonAsciiScalar(data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+size_t countCodePointsAvx2(const char *data, size_t length) {
+    const __m256i limit = _mm256_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        count += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, limit))));
+    }
+    return count + countCodePointsScalar(data + i, length - i);
+}
+
+// UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than
+// one instruction per byte". Three table lookups on the high and low nibble
+// of the previous byte and the high nibble of the current one flag every
+// invalid two-byte pattern; the third and fourth bytes of longer sequences
+// are checked by comparing the bytes two and three places back.
+enum Utf8Error : uint8_t {
+    TooShort = 1 << 0,    // lead byte not followed by a continuation
+    TooLong = 1 << 1,     // continuation after ASCII
+    Overlong3 = 1 << 2,   // E0 80..9F
+    TooLarge = 1 << 3,    // F4 90..BF, F5..FF
+    Surrogate = 1 << 4,   // ED A0..BF
+    Overlong2 = 1 << 5,   // C0..C1
+    TooLarge1000 = 1 << 6,
+    Overlong4 = 1 << 6,   // F0 80..8F
+    TwoConts = 1 << 7,    // continuation after continuation
+};
+constexpr uint8_t Carry = TooShort | TooLong | TwoConts;
+
+template <int N>
+__attribute__((target("avx2")))
+inline __m256i prevBytesAvx2(__m256i input, __m256i prev) {
+    // Bytes of input shifted up by N, with the last N of prev shifted in.
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+inline __m256i highNibblesAvx2(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2")))
+inline __m256i lookup16Avx2(const __m128i &table, __m256i index) {
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(table), index);
+}
+
+struct Utf8StateAvx2 {
+    __m256i error;
+    __m256i prevInput;
+    __m256i prevIncomplete;
+};
+
+__attribute__((target("avx2")))
+inline void checkUtf8BlockAvx2(__m256i input, Utf8StateAvx2 &state) {
+    if (!_mm256_movemask_epi8(input)) {
+        // All ASCII: only a sequence cut off by the previous block can fail.
+        state.error = _mm256_or_si256(state.error, state.prevIncomplete);
+        state.prevInput = input;
+        return;
+    }
+
+    const __m128i byte1High = _mm_setr_epi8(
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        TwoConts, TwoConts, TwoConts, TwoConts,
+        TooShort | Overlong2,
+        TooShort,
+        TooShort | Overlong3 | Surrogate,
+        static_cast<char>(TooShort | TooLarge | TooLarge1000 | Overlong4));
+    const __m128i byte1Low = _mm_setr_epi8(
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        Carry | Overlong2,
+        Carry, Carry,
+        Carry | TooLarge,
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000 | Surrogate),
+        static_cast<char>(Carry | TooLarge | TooLarge1000),
+        static_cast<char>(Carry | TooLarge | TooLarge1000));
+    const __m128i byte2High = _mm_setr_epi8(
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        static_cast<char>(TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4),
+        static_cast<char>(TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge),
+        static_cast<char>(TooLong | Overlong2 | TwoConts | Surrogate | TooLarge),
+        static_cast<char>(TooLong | Overlong2 | TwoConts | Surrogate | TooLarge),
+        TooShort, TooShort, TooShort, TooShort);
+
+    const __m256i prev1 = prevBytesAvx2<1>(input, state.prevInput);
+    const __m256i special = _mm256_and_si256(
+        _mm256_and_si256(lookup16Avx2(byte1High, highNibblesAvx2(prev1)),
+                         lookup16Avx2(byte1Low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        lookup16Avx2(byte2High, highNibblesAvx2(input)));
+
+    // Bytes two after a three- or four-byte lead, or three after a four-byte
+    // one, must be continuations; the lookups flag those as TwoConts (0x80).
+    const __m256i third = _mm256_subs_epu8(prevBytesAvx2<2>(input, state.prevInput),
+                                           _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    const __m256i fourth = _mm256_subs_epu8(prevBytesAvx2<3>(input, state.prevInput),
+                                            _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                            _mm256_set1_epi8(static_cast<char>(0x80)));
+    state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must23, special));
+
+    // Nonzero where the last three bytes start a sequence that runs past
+    // the block.
+    const __m256i maxValue = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    state.prevIncomplete = _mm256_subs_epu8(input, maxValue);
+    state.prevInput = input;
+}
+
+__attribute__((target("avx2")))
+bool validUtf8Avx2(const char *data, size_t length) {
+    Utf8StateAvx2 state = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+        checkUtf8BlockAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), state);
+    if (i < length) {
+        // Padding with ASCII leaves the verdict on the real bytes unchanged.
+        char tail[32] = {};
+        std::memcpy(tail, data + i, length - i);
+        checkUtf8BlockAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail)), state);
+    }
+    const __m256i error = _mm256_or_si256(state.error, state.prevIncomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+__attribute__((target("avx2")))
+uint64_t eqMaskAvx2(const char *data, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+    return uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle))))
+         | uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)))) << 32;
+}
+
+__attribute__((target("avx2")))
+void newlinesAvx2(const char *data, uint64_t &lf, uint64_t &cr) {
+    lf = eqMaskAvx2(data, '\n');
+    cr = eqMaskAvx2(data, '\r');
+}
+
+__attribute__((target("avx2")))
+void classify64Avx2(const char *data, AsciiClasses &c) {
+    c = AsciiClasses();
+    for (int i = 0; i < 2; ++i) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32 * i));
+        const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        const __m256i letter = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('@')));
+        const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        const __m256i letterJoiner = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')),
+                                                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+        const __m256i digitJoiner = _mm256_or_si256(
+            letterJoiner, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'))));
+
+        const int shift = 32 * i;
+        c.letters |= uint64_t(uint32_t(_mm256_movemask_epi8(letter))) << shift;
+        c.digits |= uint64_t(uint32_t(_mm256_movemask_epi8(digit))) << shift;
+        c.underscores |= uint64_t(uint32_t(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))))) << shift;
+        c.letterJoiners |= uint64_t(uint32_t(_mm256_movemask_epi8(letterJoiner))) << shift;
+        c.digitJoiners |= uint64_t(uint32_t(_mm256_movemask_epi8(digitJoiner))) << shift;
+    }
+}
+
+#endif // TEXTSCAN_X86
+
+struct Kernels {
+    const char *name;
+    size_t (*findNonAscii)(const char *, size_t);
+    size_t (*countCodePoints)(const char *, size_t);
+    bool (*validUtf8)(const char *, size_t);
+    void (*newlines)(const char *, uint64_t &, uint64_t &);
+    void (*classify64)(const char *, AsciiClasses &);
+};
+
+Kernels pickKernels() {
+#if TEXTSCAN_X86
+    // CODEIT_TEXTSCAN=scalar or =sse2 caps the kernel, for benchmarks.
+    const char *cap = std::getenv("CODEIT_TEXTSCAN");
+    const bool scalarOnly = cap && std::strcmp(cap, "scalar") == 0;
+    const bool noAvx2 = scalarOnly || (cap && std::strcmp(cap, "sse2") == 0);
+
+    __builtin_cpu_init();
+    if (!noAvx2 && __builtin_cpu_supports("avx2"))
+        return {"avx2", findNonAsciiAvx2, countCodePointsAvx2, validUtf8Avx2, newlinesAvx2, classify64Avx2};
+    if (!scalarOnly && __builtin_cpu_supports("sse2"))
+        return {"sse2", findNonAsciiSse2, countCodePointsSse2, validUtf8Sse2, newlinesSse2, classify64Sse2};
+#endif
+    return {"scalar", findNonAsciiScalar, countCodePointsScalar, validUtf8Scalar, newlinesScalar, classify64Scalar};
+}
+
+const Kernels &kernels() {
+    static const Kernels k = pickKernels();
+    return k;
+}
+
+} // namespace
+
+size_t findNonAscii(const char *data, size_t length) {
+    return kernels().findNonAscii(data, length);
+}
+
+size_t countCodePoints(const char *data, size_t length) {
+    return kernels().countCodePoints(data, length);
+}
+
+bool isValidUtf8(const char *data, size_t length) {
+    return kernels().validUtf8(data, length);
+}
+
+size_t completeUtf8Length(const char *data, size_t length) {
+    const auto *s = reinterpret_cast<const uint8_t *>(data);
+    // Look back past continuation bytes for the lead byte of the last
+    // sequence, and drop it if fewer bytes follow than it announces.
+    for (size_t back = 1; back <= 3 && back <= length; ++back) {
+        const uint8_t c = s[length - back];
+        if ((c & 0xC0) == 0x80)
+            continue;
+        const size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return need > back ? length - back : length;
+    }
+    return length;
+}
+
+void appendLineEnds(const char *data, size_t length, int64_t base, std::vector<int64_t> &ends) {
+    const Kernels &k = kernels();
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        uint64_t lf, cr;
+        k.newlines(data + i, lf, cr);
+        if (!(lf | cr))
+            continue;
+
+        // A CR directly followed by LF ends its line at the LF.
+        const uint64_t nextIsLf = (lf >> 1) | (i + 64 < length && data[i + 64] == '\n' ? 1ull << 63 : 0);
+        uint64_t mask = lf | (cr & ~nextIsLf);
+        while (mask) {
+            ends.push_back(base + static_cast<int64_t>(i + __builtin_ctzll(mask)) + 1);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < length; ++i) {
+        if (data[i] == '\n' || (data[i] == '\r' && (i + 1 == length || data[i + 1] != '\n')))
+            ends.push_back(base + static_cast<int64_t>(i) + 1);
+    }
+}
+
+size_t countLineFeeds(const char *data, size_t length) {
+    const Kernels &k = kernels();
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        uint64_t lf, cr;
+        k.newlines(data + i, lf, cr);
+        count += static_cast<size_t>(__builtin_popcountll(lf));
+    }
+    for (; i < length; ++i)
+        count += data[i] == '\n';
+    return count;
+}
+
+void classifyAscii(const char *data, size_t length, AsciiClasses &classes) {
+    if (length == 64)
+        kernels().classify64(data, classes);
+    else
+        classifyScalar(data, length, classes);
+}
+
+const char *kernelName() {
+    return kernels().name;
+}
+
+} // namespace textscan
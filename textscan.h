@@ -0,0 +1,55 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vectorized byte scans for the statistics, encoding and piece tree engines.
+// Each function picks an AVX2, SSE2 or scalar kernel once, at first use, from
+// what the CPU offers.
+namespace textscan {
+
+// Returns the offset of the first byte >= 0x80, or length.
+size_t findNonAscii(const char *data, size_t length);
+
+// Returns the number of UTF-8 sequences started in data, that is, of bytes
+// that are not continuation bytes.
+size_t countCodePoints(const char *data, size_t length);
+
+// Returns true if data is well-formed UTF-8: no stray continuation bytes, no
+// overlong forms, no surrogates, nothing above U+10FFFF and no sequence cut
+// off at the end.
+bool isValidUtf8(const char *data, size_t length);
+
+// Returns length less a UTF-8 sequence cut off at the end of data, if any,
+// so that text read in chunks can be validated a chunk at a time.
+size_t completeUtf8Length(const char *data, size_t length);
+
+// Appends base + the offset just past every line end (LF, CR LF or lone CR)
+// in data. A CR in the last byte counts as a lone CR.
+void appendLineEnds(const char *data, size_t length, int64_t base, std::vector<int64_t> &ends);
+
+// Returns the number of LF bytes in data.
+size_t countLineFeeds(const char *data, size_t length);
+
+// Character classes of 64 ASCII bytes, one bit per byte, as used by the ICU
+// word rules: ICU counts '@' as a letter, joins letters across . and an
+// apostrophe, and joins digits across , ; . and an apostrophe.
+struct AsciiClasses {
+    uint64_t letters = 0;
+    uint64_t digits = 0;
+    uint64_t underscores = 0;
+    uint64_t letterJoiners = 0;
+    uint64_t digitJoiners = 0;
+};
+
+// Classifies data[0 .. length), length <= 64; missing bytes classify as none.
+void classifyAscii(const char *data, size_t length, AsciiClasses &classes);
+
+// Name of the kernel in use ("avx2", "sse2" or "scalar").
+const char *kernelName();
+
+} // namespace textscan
+
+#endif // TEXTSCAN_H
@@ -0,0 +1,650 @@
+#include "textstats.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <unicode/rbbi.h>
+#include <unicode/ubrk.h>
+#include <unicode/utext.h>
+
+#include "textscan.h"
+
+namespace {
+
+constexpr size_t blockLines = 512;
+
+// ASCII gaps shorter than this between two non-ASCII runs go to ICU with
+// them rather than restarting the break iterators for each run.
+constexpr int64_t minAsciiRun = 64;
+
+// ASCII characters after which every ICU word and grapheme rule breaks
+// when another ASCII character follows, in every locale: white space and
+// punctuation that no rule treats as a letter, number or joiner. A space
+// still joins a following space.
+struct SplitTable {
+    bool after[128] = {};
+
+    SplitTable() {
+        for (const char *c = " \t()[]{}<>=+-*/\\|!?#%&^~\"$"; *c; ++c)
+            after[static_cast<uint8_t>(*c)] = true;
+    }
+};
+
+const SplitTable splitTable;
+
+// True if counting the text before and after offset separately gives the
+// same counts as counting it in one piece.
+bool isSafeSplit(const char *utf8, int64_t length, int64_t offset) {
+    if (offset <= 0 || offset >= length)
+        return true;
+
+    const uint8_t prev = static_cast<uint8_t>(utf8[offset - 1]);
+    const uint8_t cur = static_cast<uint8_t>(utf8[offset]);
+    if (prev == '\n')
+        return true;
+    if (prev == '\r')
+        return cur != '\n';
+    return prev < 0x80 && cur < 0x80 && splitTable.after[prev] && !(prev == ' ' && cur == ' ');
+}
+
+// Bit i set if byte i - 1 (i - 2) is in the class, continuing from the
+// previous 64-byte block.
+inline uint64_t before1(uint64_t cur, uint64_t prev) { return (cur << 1) | (prev >> 63); }
+inline uint64_t before2(uint64_t cur, uint64_t prev) { return (cur << 2) | (prev >> 62); }
+// Bit i set if byte i + 1 is in the class, continuing into the next block.
+inline uint64_t after1(uint64_t cur, uint64_t next) { return (cur >> 1) | (next << 63); }
+
+inline uint64_t wordChars(const textscan::AsciiClasses &c) {
+    return c.letters | c.digits | c.underscores;
+}
+
+} // namespace
+
+void BreakIteratorPool::Return::operator()(icu::BreakIterator *iter) const {
+    BreakIteratorPool::instance().release(key, iter);
+}
+
+BreakIteratorPool &BreakIteratorPool::instance() {
+    static BreakIteratorPool pool;
+    return pool;
+}
+
+bool BreakIteratorPool::hasRootRules(const icu::Locale &locale) {
+    const std::string name = locale.getName();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto known = rootRules.find(name);
+        if (known != rootRules.end())
+            return known->second;
+    }
+
+    auto rules = [](const Handle &iter) {
+        const auto *rbbi = dynamic_cast<const icu::RuleBasedBreakIterator *>(iter.get());
+        return rbbi ? rbbi->getRules() : icu::UnicodeString();
+    };
+    const icu::Locale root = icu::Locale::getRoot();
+    const icu::UnicodeString word = rules(acquire(locale, Word));
+    const icu::UnicodeString chars = rules(acquire(locale, Character));
+    const bool same = !word.isEmpty() && !chars.isEmpty()
+        && word == rules(acquire(root, Word))
+        && chars == rules(acquire(root, Character));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    rootRules[name] = same;
+    return same;
+}
+
+BreakIteratorPool::Handle BreakIteratorPool::acquire(const icu::Locale &locale, Kind kind) {
+    std::string key = locale.getName();
+    key += kind == Word ? "/word" : "/char";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry &entry = entries[key];
+    if (!entry.prototype) {
+        UErrorCode status = U_ZERO_ERROR;
+        entry.prototype.reset(kind == Word
+            ? icu::BreakIterator::createWordInstance(locale, status)
+            : icu::BreakIterator::createCharacterInstance(locale, status));
+        if (U_FAILURE(status))
+            entry.prototype.reset();
+        if (!entry.prototype)
+            return Handle();
+    }
+
+    if (!entry.idle.empty()) {
+        icu::BreakIterator *iter = entry.idle.back().release();
+        entry.idle.pop_back();
+        return Handle(iter, Return(key));
+    }
+    return Handle(entry.prototype->clone(), Return(key));
+}
+
+void BreakIteratorPool::release(const std::string &key, icu::BreakIterator *iter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[key].idle.emplace_back(iter);
+}
+
+// Maps increasing text offsets to the counts of the line containing them.
+class TextCounter::LineCursor {
+public:
+    LineCursor(const std::vector<int64_t> &lineEnds, LineCounts *lines, size_t lineCount)
+        : ends(lineEnds), lines(lines), last(lineCount - 1) {}
+
+    LineCounts &at(int64_t offset) {
+        while (line < ends.size() && offset >= ends[line])
+            ++line;
+        return lines[std::min(line, last)];
+    }
+
+    // Offset just past the end of the line found by the last at().
+    int64_t lineEnd() const {
+        return line < ends.size() ? ends[line] : std::numeric_limits<int64_t>::max();
+    }
+
+private:
+    const std::vector<int64_t> &ends;
+    LineCounts *lines;
+    size_t last;
+    size_t line = 0;
+};
+
+TextCounter::TextCounter(const icu::Locale &locale) : loc(locale) {}
+
+void TextCounter::setAsciiFastPath(bool enabled) {
+    asciiFastPathWanted = enabled;
+    if (prepared)
+        asciiFastPath = enabled && BreakIteratorPool::instance().hasRootRules(loc);
+}
+
+void TextCounter::prepare() {
+    if (prepared)
+        return;
+    BreakIteratorPool &pool = BreakIteratorPool::instance();
+    wordIter = pool.acquire(loc, BreakIteratorPool::Word);
+    charIter = pool.acquire(loc, BreakIteratorPool::Character);
+    asciiFastPath = asciiFastPathWanted && pool.hasRootRules(loc);
+    prepared = true;
+}
+
+size_t TextCounter::countLines(const char *utf8, int64_t length, LineCounts *lines, size_t lineCount) {
+    if (lineCount == 0 || length <= 0)
+        return 0;
+
+    std::vector<int64_t> lineEnds;
+    textscan::appendLineEnds(utf8, static_cast<size_t>(length), 0, lineEnds);
+    count(utf8, length, lineEnds, lines, lineCount);
+    return lineEnds.size();
+}
+
+void TextCounter::countLines(const char *utf8, int64_t length, std::vector<LineCounts> &lines) {
+    std::vector<int64_t> lineEnds;
+    textscan::appendLineEnds(utf8, static_cast<size_t>(std::max<int64_t>(length, 0)), 0, lineEnds);
+    lines.assign(lineEnds.size() + 1, LineCounts());
+    if (length > 0)
+        count(utf8, length, lineEnds, lines.data(), lines.size());
+}
+
+void TextCounter::count(const char *utf8, int64_t length, const std::vector<int64_t> &lineEnds,
+                        LineCounts *lines, size_t lineCount) {
+    prepare();
+    int64_t lineStart = 0;
+    for (size_t i = 0; i <= lineEnds.size(); ++i) {
+        const int64_t lineEnd = i < lineEnds.size() ? lineEnds[i] : length;
+        lines[std::min(i, lineCount - 1)].codePoints += static_cast<uint32_t>(
+            textscan::countCodePoints(utf8 + lineStart, static_cast<size_t>(lineEnd - lineStart)));
+        lineStart = lineEnd;
+    }
+
+    LineCursor wordLines(lineEnds, lines, lineCount);
+    LineCursor charLines(lineEnds, lines, lineCount);
+
+    if (!asciiFastPath) {
+        countIcu(utf8, 0, length, wordLines, charLines);
+        return;
+    }
+
+    // Count ASCII runs directly and give ICU only the text around non-ASCII
+    // bytes, cut where both rule sets break regardless of context.
+    int64_t pos = 0;
+    while (pos < length) {
+        const int64_t nonAscii = pos + static_cast<int64_t>(
+            textscan::findNonAscii(utf8 + pos, static_cast<size_t>(length - pos)));
+        if (nonAscii == length) {
+            countAscii(utf8, pos, length, wordLines, charLines);
+            break;
+        }
+
+        int64_t zoneStart = nonAscii;
+        while (zoneStart > pos && !isSafeSplit(utf8, length, zoneStart))
+            --zoneStart;
+        countAscii(utf8, pos, zoneStart, wordLines, charLines);
+
+        int64_t zoneEnd = nonAscii + 1;
+        for (;;) {
+            while (zoneEnd < length && !isSafeSplit(utf8, length, zoneEnd))
+                ++zoneEnd;
+            const size_t gap = static_cast<size_t>(std::min(length - zoneEnd, minAsciiRun));
+            const size_t next = textscan::findNonAscii(utf8 + zoneEnd, gap);
+            if (next == gap)
+                break;
+            zoneEnd += static_cast<int64_t>(next) + 1;
+        }
+        countIcu(utf8, zoneStart, zoneEnd, wordLines, charLines);
+        pos = zoneEnd;
+    }
+}
+
+void TextCounter::countIcu(const char *utf8, int64_t begin, int64_t end,
+                           LineCursor &wordLines, LineCursor &charLines) {
+    UErrorCode status = U_ZERO_ERROR;
+    UText text = UTEXT_INITIALIZER;
+    utext_openUTF8(&text, utf8 + begin, end - begin, &status);
+    if (U_FAILURE(status))
+        return;
+
+    // UTF-8 UText indexes are native byte offsets.
+    if (wordIter) {
+        // Count segments whose rule status is not UBRK_WORD_NONE
+        wordIter->setText(&text, status);
+        int32_t start = wordIter->first();
+        for (int32_t stop = wordIter->next(); U_SUCCESS(status) && stop != icu::BreakIterator::DONE;
+             start = stop, stop = wordIter->next()) {
+            if (wordIter->getRuleStatus() != UBRK_WORD_NONE)
+                ++wordLines.at(begin + start).words;
+        }
+    }
+
+    if (charIter) {
+        status = U_ZERO_ERROR;
+        charIter->setText(&text, status);
+        int32_t start = charIter->first();
+        for (int32_t stop = charIter->next(); U_SUCCESS(status) && stop != icu::BreakIterator::DONE;
+             start = stop, stop = charIter->next())
+            ++charLines.at(begin + start).graphemes;
+    }
+
+    utext_close(&text);
+}
+
+void TextCounter::countAscii(const char *utf8, int64_t begin, int64_t end,
+                             LineCursor &wordLines, LineCursor &charLines) {
+    // Every ASCII byte is a grapheme of its own, except the LF of CR LF.
+    for (int64_t p = begin; p < end;) {
+        LineCounts &line = charLines.at(p);
+        const int64_t stop = std::min(end, charLines.lineEnd());
+        int64_t n = stop - p;
+        if (stop == charLines.lineEnd() && n >= 2 && utf8[stop - 1] == '\n' && utf8[stop - 2] == '\r')
+            --n;
+        line.graphemes += static_cast<uint32_t>(n);
+        p = stop;
+    }
+
+    // A word starts at a letter, digit or underscore that follows none of
+    // them and is not joined to the word before by . or an apostrophe
+    // (between letters) or by , ; . or an apostrophe (between digits). A lone
+    // underscore has no word status. begin is a safe split, so nothing
+    // before it can join.
+    textscan::AsciiClasses prev, cur, next;
+    textscan::classifyAscii(utf8 + begin, static_cast<size_t>(std::min<int64_t>(64, end - begin)), cur);
+    for (int64_t block = begin; block < end; block += 64) {
+        if (block + 64 < end)
+            textscan::classifyAscii(utf8 + block + 64,
+                                    static_cast<size_t>(std::min<int64_t>(64, end - block - 64)), next);
+        else
+            next = textscan::AsciiClasses();
+
+        const uint64_t word = wordChars(cur);
+        uint64_t starts = word & ~before1(word, wordChars(prev));
+        starts &= ~(cur.letters & before1(cur.letterJoiners, prev.letterJoiners)
+                    & before2(cur.letters, prev.letters));
+        starts &= ~(cur.digits & before1(cur.digitJoiners, prev.digitJoiners)
+                    & before2(cur.digits, prev.digits));
+        starts &= ~(cur.underscores & ~after1(word, wordChars(next)));
+
+        while (starts) {
+            LineCounts &line = wordLines.at(block + __builtin_ctzll(starts));
+            const int64_t lineEnd = wordLines.lineEnd();
+            if (lineEnd >= block + 64) {
+                line.words += static_cast<uint32_t>(__builtin_popcountll(starts));
+                break;
+            }
+            const uint64_t inLine = (1ull << (lineEnd - block)) - 1;
+            line.words += static_cast<uint32_t>(__builtin_popcountll(starts & inLine));
+            starts &= ~inLine;
+        }
+
+        prev = cur;
+        cur = next;
+    }
+}
+
+int64_t splitPointAfter(const char *utf8, int64_t length, int64_t from) {
+    while (from < length && !isSafeSplit(utf8, length, from))
+        ++from;
+    return std::min(from, length);
+}
+
+LineStatsIndex::LineStatsIndex() {
+    reset(1);
+}
+
+void LineStatsIndex::reset(size_t lineCount) {
+    blocks.clear();
+    for (size_t done = 0; done < lineCount || blocks.empty(); done += blockLines) {
+        Block block;
+        block.lines.resize(std::min(blockLines, lineCount - done));
+        blocks.push_back(std::move(block));
+    }
+    lines = lineCount;
+    total = TextCounts();
+    rebuildTree();
+}
+
+size_t LineStatsIndex::locate(size_t &line) const {
+    // Descend the tree to the first block that ends after line.
+    size_t b = 0;
+    size_t step = 1;
+    while (step * 2 <= tree.size())
+        step *= 2;
+    for (; step > 0; step /= 2) {
+        if (b + step <= tree.size() && static_cast<size_t>(tree[b + step - 1].lines) <= line) {
+            b += step;
+            line -= static_cast<size_t>(tree[b - 1].lines);
+        }
+    }
+
+    // Past the end: stay in the last block.
+    if (b == blocks.size()) {
+        --b;
+        line += blocks[b].lines.size();
+    }
+    return b;
+}
+
+TextCounts LineStatsIndex::sumBefore(size_t line) const {
+    size_t offset = std::min(line, lines);
+    const size_t b = locate(offset);
+
+    TextCounts result;
+    for (size_t i = b; i > 0; i -= i & (~i + 1))
+        result += tree[i - 1].sum;
+
+    // Walk whichever part of the block is shorter.
+    const Block &block = blocks[b];
+    if (offset <= block.lines.size() / 2) {
+        for (size_t i = 0; i < offset; ++i)
+            result += block.lines[i];
+    } else {
+        result += block.sum;
+        for (size_t i = offset; i < block.lines.size(); ++i)
+            result -= block.lines[i];
+    }
+    return result;
+}
+
+TextCounts LineStatsIndex::sum(size_t first, size_t count) const {
+    TextCounts result = sumBefore(first + std::min(count, lines - std::min(first, lines)));
+    result -= sumBefore(first);
+    return result;
+}
+
+void LineStatsIndex::setLines(size_t first, const LineCounts *counts, size_t count) {
+    size_t offset = first;
+    size_t b = locate(offset);
+    for (size_t i = 0; i < count && b < blocks.size(); ++b, offset = 0) {
+        Block &block = blocks[b];
+        TextCounts delta;
+        for (; i < count && offset < block.lines.size(); ++i, ++offset) {
+            delta -= block.lines[offset];
+            block.lines[offset] = counts[i];
+            delta += counts[i];
+        }
+        block.sum += delta;
+        total += delta;
+        addToTree(b, 0, delta);
+    }
+}
+
+void LineStatsIndex::insertLines(size_t at, size_t count) {
+    if (count == 0)
+        return;
+
+    size_t offset = std::min(at, lines);
+    size_t b = locate(offset);
+    Block &block = blocks[b];
+    block.lines.insert(block.lines.begin() + std::min(offset, block.lines.size()),
+                       count, LineCounts());
+    lines += count;
+
+    if (block.lines.size() > 2 * blockLines)
+        splitBlock(b);
+    else
+        addToTree(b, static_cast<int64_t>(count), TextCounts());
+}
+
+void LineStatsIndex::removeLines(size_t at, size_t count) {
+    count = std::min(count, lines - std::min(at, lines));
+    if (count == 0)
+        return;
+
+    size_t offset = at;
+    size_t b = locate(offset);
+    bool blocksRemoved = false;
+    while (count > 0 && b < blocks.size()) {
+        Block &block = blocks[b];
+        const size_t n = std::min(count, block.lines.size() - offset);
+        auto first = block.lines.begin() + offset;
+        TextCounts removed;
+        for (auto it = first; it != first + n; ++it)
+            removed += *it;
+        block.sum -= removed;
+        total -= removed;
+        block.lines.erase(first, first + n);
+        lines -= n;
+        count -= n;
+        offset = 0;
+
+        if (block.lines.empty() && blocks.size() > 1) {
+            blocks.erase(blocks.begin() + b);
+            blocksRemoved = true;
+        } else {
+            if (!blocksRemoved) {
+                TextCounts delta;
+                delta -= removed;
+                addToTree(b, -static_cast<int64_t>(n), delta);
+            }
+            ++b;
+        }
+    }
+
+    // Block indexes shifted; the tree is cheaper to rebuild than to patch.
+    if (blocksRemoved)
+        rebuildTree();
+}
+
+void LineStatsIndex::splitBlock(size_t index) {
+    std::vector<LineCounts> all = std::move(blocks[index].lines);
+    std::vector<Block> pieces;
+    for (size_t start = 0; start < all.size(); start += blockLines) {
+        Block piece;
+        piece.lines.assign(all.begin() + start,
+                           all.begin() + std::min(start + blockLines, all.size()));
+        for (const LineCounts &c : piece.lines)
+            piece.sum += c;
+        pieces.push_back(std::move(piece));
+    }
+    blocks.erase(blocks.begin() + index);
+    blocks.insert(blocks.begin() + index,
+                  std::make_move_iterator(pieces.begin()),
+                  std::make_move_iterator(pieces.end()));
+    rebuildTree();
+}
+
+void LineStatsIndex::addToTree(size_t block, int64_t lineDelta, const TextCounts &sumDelta) {
+    for (size_t i = block + 1; i <= tree.size(); i += i & (~i + 1)) {
+        tree[i - 1].lines += lineDelta;
+        tree[i - 1].sum += sumDelta;
+    }
+}
+
+void LineStatsIndex::rebuildTree() {
+    tree.assign(blocks.size(), TreeNode());
+    for (size_t i = 1; i <= tree.size(); ++i) {
+        tree[i - 1].lines += static_cast<int64_t>(blocks[i - 1].lines.size());
+        tree[i - 1].sum += blocks[i - 1].sum;
+        const size_t parent = i + (i & (~i + 1));
+        if (parent <= tree.size()) {
+            tree[parent - 1].lines += tree[i - 1].lines;
+            tree[parent - 1].sum += tree[i - 1].sum;
+        }
+    }
+}
+
+IncrementalStats::IncrementalStats(const TextSource &source, const icu::Locale &locale)
+    : source(source), counter(locale) {
+    reset();
+}
+
+void IncrementalStats::reset() {
+    const size_t lineCount = static_cast<size_t>(source.lineCount());
+    index.reset(lineCount);
+    dirty = false;
+    markDirty(0, lineCount > 0 ? lineCount - 1 : 0);
+}
+
+void IncrementalStats::setLocale(const icu::Locale &locale) {
+    counter = TextCounter(locale);
+    reset();
+}
+
+void IncrementalStats::textChanged(int64_t position, int64_t linesAdded) {
+    const size_t line = static_cast<size_t>(source.lineFromPosition(position));
+    const size_t k = static_cast<size_t>(linesAdded > 0 ? linesAdded : -linesAdded);
+
+    if (linesAdded > 0) {
+        // Lines from line onwards move down by k.
+        index.insertLines(line, k);
+        if (dirty) {
+            if (dirtyFirst >= line)
+                dirtyFirst += k;
+            if (dirtyLast >= line)
+                dirtyLast += k;
+        }
+    } else if (linesAdded < 0) {
+        // Lines line + 1 .. line + k were joined into line.
+        index.removeLines(line + 1, k);
+        if (dirty) {
+            auto shift = [line, k](size_t d) {
+                return d <= line ? d : d <= line + k ? line : d - k;
+            };
+            dirtyFirst = shift(dirtyFirst);
+            dirtyLast = shift(dirtyLast);
+        }
+    }
+
+    if (index.lineCount() != static_cast<size_t>(source.lineCount())) {
+        // Should not happen, but never let the index drift from the document.
+        reset();
+        return;
+    }
+
+    markDirty(line > 0 ? line - 1 : 0, line + (linesAdded > 0 ? k : 0) + 1);
+}
+
+void IncrementalStats::markDirty(size_t first, size_t last) {
+    const size_t lastLine = index.lineCount() > 0 ? index.lineCount() - 1 : 0;
+    first = std::min(first, lastLine);
+    last = std::min(last, lastLine);
+    if (dirty) {
+        dirtyFirst = std::min(dirtyFirst, first);
+        dirtyLast = std::max(std::min(dirtyLast, lastLine), last);
+    } else {
+        dirtyFirst = first;
+        dirtyLast = last;
+        dirty = true;
+    }
+}
+
+IncrementalStats::Range IncrementalStats::dirtyRange(int64_t maxLength) const {
+    Range range;
+    if (!dirty)
+        return range;
+
+    const size_t lineCount = index.lineCount();
+    size_t last = dirtyLast;
+    range.start = source.lineStart(static_cast<int64_t>(dirtyFirst));
+    int64_t end = last + 1 < lineCount
+        ? source.lineStart(static_cast<int64_t>(last + 1))
+        : source.length();
+
+    if (end - range.start > maxLength) {
+        // Lines before the one holding byte start + maxLength fit.
+        const size_t over = static_cast<size_t>(source.lineFromPosition(range.start + maxLength));
+        last = std::max(dirtyFirst, over > 0 ? over - 1 : 0);
+        if (last < dirtyLast)
+            end = source.lineStart(static_cast<int64_t>(last + 1));
+        else
+            last = dirtyLast;
+    }
+
+    range.firstLine = dirtyFirst;
+    range.lineCount = last - dirtyFirst + 1;
+    range.length = end - range.start;
+    return range;
+}
+
+void IncrementalStats::recountDirty() {
+    if (!dirty)
+        return;
+
+    const Range range = dirtyRange();
+    std::vector<LineCounts> counts(range.lineCount);
+    counter.countLines(source.rangePointer(range.start, range.length), range.length,
+                       counts.data(), counts.size());
+    applyCounts(range.firstLine, counts.data(), counts.size());
+}
+
+void IncrementalStats::applyCounts(size_t firstLine, const LineCounts *counts, size_t count) {
+    index.setLines(firstLine, counts, count);
+    if (dirty && firstLine <= dirtyFirst && firstLine + count > dirtyFirst
+            && firstLine + count <= dirtyLast)
+        dirtyFirst = firstLine + count;
+    else
+        dirty = false;
+}
+
+TextCounts IncrementalStats::rangeTotals(int64_t start, int64_t end) {
+    const int64_t length = source.length();
+    start = std::min(std::max<int64_t>(start, 0), length);
+    end = std::min(std::max(end, start), length);
+    if (start == end)
+        return TextCounts();
+
+    const size_t firstLine = static_cast<size_t>(source.lineFromPosition(start));
+    const size_t lastLine = static_cast<size_t>(source.lineFromPosition(end));
+    if (firstLine == lastLine)
+        return countText(start, end);
+
+    size_t firstWhole = firstLine;
+    const int64_t wholeStart = source.lineStart(static_cast<int64_t>(firstLine)) == start
+        ? start
+        : source.lineStart(static_cast<int64_t>(++firstWhole));
+    const int64_t lastStart = source.lineStart(static_cast<int64_t>(lastLine));
+
+    TextCounts result = countText(start, wholeStart);
+    result += index.sum(firstWhole, lastLine - firstWhole);
+    result += countText(lastStart, end);
+    return result;
+}
+
+TextCounts IncrementalStats::countText(int64_t start, int64_t end) {
+    TextCounts result;
+    if (start >= end)
+        return result;
+
+    std::vector<LineCounts> counts;
+    counter.countLines(source.rangePointer(start, end - start), end - start, counts);
+    for (const LineCounts &c : counts)
+        result += c;
+    return result;
+}
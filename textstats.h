@@ -0,0 +1,285 @@
+#ifndef TEXTSTATS_H
+#define TEXTSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unicode/brkiter.h>
+#include <unicode/locid.h>
+
+// Word, grapheme and code point counts of one document line, including its
+// line end. A line end is always both a word and a grapheme boundary, so the
+// counts of whole lines simply add up.
+struct LineCounts {
+    uint32_t words = 0;
+    uint32_t graphemes = 0;
+    uint32_t codePoints = 0;
+
+    LineCounts &operator+=(const LineCounts &c) {
+        words += c.words;
+        graphemes += c.graphemes;
+        codePoints += c.codePoints;
+        return *this;
+    }
+};
+
+struct TextCounts {
+    int64_t words = 0;
+    int64_t graphemes = 0;
+    int64_t codePoints = 0;
+
+    TextCounts &operator+=(const LineCounts &c) {
+        words += c.words;
+        graphemes += c.graphemes;
+        codePoints += c.codePoints;
+        return *this;
+    }
+
+    TextCounts &operator-=(const LineCounts &c) {
+        words -= c.words;
+        graphemes -= c.graphemes;
+        codePoints -= c.codePoints;
+        return *this;
+    }
+
+    TextCounts &operator+=(const TextCounts &c) {
+        words += c.words;
+        graphemes += c.graphemes;
+        codePoints += c.codePoints;
+        return *this;
+    }
+
+    TextCounts &operator-=(const TextCounts &c) {
+        words -= c.words;
+        graphemes -= c.graphemes;
+        codePoints -= c.codePoints;
+        return *this;
+    }
+};
+
+// Process-wide cache of ICU break iterators. Rule data and dictionaries are
+// loaded once per locale and kind into a prototype; callers get clones of it,
+// and clones handed back are kept for the next caller, on any thread.
+class BreakIteratorPool {
+public:
+    enum Kind { Word, Character };
+
+    class Return {
+    public:
+        Return() = default;
+        explicit Return(std::string key) : key(std::move(key)) {}
+        void operator()(icu::BreakIterator *iter) const;
+
+    private:
+        std::string key;
+    };
+
+    using Handle = std::unique_ptr<icu::BreakIterator, Return>;
+
+    static BreakIteratorPool &instance();
+
+    // True if the word and character rules of locale are ICU's root rules,
+    // which TextCounter's ASCII fast path reproduces.
+    bool hasRootRules(const icu::Locale &locale);
+
+    // Returns an iterator for locale and kind, or a null handle if ICU has no
+    // rules for it. The iterator goes back to the pool when the handle dies.
+    Handle acquire(const icu::Locale &locale, Kind kind);
+
+private:
+    struct Entry {
+        std::unique_ptr<icu::BreakIterator> prototype;
+        std::vector<std::unique_ptr<icu::BreakIterator>> idle;
+    };
+
+    BreakIteratorPool() = default;
+    void release(const std::string &key, icu::BreakIterator *iter);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<std::string, bool> rootRules;
+};
+
+// Counts words and graphemes with ICU break iterators taken from the pool.
+// They are re-targeted with setText() on every call, never rebuilt, and
+// taken only on the first call, so a counter costs nothing to construct. Runs
+// of ASCII are counted without ICU, a 64-byte block at a time, whenever the
+// locale uses the root rules; the result is identical.
+class TextCounter {
+public:
+    explicit TextCounter(const icu::Locale &locale = icu::Locale::getDefault());
+
+    const icu::Locale &locale() const { return loc; }
+
+    // On by default where the rules allow it; off sends all text to ICU.
+    void setAsciiFastPath(bool enabled);
+
+    // Counts the UTF-8 text [utf8, utf8 + length), which must start at a line
+    // start or a splitPointAfter() offset, and adds the counts of its lines to
+    // lines[0 .. lineCount). The text is read in place through a UTF-8 UText;
+    // nothing is copied. Returns the number of line ends in the text.
+    size_t countLines(const char *utf8, int64_t length, LineCounts *lines, size_t lineCount);
+
+    // Counts like the above into lines, sized to one entry per line end plus
+    // one for the text after the last.
+    void countLines(const char *utf8, int64_t length, std::vector<LineCounts> &lines);
+
+private:
+    class LineCursor;
+
+    // Takes the iterators from the pool, once.
+    void prepare();
+    void count(const char *utf8, int64_t length, const std::vector<int64_t> &lineEnds,
+               LineCounts *lines, size_t lineCount);
+    void countIcu(const char *utf8, int64_t begin, int64_t end,
+                  LineCursor &wordLines, LineCursor &charLines);
+    void countAscii(const char *utf8, int64_t begin, int64_t end,
+                    LineCursor &wordLines, LineCursor &charLines);
+
+    icu::Locale loc;
+    BreakIteratorPool::Handle wordIter;
+    BreakIteratorPool::Handle charIter;
+    bool prepared = false;
+    bool asciiFastPathWanted = true;
+    bool asciiFastPath = false;
+};
+
+// Returns the first offset at or after from where the text can be cut into
+// pieces that count the same apart as together, or length if there is none.
+// Line starts qualify, and so do most points between two ASCII characters
+// after white space or punctuation; a cut never falls inside a word, so
+// dictionary-segmented scripts are never split.
+int64_t splitPointAfter(const char *utf8, int64_t length, int64_t from);
+
+// Per-line counts with a running total. Lines are kept in small blocks so
+// inserting or removing lines only shifts one block, and a Fenwick tree over
+// the blocks finds the block of a line and sums the blocks before it in
+// O(log n), so any range of lines is summed without walking the document.
+class LineStatsIndex {
+public:
+    LineStatsIndex();
+
+    // Replaces the contents with lineCount zeroed lines.
+    void reset(size_t lineCount);
+
+    size_t lineCount() const { return lines; }
+    const TextCounts &totals() const { return total; }
+
+    // Overwrites the counts of lines [first, first + count).
+    void setLines(size_t first, const LineCounts *counts, size_t count);
+
+    // Inserts count zeroed lines before line at.
+    void insertLines(size_t at, size_t count);
+    void removeLines(size_t at, size_t count);
+
+    // Sum of lines [first, first + count).
+    TextCounts sum(size_t first, size_t count) const;
+
+private:
+    struct Block {
+        std::vector<LineCounts> lines;
+        TextCounts sum;
+    };
+
+    struct TreeNode {
+        int64_t lines = 0;
+        TextCounts sum;
+    };
+
+    // Returns the block holding line and turns line into an offset in it.
+    size_t locate(size_t &line) const;
+    // Sum of lines [0, line).
+    TextCounts sumBefore(size_t line) const;
+    void splitBlock(size_t index);
+
+    void addToTree(size_t block, int64_t lineDelta, const TextCounts &sumDelta);
+    void rebuildTree();
+
+    std::vector<Block> blocks;
+    std::vector<TreeNode> tree;
+    size_t lines = 0;
+    TextCounts total;
+};
+
+// Read access to a UTF-8 document using Scintilla's line model: a line ends
+// after LF, CR LF or a lone CR, and the last line has no line end.
+class TextSource {
+public:
+    virtual ~TextSource() = default;
+
+    virtual int64_t length() const = 0;
+    virtual int64_t lineCount() const = 0;
+    virtual int64_t lineFromPosition(int64_t position) const = 0;
+    virtual int64_t lineStart(int64_t line) const = 0;
+
+    // Returns the bytes [start, start + length) in place. The pointer stays
+    // valid until the document is next modified.
+    virtual const char *rangePointer(int64_t start, int64_t length) const = 0;
+};
+
+// Keeps the counts of a TextSource current from its edit notifications.
+// An edit only marks the lines it touched dirty, plus one line of context on
+// either side (for CR LF pairs that an edit splits or joins); the dirty lines
+// are then re-counted either in place with recountDirty() or elsewhere from
+// a snapshot of dirtyRange(), with the result handed back to applyCounts().
+class IncrementalStats {
+public:
+    struct Range {
+        size_t firstLine = 0;
+        size_t lineCount = 0;
+        int64_t start = 0;
+        int64_t length = 0;
+    };
+
+    explicit IncrementalStats(const TextSource &source,
+                              const icu::Locale &locale = icu::Locale::getDefault());
+
+    // Marks the whole document dirty.
+    void reset();
+
+    const icu::Locale &locale() const { return counter.locale(); }
+
+    // Switches to the word rules of locale and marks the document dirty.
+    void setLocale(const icu::Locale &locale);
+
+    // Call after text was inserted (linesAdded >= 0) or deleted
+    // (linesAdded <= 0) at position.
+    void textChanged(int64_t position, int64_t linesAdded);
+
+    bool isDirty() const { return dirty; }
+
+    // The dirty lines, or as many of the first ones as fit in maxLength
+    // bytes, but at least one line.
+    Range dirtyRange(int64_t maxLength = INT64_MAX) const;
+    void recountDirty();
+
+    // Counts may cover all dirty lines or only the first ones; the rest
+    // stay dirty.
+    void applyCounts(size_t firstLine, const LineCounts *counts, size_t count);
+
+    // Exact only while nothing is dirty.
+    const TextCounts &totals() const { return index.totals(); }
+
+    // Counts of the text [start, end) as if it stood alone. Whole lines come
+    // from the index; only the partial first and last lines are counted.
+    // Exact only while nothing is dirty.
+    TextCounts rangeTotals(int64_t start, int64_t end);
+
+private:
+    void markDirty(size_t first, size_t last);
+    TextCounts countText(int64_t start, int64_t end);
+
+    const TextSource &source;
+    TextCounter counter;
+    LineStatsIndex index;
+    bool dirty = false;
+    size_t dirtyFirst = 0;
+    size_t dirtyLast = 0;
+};
+
+#endif // TEXTSTATS_H